@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2025 Idan Gutman
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ *
+ * This example displays an animated SVG on TFT_eSPI, sending each band to the screen by DMA while the next one is rasterized.
+ */
+
+#include <TFT_eSPI.h>
+
+#include "AnimatedSVG.h"
+#include "ball_bounce_svg.h"
+
+#define TFT_WIDTH           240
+#define TFT_HEIGHT          240
+#define SVG_BUFFER_HEIGHT   16
+#define SVG_BANDS           2
+
+// SVG that clears the bands to the background color.
+class BackgroundSVG : public AnimatedSVG
+{
+public:
+	BackgroundSVG(const char* svg, unsigned char* rastBuffer, int bufferWidth, int bufferHeight, int options, unsigned short color) :
+		AnimatedSVG(svg, rastBuffer, bufferWidth, bufferHeight, options), _color(color)
+	{
+	}
+
+protected:
+	void clearDest(void* dstBuffer, int dstStride, int width, int height) override
+	{
+		for (int y = 0; y < height; y++)
+		{
+			unsigned short* row = (unsigned short*)((unsigned char*)dstBuffer + y * dstStride);
+			for (int x = 0; x < width; x++)
+			{
+				row[x] = _color;
+			}
+		}
+	}
+
+private:
+	unsigned short _color;
+};
+
+TFT_eSPI tft = TFT_eSPI();
+unsigned char* svgBuffer;
+void* bands[SVG_BANDS];
+BackgroundSVG* svg;
+unsigned long startTime;
+
+void pushBand(void* userData, void* band, int x, int y, int width, int height);
+
+void setup()
+{
+	Serial.begin(115200);
+
+	// Initialize TFT_eSPI package with DMA.
+	tft.begin();
+	tft.setRotation(0);
+	tft.fillScreen(TFT_BLACK);
+	tft.initDMA();
+
+	// Create buffer for SVG (must be BGRA).
+	svgBuffer = (unsigned char*)malloc(TFT_WIDTH * SVG_BUFFER_HEIGHT * 4);
+
+	// Create the bands in RGB565, in memory the DMA can read.
+	for (int i = 0; i < SVG_BANDS; i++)
+	{
+		bands[i] = heap_caps_malloc(TFT_WIDTH * SVG_BUFFER_HEIGHT * 2, MALLOC_CAP_DMA);
+	}
+
+	// Create the SVG, cleared to blue (with swapped bytes, like the image).
+	int svgOptions = ANIMATED_SVG_OPTION_RGB565 | ANIMATED_SVG_OPTION_SWAP_BYTES;
+	svg = new BackgroundSVG(ball_bounce_svg, svgBuffer, TFT_WIDTH, SVG_BUFFER_HEIGHT, svgOptions, (TFT_BLUE >> 8) | (TFT_BLUE << 8));
+
+	// Load the SVG.
+	if (!svg->load())
+	{
+		Serial.println("Failed loading SVG!");
+		Serial.flush();
+		while (true)
+			sleep(1000);
+	}
+
+	// Store start time in milliseconds.
+	startTime = millis();
+}
+
+void loop()
+{
+	// Get current time in milliseconds.
+	unsigned long now = millis();
+	unsigned long timeMs = now - startTime;
+
+	// Update animation.
+	svg->update(timeMs);
+
+	// Rasterize the image in bands, each pushed to the screen while the next is rasterized.
+	float scale = 1.0f;
+	tft.startWrite();
+	svg->rasterizeBands(bands, SVG_BANDS, SVG_BUFFER_HEIGHT, TFT_WIDTH, TFT_HEIGHT, pushBand, NULL,
+						TFT_WIDTH*(1-scale)/2, TFT_HEIGHT*(1-scale)/2, scale);
+	tft.dmaWait();
+	tft.endWrite();
+}
+
+void pushBand(void* userData, void* band, int x, int y, int width, int height)
+{
+	// Waits for the previous band to be sent, so its buffer can be rasterized again, and starts sending this band.
+	tft.pushImageDMA(x, y, width, height, (uint16_t*)band);
+}
@@ -0,0 +1,40 @@
+#ifndef BALL_BOUNCE_SVG_H
+#define BALL_BOUNCE_SVG_H
+
+const char ball_bounce_svg[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>"
+	"<svg width=\"240\" height=\"240\" viewBox=\"0 0 240 240\" xmlns=\"http://www.w3.org/2000/svg\" xmlns:svg=\"http://www.w3.org/2000/svg\">"
+	"  <g>"
+	"    <g>"
+	"      <g fill=\"none\" stroke=\"#000\" stroke-width=\"1.2\" stroke-linecap=\"round\" transform=\"translate(80,0)\">"
+	"         <circle cx=\"40.6\" cy=\"40.6\" r=\"40\" fill=\"#e26b00\"/>"
+	"         <path d=\"M 2.91862,54.024893 C -0.94074998,23.741421 41.512468,4.78255 77.114494,24.365866\" />"
+	"         <path d=\"M 28.230235,2.7254 C 11.17173,12.68738 23.328847,66.213381 55.221377,77.590675\" />"
+	"         <path d=\"m 7.45925,18.37609 c 12.06282,2.574785 -1.1632,45.199686 15.843914,58.255358\" />"
+	"         <path d=\"M 49.411803,1.51779 C 36.580288,4.8364 30.966916,9.87164 31.732318,18.4244 34.431635,48.587127 77.907594,41.556688 74.723589,61.264967\" />"
+	"         <animateTransform attributeName=\"transform\" attributeType=\"XML\" type=\"rotate\""
+	"            values=\"0,40.6,40.6; 360,40.6,40.6\""
+	"            begin=\"0s\" dur=\"5s\" repeatCount=\"indefinite\" additive=\"sum\" />"
+	"       </g>"
+	"       <animateTransform attributeName=\"transform\" attributeType=\"XML\" type=\"translate\""
+	"         values=\"0; 0,171; 0\""
+	"         keyTimes=\"0; 0.5; 1\""
+	"         keySplines=\"0.5,0, 0.2,1; 0.5,0, 0.2,1\""
+	"         calcMode=\"spline\""
+	"         begin=\"0s\" dur=\"1s\" repeatCount=\"indefinite\" additive=\"sum\" />"
+	"      <animateTransform attributeName=\"transform\" attributeType=\"XML\" type=\"scale\""
+	"         values=\"1; 1; 1,0.85; 1; 1\""
+	"         keyTimes=\"0; 0.25; 0.5; 0.8; 1\""
+	"         keySplines=\"0.42,0, 0.58,1; 0.42,0, 0.58,1; 0.42,0, 0.58,1; 0.42,0, 0.58,1\""
+	"         calcMode=\"spline\""
+	"         begin=\"0s\" dur=\"1s\" repeatCount=\"indefinite\" additive=\"sum\" />"
+	"   </g>"
+	"   <animateTransform attributeName=\"transform\" attributeType=\"XML\" type=\"translate\""
+	"      values=\"0; 80; -80; 0\""
+	"      keyTimes=\"0; 0.25; 0.75; 1\""
+	"      calcMode=\"linear\""
+	"      begin=\"0s\" dur=\"3s\" repeatCount=\"indefinite\" additive=\"sum\" />"
+	"  </g>"
+	"</svg>";
+
+#endif //BALL_BOUNCE_SVG_H
@@ -143,12 +143,15 @@ void renderSVG(AnimatedSVG* svg, unsigned long timeMs)
 	// Update animation.
 	svg->update(timeMs);
 
-	// Clear the buffer and rasterize the image.
+	// Rasterize only the areas that changed (cleared to black).
 	float scale = 1.0f;
-	buffer.fillScreen(TFT_BLACK);
-	svg->rasterize((unsigned short*)buffer.getPointer(), TFT_WIDTH, TFT_HEIGHT, TFT_WIDTH * 2,
-		TFT_WIDTH*(1-scale)/2, TFT_HEIGHT*(1-scale)/2, scale);
+	AnimatedSVGRect rects[ANIMATED_SVG_MAX_DIRTY_RECTS];
+	int count = svg->rasterizeDirty((unsigned short*)buffer.getPointer(), TFT_WIDTH, TFT_HEIGHT, TFT_WIDTH * 2,
+		rects, TFT_WIDTH*(1-scale)/2, TFT_HEIGHT*(1-scale)/2, scale);
 
-	// Push the double-buffer to the screen.
-	buffer.pushSprite(0, 0);
+	// Push the changed areas of the double-buffer to the screen.
+	for (int i = 0; i < count; i++)
+	{
+		buffer.pushSprite(rects[i].x, rects[i].y, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+	}
 }
@@ -23,36 +23,584 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "AnimatedSVG.h"
 
+// The counters of NanoSVG are collected for the stats.
+#if defined(ANIMATED_SVG_STATS) && !defined(NSVG_STATS)
+#define NSVG_STATS
+#endif
+
 #define NANOSVG_IMPLEMENTATION
 #include "nanosvg.h"
 #define NANOSVGRAST_IMPLEMENTATION
 #include "nanosvgrast.h"
 
+#if !defined(ANIMATED_SVG_NO_THREADS)
+#if defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#define ANIMATED_SVG_THREADS
+#define ANIMATED_SVG_THREADS_FREERTOS
+#elif !defined(ARDUINO)
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#define ANIMATED_SVG_THREADS
+#define ANIMATED_SVG_THREADS_STD
+#endif
+#endif
+
+#if defined(ANIMATED_SVG_STATS)
+#if defined(ESP_PLATFORM)
+#include "esp_timer.h"
+#elif defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+#endif
+
 #define ANIMATED_SVG_UNITS  "px"
 #define ANIMATED_SVG_DPI    96
 
+#define ANIMATED_SVG_READ_CHUNK_SIZE    256     // Size of the chunks read by the read callback.
+
+#if defined(ANIMATED_SVG_THREADS_FREERTOS)
+#define ANIMATED_SVG_MAX_WORKERS    1   // One worker on the other core.
+#else
+#define ANIMATED_SVG_MAX_WORKERS    8
+#endif
+#define ANIMATED_SVG_WORKER_SLOTS   2   // Buffer slots per worker, so a worker can rasterize while the previous slot is copied.
+#define ANIMATED_SVG_MIN_TILE_ROWS  8   // Fewest rows of the tiles of the workers, as the edges are set up again for every tile.
+
+#if defined(ANIMATED_SVG_THREADS)
+
+// Counting semaphore.
+class AnimatedSVGSemaphore
+{
+public:
+#if defined(ANIMATED_SVG_THREADS_STD)
+    AnimatedSVGSemaphore() : _count(0) {}
+
+    void give()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _count++;
+        _cond.notify_one();
+    }
+
+    void take()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_count == 0)
+        {
+            _cond.wait(lock);
+        }
+        _count--;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int _count;
+#else
+    AnimatedSVGSemaphore() { _sem = xSemaphoreCreateCounting(ANIMATED_SVG_WORKER_SLOTS, 0); }
+    ~AnimatedSVGSemaphore() { vSemaphoreDelete(_sem); }
+
+    void give() { xSemaphoreGive(_sem); }
+    void take() { xSemaphoreTake(_sem, portMAX_DELAY); }
+
+private:
+    SemaphoreHandle_t _sem;
+#endif
+};
+
+// Rasterization of a rectangle, shared with the workers.
+struct AnimatedSVGJob
+{
+    const NSVGrasterizedImage* prepared;
+    int firstShape;
+    int shapeCount;
+    unsigned char* buffer;
+    int bufferStride;
+    int slotHeight;
+    AnimatedSVGRect rect;
+    int tileWidth;
+    int tileHeight;
+    int nx;
+    int count;
+    int nworkers;
+    int format;
+    int pitch;
+    int quality;
+    float tx;
+    float ty;
+};
+
+struct AnimatedSVGWorkers;
+
+// Argument of a worker thread.
+struct AnimatedSVGWorker
+{
+    AnimatedSVGWorkers* workers;
+    int index;
+    NSVGrasterizer* rasterizer;
+    AnimatedSVGSemaphore start;
+#if defined(ANIMATED_SVG_THREADS_STD)
+    std::thread thread;
+#else
+    AnimatedSVGSemaphore done;
+#endif
+};
+
+// Worker threads, each with its own rasterizer context for the scratch memory.
+// Tile k of a job is rasterized by worker k % nworkers, in buffer slot (k % nworkers) * slots + (k / nworkers) % slots.
+struct AnimatedSVGWorkers
+{
+    int count;
+    bool quit;
+    AnimatedSVGJob job;
+    AnimatedSVGWorker workers[ANIMATED_SVG_MAX_WORKERS];
+    AnimatedSVGSemaphore slotFree[ANIMATED_SVG_MAX_WORKERS * ANIMATED_SVG_WORKER_SLOTS];
+    AnimatedSVGSemaphore slotReady[ANIMATED_SVG_MAX_WORKERS * ANIMATED_SVG_WORKER_SLOTS];
+};
+
+#else
+
+struct AnimatedSVGWorkers;
+
+#endif
+
 // Structure containing the SVG data-types.
 struct AnimatedSVGImage
 {
     NSVGimage* svgImage;
+    NSVGrasterizedImage* svgPrepared;
+    // Shared rasterizer context, acquired while rasterizing.
     NSVGrasterizer* svgRasterizer;
+    AnimatedSVGWorkers* workers;
     bool isAnimated;
+    // Placement of the last rasterize, used for dirty rectangles.
+    bool rasterized;
+    void* dst;
+    int dstWidth;
+    int dstHeight;
+    float tx;
+    float ty;
+    float scale;
+    // Shapes rasterized by rasterizeRect(), over the static layer when it is used.
+    int firstShape;
+    int shapeCount;
+    bool useLayer;
+    // Static layer, the shapes below the first animated shape rasterized in the destination format.
+    int staticShapes;
+    unsigned char* layer;
+    int layerSize;
+    bool layerAllocated;
+    bool layerValid;
+    int layerWidth;
+    int layerHeight;
+    float layerTx;
+    float layerTy;
+    float layerScale;
+    int layerQuality;
+    float layerTolerance;
+};
+
+// Rasterizer context for scratch memory, shared by all instances.
+struct AnimatedSVGContext
+{
+    NSVGrasterizer* rasterizer;
+    bool busy;
+    AnimatedSVGContext* next;
 };
 
-// Global rasterizer, used by all instances.
-static NSVGrasterizer* g_svgRasterizer = NULL;
-static int g_svgRasterizerRefCount = 0;
+// Global rasterizer contexts, one for each instance rasterizing at the same time.
+static AnimatedSVGContext* g_svgContexts = NULL;
+static int g_svgContextsRefCount = 0;
+
+#if defined(ANIMATED_SVG_THREADS_STD)
+static std::mutex g_svgContextsMutex;
+static void lockContexts() { g_svgContextsMutex.lock(); }
+static void unlockContexts() { g_svgContextsMutex.unlock(); }
+#elif defined(ANIMATED_SVG_THREADS_FREERTOS)
+static portMUX_TYPE g_svgContextsMux = portMUX_INITIALIZER_UNLOCKED;
+static void lockContexts() { taskENTER_CRITICAL(&g_svgContextsMux); }
+static void unlockContexts() { taskEXIT_CRITICAL(&g_svgContextsMux); }
+#else
+static void lockContexts() {}
+static void unlockContexts() {}
+#endif
+
+// Acquire a shared rasterizer context, creating a new one if all are in use.
+static NSVGrasterizer* acquireRasterizer()
+{
+    lockContexts();
+    for (AnimatedSVGContext* context = g_svgContexts; context != NULL; context = context->next)
+    {
+        if (!context->busy)
+        {
+            context->busy = true;
+            unlockContexts();
+            return context->rasterizer;
+        }
+    }
+    unlockContexts();
+
+    AnimatedSVGContext* context = new AnimatedSVGContext;
+    if (context == NULL)
+    {
+        return NULL;
+    }
+    context->rasterizer = nsvgCreateRasterizer();
+    if (context->rasterizer == NULL)
+    {
+        delete context;
+        return NULL;
+    }
+    context->busy = true;
+
+    lockContexts();
+    context->next = g_svgContexts;
+    g_svgContexts = context;
+    unlockContexts();
+
+    return context->rasterizer;
+}
+
+// Release a shared rasterizer context.
+static void releaseRasterizer(NSVGrasterizer* rasterizer)
+{
+    lockContexts();
+    for (AnimatedSVGContext* context = g_svgContexts; context != NULL; context = context->next)
+    {
+        if (context->rasterizer == rasterizer)
+        {
+            context->busy = false;
+            break;
+        }
+    }
+    unlockContexts();
+}
+
+// Get the position of a tile of a rectangle split to tiles of the given size.
+static void getTile(const AnimatedSVGRect& rect, int tileWidth, int tileHeight, int nx, int index, AnimatedSVGRect& tile)
+{
+    int x = index % nx;
+    int y = index / nx;
+    tile.x = rect.x + x * tileWidth;
+    tile.y = rect.y + y * tileHeight;
+    tile.width = (x + 1) * tileWidth <= rect.width ? tileWidth : rect.width - x * tileWidth;
+    tile.height = (y + 1) * tileHeight <= rect.height ? tileHeight : rect.height - y * tileHeight;
+}
+
+// Count the shapes before the first shape node with animations, which never change.
+// Later shapes are drawn over animated shapes, so they are not static even without animations.
+static int countStaticShapes(NSVGimage* image)
+{
+    int count = 0;
+    for (NSVGshapeNode* shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next)
+    {
+        for (int i = 0; i < image->nanimatedNodes; i++)
+        {
+            if (image->animatedNodes[i].node == shapeNode)
+            {
+                return count;
+            }
+        }
+        if (shapeNode->shape != NULL)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+#if defined(ANIMATED_SVG_THREADS)
+
+// Get the buffer slot of a tile.
+static int getTileSlot(const AnimatedSVGJob& job, int index)
+{
+    return (index % job.nworkers) * ANIMATED_SVG_WORKER_SLOTS + (index / job.nworkers) % ANIMATED_SVG_WORKER_SLOTS;
+}
+
+// Rasterize the tiles of the jobs given to a worker.
+static void workerMain(AnimatedSVGWorker* worker)
+{
+    AnimatedSVGWorkers* workers = worker->workers;
+
+    for (;;)
+    {
+        worker->start.take();
+        if (workers->quit)
+        {
+            break;
+        }
+
+        // Copy the job, it can be replaced once the last tile is ready.
+        AnimatedSVGJob job = workers->job;
+        for (int i = worker->index; i < job.count; i += job.nworkers)
+        {
+            int slot = getTileSlot(job, i);
+            unsigned char* buffer = job.buffer + slot * job.slotHeight * job.bufferStride;
+            AnimatedSVGRect tile;
+            getTile(job.rect, job.tileWidth, job.tileHeight, job.nx, i, tile);
+
+            workers->slotFree[slot].take();
+            nsvgRasterizerSetFormat(worker->rasterizer, job.format);
+            nsvgRasterizerSetSubsamples(worker->rasterizer, job.quality);
+            if (job.format != NSVG_RAST_FORMAT_RGBA)
+            {
+                // Tiles are blended straight into the destination.
+                buffer = job.buffer + tile.x * job.pitch + tile.y * job.bufferStride;
+            }
+            else if (!nsvgRasterizeIsOpaqueShapes(job.prepared, job.firstShape, job.shapeCount, job.tx - tile.x, job.ty - tile.y,
+                                                  tile.width, tile.height))
+            {
+                memset(buffer, 0, tile.height * job.bufferStride);
+            }
+            nsvgRasterizeFinishImageShapes(worker->rasterizer, job.prepared, job.firstShape, job.shapeCount,
+                                           job.tx - tile.x, job.ty - tile.y, buffer, tile.width, tile.height, job.bufferStride);
+            workers->slotReady[slot].give();
+        }
+    }
+}
+
+#if defined(ANIMATED_SVG_THREADS_FREERTOS)
+// FreeRTOS task of a worker.
+static void workerTask(void* arg)
+{
+    AnimatedSVGWorker* worker = (AnimatedSVGWorker*)arg;
+    workerMain(worker);
+    worker->done.give();
+    vTaskDelete(NULL);
+}
+#endif
+
+// Delete the worker threads.
+static void deleteWorkers(AnimatedSVGWorkers* workers)
+{
+    workers->quit = true;
+    for (int i = 0; i < workers->count; i++)
+    {
+        AnimatedSVGWorker* worker = &workers->workers[i];
+        worker->start.give();
+#if defined(ANIMATED_SVG_THREADS_STD)
+        worker->thread.join();
+#else
+        worker->done.take();
+#endif
+        nsvgDeleteRasterizer(worker->rasterizer);
+    }
+
+    delete workers;
+}
+
+// Create the worker threads, on desktop one per hardware thread and on dual-core ESP32 one on the other core.
+static AnimatedSVGWorkers* createWorkers()
+{
+    AnimatedSVGWorkers* workers = new AnimatedSVGWorkers;
+    if (workers == NULL)
+    {
+        return NULL;
+    }
+    workers->count = 0;
+    workers->quit = false;
+    for (int i = 0; i < ANIMATED_SVG_MAX_WORKERS * ANIMATED_SVG_WORKER_SLOTS; i++)
+    {
+        workers->slotFree[i].give();
+    }
+
+#if defined(ANIMATED_SVG_THREADS_STD)
+    int count = (int)std::thread::hardware_concurrency();
+    count = (count < 1) ? 1 : (count > ANIMATED_SVG_MAX_WORKERS) ? ANIMATED_SVG_MAX_WORKERS : count;
+#else
+    int count = portNUM_PROCESSORS - 1;
+#endif
+    for (int i = 0; i < count; i++)
+    {
+        AnimatedSVGWorker* worker = &workers->workers[i];
+        worker->workers = workers;
+        worker->index = i;
+        worker->rasterizer = nsvgCreateRasterizer();
+        if (worker->rasterizer == NULL)
+        {
+            break;
+        }
+#if defined(ANIMATED_SVG_THREADS_STD)
+        worker->thread = std::thread(workerMain, worker);
+#else
+        if (xTaskCreatePinnedToCore(workerTask, "AnimatedSVG", 4096, worker, uxTaskPriorityGet(NULL), NULL,
+                                    xPortGetCoreID() ? 0 : 1) != pdPASS)
+        {
+            nsvgDeleteRasterizer(worker->rasterizer);
+            break;
+        }
+#endif
+        workers->count++;
+    }
+
+    if (workers->count == 0)
+    {
+        deleteWorkers(workers);
+        return NULL;
+    }
+
+    return workers;
+}
+
+#endif
+
+// Parse an SVG file read in chunks by the callback, only an element split between chunks is buffered by the parser.
+static NSVGimage* parseChunks(NSVGparser* parser, AnimatedSVGReadCallback readCallback, void* userData)
+{
+    char chunk[ANIMATED_SVG_READ_CHUNK_SIZE];
+    if (parser == NULL)
+    {
+        return NULL;
+    }
+
+    int len;
+    while ((len = readCallback(userData, chunk, sizeof(chunk))) > 0)
+    {
+        if (!nsvgParseFeed(parser, chunk, len))
+        {
+            break;
+        }
+    }
+
+    // A read error is not reported by the parser, so the partial image is deleted.
+    NSVGimage* image = nsvgParseEnd(parser);
+    if (len < 0 && image != NULL)
+    {
+        nsvgDelete(image);
+        image = NULL;
+    }
+
+    return image;
+}
+
+#if defined(ANIMATED_SVG_STATS)
+// Get the time in microseconds for the stats.
+static unsigned long getTimeUs()
+{
+#if defined(ESP_PLATFORM)
+    return (unsigned long)esp_timer_get_time();
+#elif defined(ARDUINO)
+    return micros();
+#else
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Add the counters of a rasterizer context to the stats, and reset them.
+static void addRasterizerStats(AnimatedSVGStats& stats, NSVGrasterizer* rasterizer)
+{
+    NSVGrasterizerStats rasterizerStats;
+    nsvgRasterizerGetStats(rasterizer, &rasterizerStats);
+    nsvgRasterizerResetStats(rasterizer);
+
+    stats.shapesPrepared += rasterizerStats.shapes;
+    stats.edgesPrepared += rasterizerStats.edges;
+    stats.bands += rasterizerStats.bands;
+    stats.edgesVisited += rasterizerStats.edgesVisited;
+    stats.pixelsBlended += rasterizerStats.pixels;
+    stats.activeEdgeTableGrows += rasterizerStats.activeGrows;
+    if (rasterizerStats.maxActiveEdges > stats.maxActiveEdges)
+    {
+        stats.maxActiveEdges = rasterizerStats.maxActiveEdges;
+    }
+}
+#endif
+
+// Get the rasterizer format of the options, blending straight into the destination or into the RGBA rasterize buffer.
+static int getRasterizerFormat(int options)
+{
+    int format = NSVG_RAST_FORMAT_RGBA;
+    if (options & ANIMATED_SVG_OPTION_DIRECT)
+    {
+        format = (options & ANIMATED_SVG_OPTION_BGRA8888) ? NSVG_RAST_FORMAT_BGRA8888 :
+                 !(options & ANIMATED_SVG_OPTION_RGB565) ? NSVG_RAST_FORMAT_RGBA :
+                 (options & ANIMATED_SVG_OPTION_SWAP_BYTES) ? NSVG_RAST_FORMAT_RGB565_SWAPPED : NSVG_RAST_FORMAT_RGB565;
+    }
+    if (format != NSVG_RAST_FORMAT_RGBA && (options & ANIMATED_SVG_OPTION_NO_ANTIALIASING))
+    {
+        format |= NSVG_RAST_FORMAT_ALIASED;
+    }
+
+    return format;
+}
 
 // Constructor.
 // Rasterize buffer should be in RGBA format (32 bits), but can be smaller than image size.
 AnimatedSVG::AnimatedSVG(const char* svg, unsigned char* rastBuffer, int bufferWidth, int bufferHeight, int options)
 {
     _svg = svg;
+    _binary = NULL;
+    _binarySize = 0;
+    _readCallback = NULL;
+    _readUserData = NULL;
+    _imageMemory = NULL;
+    _imageMemorySize = 0;
+    _layerMemory = NULL;
+    _layerMemorySize = 0;
+    _scale = 1;
+    _options = options;
+    _quality = (options & ANIMATED_SVG_OPTION_NO_ANTIALIASING) ? ANIMATED_SVG_QUALITY_DRAFT : ANIMATED_SVG_QUALITY_NORMAL;
+    _tolerance = ANIMATED_SVG_TOLERANCE_NORMAL;
+    resetStats();
+
+    _image = NULL;
+
+    setBuffer(rastBuffer, bufferWidth, bufferHeight);
+}
+
+// Constructor for an image compiled by svgcompile, loaded without parsing.
+AnimatedSVG::AnimatedSVG(const unsigned char* binary, int binarySize, unsigned char* rastBuffer, int bufferWidth, int bufferHeight, int options)
+{
+    _svg = NULL;
+    _binary = binary;
+    _binarySize = binarySize;
+    _readCallback = NULL;
+    _readUserData = NULL;
+    _imageMemory = NULL;
+    _imageMemorySize = 0;
+    _layerMemory = NULL;
+    _layerMemorySize = 0;
+    _scale = 1;
+    _options = options;
+    _quality = (options & ANIMATED_SVG_OPTION_NO_ANTIALIASING) ? ANIMATED_SVG_QUALITY_DRAFT : ANIMATED_SVG_QUALITY_NORMAL;
+    _tolerance = ANIMATED_SVG_TOLERANCE_NORMAL;
+    resetStats();
+
+    _image = NULL;
+
+    setBuffer(rastBuffer, bufferWidth, bufferHeight);
+}
+
+// Constructor for an SVG file read in chunks by the callback.
+AnimatedSVG::AnimatedSVG(AnimatedSVGReadCallback readCallback, void* userData, unsigned char* rastBuffer, int bufferWidth,
+                         int bufferHeight, int options)
+{
+    _svg = NULL;
+    _binary = NULL;
+    _binarySize = 0;
+    _readCallback = readCallback;
+    _readUserData = userData;
+    _imageMemory = NULL;
+    _imageMemorySize = 0;
+    _layerMemory = NULL;
+    _layerMemorySize = 0;
     _scale = 1;
     _options = options;
+    _quality = (options & ANIMATED_SVG_OPTION_NO_ANTIALIASING) ? ANIMATED_SVG_QUALITY_DRAFT : ANIMATED_SVG_QUALITY_NORMAL;
+    _tolerance = ANIMATED_SVG_TOLERANCE_NORMAL;
+    resetStats();
 
     _image = NULL;
 
@@ -104,35 +652,73 @@ bool AnimatedSVG::load()
     }
     memset(_image, 0, sizeof(AnimatedSVGImage));
 
-    // Parse the SVG image.
-    _image->svgImage = nsvgParse((char*)_svg, ANIMATED_SVG_UNITS, ANIMATED_SVG_DPI);
+    // Parse the SVG image, or load the compiled image, in the arena of the image if requested.
+    bool arena = (_options & ANIMATED_SVG_OPTION_ARENA) != 0;
+    if (_binary != NULL)
+    {
+        int flags = (_options & ANIMATED_SVG_OPTION_IN_PLACE) ? NSVG_BINARY_IN_PLACE : 0;
+        _image->svgImage = arena ? nsvgParseBinaryArena(_binary, _binarySize, flags, _imageMemory, _imageMemorySize) :
+                                   nsvgParseBinary(_binary, _binarySize, flags);
+    }
+    else
+    {
+        NSVGparser* parser = arena ? nsvgParseBeginArena(ANIMATED_SVG_UNITS, ANIMATED_SVG_DPI, _imageMemory, _imageMemorySize) :
+                                     nsvgParseBegin(ANIMATED_SVG_UNITS, ANIMATED_SVG_DPI);
+        if (_readCallback != NULL)
+        {
+            _image->svgImage = parseChunks(parser, _readCallback, _readUserData);
+        }
+        else if (parser != NULL)
+        {
+            nsvgParseFeed(parser, _svg, (int)strlen(_svg));
+            _image->svgImage = nsvgParseEnd(parser);
+        }
+    }
     if (_image->svgImage == NULL)
     {
         unload();
         return false;
     }
     _image->isAnimated = nsvgIsAnimated(_image->svgImage) ? true : false;
+    _image->staticShapes = countStaticShapes(_image->svgImage);
 
-    // Create rasterizer.
-    if (g_svgRasterizer == NULL)
+    // Create the prepared image, the rasterizer contexts are shared.
+    _image->svgPrepared = nsvgCreateRasterizedImage();
+    if (_image->svgPrepared == NULL)
     {
-        g_svgRasterizer = nsvgCreateRasterizer();
-        if (g_svgRasterizer == NULL)
-        {
-            unload();
-            return false;
-        }
+        unload();
+        return false;
     }
-    _image->svgRasterizer = g_svgRasterizer;
-    g_svgRasterizerRefCount++;
+    lockContexts();
+    g_svgContextsRefCount++;
+    unlockContexts();
+
+#if defined(ANIMATED_SVG_THREADS)
+    // Create worker threads, rasterizing serially if not possible.
+    if ((_options & ANIMATED_SVG_OPTION_PARALLEL) && !(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
+    {
+        _image->workers = createWorkers();
+    }
+#endif
 
     // Create rasterized image.
     if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
     {
         // Prepare the rasterized image once, to allocate most of the memory on load.
-        nsvgRasterizePrepare(_image->svgRasterizer, _image->svgImage, _scale);
+        _image->svgRasterizer = acquireRasterizer();
+        if (_image->svgRasterizer == NULL)
+        {
+            unload();
+            return false;
+        }
+        prepare();
+        releaseRasterizer(_image->svgRasterizer);
+        _image->svgRasterizer = NULL;
     }
 
+    // Frames are counted from the loaded image.
+    resetStats();
+
     return true;
 }
 
@@ -145,19 +731,46 @@ void AnimatedSVG::unload()
         return;
     }
 
+#if defined(ANIMATED_SVG_THREADS)
+    if (_image->workers != NULL)
+    {
+        deleteWorkers(_image->workers);
+        _image->workers = NULL;
+    }
+#endif
+
     if (_image->svgImage != NULL)
     {
         nsvgDelete(_image->svgImage);
         _image->svgImage = NULL;
     }
 
-    if (_image->svgRasterizer != NULL)
+    if (_image->layerAllocated)
+    {
+        free(_image->layer);
+    }
+
+    if (_image->svgPrepared != NULL)
     {
-        g_svgRasterizerRefCount--;
-        if (g_svgRasterizerRefCount == 0)
+        nsvgDeleteRasterizedImage(_image->svgPrepared);
+        _image->svgPrepared = NULL;
+
+        // Delete the shared rasterizer contexts with the last instance.
+        AnimatedSVGContext* contexts = NULL;
+        lockContexts();
+        g_svgContextsRefCount--;
+        if (g_svgContextsRefCount == 0)
+        {
+            contexts = g_svgContexts;
+            g_svgContexts = NULL;
+        }
+        unlockContexts();
+        while (contexts != NULL)
         {
-            nsvgDeleteRasterizer(g_svgRasterizer);
-            g_svgRasterizer = NULL;
+            AnimatedSVGContext* next = contexts->next;
+            nsvgDeleteRasterizer(contexts->rasterizer);
+            delete contexts;
+            contexts = next;
         }
     }
 
@@ -168,6 +781,11 @@ void AnimatedSVG::unload()
 // Update the animation according to timestamp.
 bool AnimatedSVG::update(long timeMs)
 {
+#if defined(ANIMATED_SVG_STATS)
+    // Start a new frame.
+    resetStats();
+#endif
+
     // Check that image was loaded.
     if (_image == NULL || !_image->isAnimated)
     {
@@ -175,7 +793,28 @@ bool AnimatedSVG::update(long timeMs)
     }
 
     // Animate the image.
+#if defined(ANIMATED_SVG_STATS)
+    unsigned long startUs = getTimeUs();
+    _image->svgImage->nevaluatedAnimates = 0;
+    bool changed = nsvgAnimate(_image->svgImage, timeMs) ? true : false;
+    _stats.animateUs += getTimeUs() - startUs;
+    _stats.animatesEvaluated += _image->svgImage->nevaluatedAnimates;
+    return changed;
+#else
     return nsvgAnimate(_image->svgImage, timeMs) ? true : false;
+#endif
+}
+
+// Return the time of the next change after an update to timeMs.
+long AnimatedSVG::nextChangeMs(long timeMs)
+{
+    // Check that image was loaded.
+    if (_image == NULL || !_image->isAnimated)
+    {
+        return -1;
+    }
+
+    return nsvgNextChange(_image->svgImage, timeMs);
 }
 
 // Rasterize the image with scale and position.
@@ -193,54 +832,572 @@ void AnimatedSVG::rasterize(void* dst, int dstWidth, int dstHeight, int dstStrid
         _scale = scale;
     }
 
+    _image->svgRasterizer = acquireRasterizer();
+    if (_image->svgRasterizer == NULL)
+    {
+        return;
+    }
+#if defined(ANIMATED_SVG_STATS)
+    // The context is shared, so its counters may be of other instances.
+    nsvgRasterizerResetStats(_image->svgRasterizer);
+#endif
+
+    if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
+    {
+        prepare(tx, ty, dstWidth, dstHeight);
+    }
+    prepareStaticLayer(tx, ty, dstWidth, dstHeight);
+
+    AnimatedSVGRect rect = { 0, 0, dstWidth, dstHeight };
+    rasterizeRect(dst, dstStride, rect, tx, ty, false);
+
+#if defined(ANIMATED_SVG_STATS)
+    addRasterizerStats(_stats, _image->svgRasterizer);
+#endif
+    releaseRasterizer(_image->svgRasterizer);
+    _image->svgRasterizer = NULL;
+
+    // Destination is up to date.
+    _image->rasterized = true;
+    _image->dst = dst;
+    _image->dstWidth = dstWidth;
+    _image->dstHeight = dstHeight;
+    _image->tx = tx;
+    _image->ty = ty;
+    _image->scale = scale;
+    nsvgResetDirty(_image->svgImage);
+}
+
+// Rasterize only the areas changed since the last rasterize into a persistent destination.
+int AnimatedSVG::rasterizeDirty(void* dst, int dstWidth, int dstHeight, int dstStride, AnimatedSVGRect* rects,
+                                float tx, float ty, float scale)
+{
+    // Check that image was loaded.
+    if (_image == NULL)
+    {
+        return 0;
+    }
+
+    // Redraw everything if the destination or placement of the image changed.
+    NSVGimage* svgImage = _image->svgImage;
+    int count = 0;
+    if (!_image->rasterized || dst != _image->dst || dstWidth != _image->dstWidth || dstHeight != _image->dstHeight ||
+        tx != _image->tx || ty != _image->ty || scale != _image->scale)
+    {
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].width = dstWidth;
+        rects[0].height = dstHeight;
+        count = 1;
+    }
+    else
+    {
+        for (int i = 0; i < svgImage->ndirtyRects; i++)
+        {
+            // Convert to destination pixels, with an extra pixel for antialiasing.
+            float* bounds = svgImage->dirtyRects[i];
+            int x0 = (int)floorf(bounds[0] * scale + tx) - 1;
+            int y0 = (int)floorf(bounds[1] * scale + ty) - 1;
+            int x1 = (int)ceilf(bounds[2] * scale + tx) + 1;
+            int y1 = (int)ceilf(bounds[3] * scale + ty) + 1;
+            x0 = (x0 > 0) ? x0 : 0;
+            y0 = (y0 > 0) ? y0 : 0;
+            x1 = (x1 < dstWidth) ? x1 : dstWidth;
+            y1 = (y1 < dstHeight) ? y1 : dstHeight;
+            if (x1 > x0 && y1 > y0)
+            {
+                rects[count].x = x0;
+                rects[count].y = y0;
+                rects[count].width = x1 - x0;
+                rects[count].height = y1 - y0;
+                count++;
+            }
+        }
+    }
+
+    if (count > 0)
+    {
+        _image->svgRasterizer = acquireRasterizer();
+        if (_image->svgRasterizer == NULL)
+        {
+            return 0;
+        }
+#if defined(ANIMATED_SVG_STATS)
+        nsvgRasterizerResetStats(_image->svgRasterizer);
+#endif
+
+        _scale = scale;
+        if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
+        {
+            prepare(tx, ty, dstWidth, dstHeight);
+        }
+        prepareStaticLayer(tx, ty, dstWidth, dstHeight);
+
+        for (int i = 0; i < count; i++)
+        {
+            rasterizeRect(dst, dstStride, rects[i], tx, ty, true);
+        }
+
+#if defined(ANIMATED_SVG_STATS)
+        addRasterizerStats(_stats, _image->svgRasterizer);
+#endif
+        releaseRasterizer(_image->svgRasterizer);
+        _image->svgRasterizer = NULL;
+    }
+
+    // Destination is up to date.
+    _image->rasterized = true;
+    _image->dst = dst;
+    _image->dstWidth = dstWidth;
+    _image->dstHeight = dstHeight;
+    _image->tx = tx;
+    _image->ty = ty;
+    _image->scale = scale;
+    nsvgResetDirty(svgImage);
+
+    return count;
+}
+
+// Rasterize the image in bands rotating through the band buffers, passing each band to the callback once rasterized.
+void AnimatedSVG::rasterizeBands(void** bands, int bandCount, int bandHeight, int dstWidth, int dstHeight,
+                                 AnimatedSVGBandCallback callback, void* userData, float tx, float ty, float scale)
+{
+    int pitch = (_options & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 
+                (_options & ANIMATED_SVG_OPTION_RGB565) ? 2 : 0;
+
+    // Check that image was loaded, and that the bands are in the destination format.
+    if (_image == NULL || pitch == 0 || bands == NULL || bandCount < 1 || bandHeight < 1 || callback == NULL)
+    {
+        return;
+    }
+
+    _scale = scale;
+    _image->svgRasterizer = acquireRasterizer();
+    if (_image->svgRasterizer == NULL)
+    {
+        return;
+    }
+#if defined(ANIMATED_SVG_STATS)
+    nsvgRasterizerResetStats(_image->svgRasterizer);
+#endif
+
     if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
     {
-        nsvgRasterizePrepare(_image->svgRasterizer, _image->svgImage, _scale);
+        prepare(tx, ty, dstWidth, dstHeight);
+    }
+    prepareStaticLayer(tx, ty, dstWidth, dstHeight);
+
+    // Every band is a destination of its own, with the image moved up by the rows above the band.
+    for (int i = 0, y = 0; y < dstHeight; i++, y += bandHeight)
+    {
+        void* band = bands[i % bandCount];
+        AnimatedSVGRect rect = { 0, 0, dstWidth, (dstHeight - y < bandHeight) ? dstHeight - y : bandHeight };
+        rasterizeRect(band, dstWidth * pitch, rect, tx, ty - y, true);
+        callback(userData, band, 0, y, rect.width, rect.height);
+    }
+
+#if defined(ANIMATED_SVG_STATS)
+    addRasterizerStats(_stats, _image->svgRasterizer);
+#endif
+    releaseRasterizer(_image->svgRasterizer);
+    _image->svgRasterizer = NULL;
+
+    // The bands are not kept, so the next rasterizeDirty() draws everything.
+    _image->rasterized = false;
+    nsvgResetDirty(_image->svgImage);
+}
+
+// Prepare the rasterization of the image with the current scale, only shapes changed by updates are prepared again.
+// Shapes prepared for a larger destination are kept, so the image is prepared again only when it moves outside of it.
+void AnimatedSVG::prepare(float tx, float ty, int dstWidth, int dstHeight)
+{
+    // The rasterizer is shared by all instances, so the flags and tolerance are set for every prepare.
+    nsvgRasterizerSetFlags(_image->svgRasterizer, (_options & ANIMATED_SVG_OPTION_COMPACT_EDGES) ? NSVG_RAST_COMPACT_EDGES : 0);
+    nsvgRasterizerSetTolerance(_image->svgRasterizer, _tolerance);
+#if defined(ANIMATED_SVG_STATS)
+    unsigned long startUs = getTimeUs();
+#endif
+    if (dstWidth > 0 && dstHeight > 0)
+    {
+        nsvgRasterizePrepareImageViewport(_image->svgRasterizer, _image->svgPrepared, _image->svgImage, _scale,
+                                          tx, ty, dstWidth, dstHeight);
+    }
+    else
+    {
+        nsvgRasterizePrepareImage(_image->svgRasterizer, _image->svgPrepared, _image->svgImage, _scale);
+    }
+#if defined(ANIMATED_SVG_STATS)
+    _stats.prepareUs += getTimeUs() - startUs;
+#endif
+}
+
+// Return whether an opaque shape of the prepared image covers a rectangle of the destination, so it need not be cleared.
+bool AnimatedSVG::isOpaque(const AnimatedSVGRect& rect, float tx, float ty)
+{
+    if (_options & ANIMATED_SVG_OPTION_LARGE_BUFFER)
+    {
+        return false;
+    }
+    return nsvgRasterizeIsOpaqueShapes(_image->svgPrepared, _image->firstShape, _image->shapeCount,
+                                       tx - rect.x, ty - rect.y, rect.width, rect.height) != 0;
+}
+
+// Rasterize the static layer if its placement changed, and set the shapes rasterized over it.
+// Without the static layer all shapes are rasterized, returns whether the static layer is used.
+bool AnimatedSVG::prepareStaticLayer(float tx, float ty, int dstWidth, int dstHeight)
+{
+    int pitch = (_options & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 
+                (_options & ANIMATED_SVG_OPTION_RGB565) ? 2 : 0;
+
+    _image->firstShape = 0;
+    _image->shapeCount = (_options & ANIMATED_SVG_OPTION_LARGE_BUFFER) ? 0 : _image->svgPrepared->nshapes;
+    _image->useLayer = false;
+    if (!(_options & ANIMATED_SVG_OPTION_STATIC_LAYER) || (_options & ANIMATED_SVG_OPTION_LARGE_BUFFER) || pitch == 0 ||
+        _image->staticShapes == 0)
+    {
+        return false;
+    }
+
+    // The layer is in the memory set by setStaticLayerMemory(), or allocated for the destination size.
+    int size = dstWidth * dstHeight * pitch;
+    if (_layerMemory != NULL)
+    {
+        if (size > _layerMemorySize)
+        {
+            return false;
+        }
+        if (_image->layerAllocated)
+        {
+            free(_image->layer);
+            _image->layerAllocated = false;
+        }
+        _image->layer = (unsigned char*)_layerMemory;
+    }
+    else if (!_image->layerAllocated || size > _image->layerSize)
+    {
+        if (_image->layerAllocated)
+        {
+            free(_image->layer);
+        }
+        _image->layer = (unsigned char*)malloc(size);
+        _image->layerAllocated = (_image->layer != NULL);
+        _image->layerSize = (_image->layer != NULL) ? size : 0;
+        _image->layerValid = false;
+        if (_image->layer == NULL)
+        {
+            return false;
+        }
+    }
+
+    if (!_image->layerValid || dstWidth != _image->layerWidth || dstHeight != _image->layerHeight ||
+        tx != _image->layerTx || ty != _image->layerTy || _scale != _image->layerScale || _quality != _image->layerQuality ||
+        _tolerance != _image->layerTolerance)
+    {
+        _image->shapeCount = _image->staticShapes;
+        AnimatedSVGRect rect = { 0, 0, dstWidth, dstHeight };
+        rasterizeRect(_image->layer, dstWidth * pitch, rect, tx, ty, true);
+        _image->layerValid = true;
+        _image->layerWidth = dstWidth;
+        _image->layerHeight = dstHeight;
+        _image->layerTx = tx;
+        _image->layerTy = ty;
+        _image->layerScale = _scale;
+        _image->layerQuality = _quality;
+        _image->layerTolerance = _tolerance;
+    }
+
+    _image->firstShape = _image->staticShapes;
+    _image->shapeCount = _image->svgPrepared->nshapes - _image->staticShapes;
+    _image->useLayer = true;
+    return true;
+}
+
+// Clear a rectangle of the destination before rasterizing over it, or copy the static layer to it when used.
+// Nothing is needed where an opaque shape rasterized over it covers the rectangle.
+void AnimatedSVG::clearRect(void* dst, int dstStride, const AnimatedSVGRect& rect, float tx, float ty, bool clear)
+{
+    int pitch = (_options & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 
+                (_options & ANIMATED_SVG_OPTION_RGB565) ? 2 : 0;
+
+    if ((!clear && !_image->useLayer) || isOpaque(rect, tx, ty))
+    {
+        return;
+    }
+
+    unsigned char* ptr = (unsigned char*)dst + rect.x * pitch + rect.y * dstStride;
+    if (!_image->useLayer)
+    {
+        clearDest(ptr, dstStride, rect.width, rect.height);
+        return;
+    }
+
+    // The layer is at the placement it was rasterized for, a band of the destination is below it by the rows above the band.
+    int layerX = rect.x + (int)floorf(_image->layerTx - tx + 0.5f);
+    int layerY = rect.y + (int)floorf(_image->layerTy - ty + 0.5f);
+    int layerStride = _image->layerWidth * pitch;
+    const unsigned char* src = _image->layer + layerX * pitch + layerY * layerStride;
+    for (int y = 0; y < rect.height; y++)
+    {
+        memcpy(ptr + y * dstStride, src + y * layerStride, rect.width * pitch);
     }
+}
 
+// Rasterize a rectangle of the destination in parts of the rasterize buffer size.
+void AnimatedSVG::rasterizeRect(void* dst, int dstStride, const AnimatedSVGRect& rect, float tx, float ty, bool clear)
+{
     int pitch = (_options & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 
                 (_options & ANIMATED_SVG_OPTION_RGB565) ? 2 : 0;
 
-    int bufWidth = (dstWidth <= _bufferWidth) ? dstWidth : _bufferWidth;
-    int bufHeight = (dstHeight <= _bufferHeight) ? dstHeight : _bufferHeight;
-    int nx = (dstWidth + bufWidth - 1) / bufWidth;
-    int ny = (dstHeight + bufHeight - 1) / bufHeight;
-    for (int y = 0; y < ny; y++)
+    if (rasterizeRectParallel(dst, dstStride, rect, tx, ty, clear))
+    {
+        return;
+    }
+
+    // The rasterizer is shared by all instances, so the format, quality and tolerance are set for every rasterize.
+    int format = getRasterizerFormat(_options);
+    nsvgRasterizerSetFormat(_image->svgRasterizer, format);
+    nsvgRasterizerSetSubsamples(_image->svgRasterizer, _quality);
+    nsvgRasterizerSetTolerance(_image->svgRasterizer, _tolerance);
+    if (format != NSVG_RAST_FORMAT_RGBA)
+    {
+        // Blend the whole rectangle straight into the destination.
+        unsigned char* ptr = (unsigned char*)dst + rect.x * pitch + rect.y * dstStride;
+        clearRect(dst, dstStride, rect, tx, ty, clear);
+#if defined(ANIMATED_SVG_STATS)
+        unsigned long startUs = getTimeUs();
+#endif
+        if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
+        {
+            nsvgRasterizeFinishImageShapes(_image->svgRasterizer, _image->svgPrepared, _image->firstShape, _image->shapeCount,
+                                           tx - rect.x, ty - rect.y, ptr, rect.width, rect.height, dstStride);
+        }
+        else
+        {
+            nsvgRasterize(_image->svgRasterizer, _image->svgImage, tx - rect.x, ty - rect.y, _scale,
+                          ptr, rect.width, rect.height, dstStride);
+        }
+#if defined(ANIMATED_SVG_STATS)
+        _stats.finishUs += getTimeUs() - startUs;
+#endif
+        return;
+    }
+
+    int bufWidth = (rect.width <= _bufferWidth) ? rect.width : _bufferWidth;
+    int bufHeight = (rect.height <= _bufferHeight) ? rect.height : _bufferHeight;
+    int nx = (rect.width + bufWidth - 1) / bufWidth;
+    int ny = (rect.height + bufHeight - 1) / bufHeight;
+    _bandBuffer = _rastBuffer;
+    for (int i = 0; i < nx * ny; i++)
     {
-        for (int x = 0; x < nx; x++)
+        AnimatedSVGRect tile;
+        getTile(rect, bufWidth, bufHeight, nx, i, tile);
+
+        // Clear the buffer, unless an opaque shape covers the tile.
+        bool opaque = isOpaque(tile, tx, ty);
+        if (!opaque)
         {
-            // Clear the buffer.
             memset(_rastBuffer, 0, _bufferWidth * bufHeight * 4);
+        }
 
-            // Rasterize section of image.
-            if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
-            {
-                nsvgRasterizeFinish(_image->svgRasterizer, tx - x * bufWidth, ty - y * bufHeight,
-                                    _rastBuffer, bufWidth, bufHeight, _bufferWidth * 4);
-            }
-            else
-            {
-                nsvgRasterize(_image->svgRasterizer, _image->svgImage, tx - x * bufWidth, ty - y * bufHeight, _scale,
-                              _rastBuffer, bufWidth, bufHeight, _bufferWidth * 4);
-            }
+        // Rasterize section of image.
+#if defined(ANIMATED_SVG_STATS)
+        unsigned long startUs = getTimeUs();
+#endif
+        if (!(_options & ANIMATED_SVG_OPTION_LARGE_BUFFER))
+        {
+            nsvgRasterizeFinishImageShapes(_image->svgRasterizer, _image->svgPrepared, _image->firstShape, _image->shapeCount,
+                                           tx - tile.x, ty - tile.y, _rastBuffer, tile.width, tile.height, _bufferWidth * 4);
+        }
+        else
+        {
+            nsvgRasterize(_image->svgRasterizer, _image->svgImage, tx - tile.x, ty - tile.y, _scale,
+                          _rastBuffer, tile.width, tile.height, _bufferWidth * 4);
+        }
+#if defined(ANIMATED_SVG_STATS)
+        _stats.finishUs += getTimeUs() - startUs;
+#endif
+
+        // Copy rasterized buffer.
+        unsigned char* ptr = (unsigned char*)dst + tile.x * pitch + tile.y * dstStride;
+        clearRect(dst, dstStride, tile, tx, ty, clear);
+#if defined(ANIMATED_SVG_STATS)
+        startUs = getTimeUs();
+        copyToDest(ptr, dstStride, tile.width, tile.height);
+        _stats.copyUs += getTimeUs() - startUs;
+#else
+        copyToDest(ptr, dstStride, tile.width, tile.height);
+#endif
+    }
+}
+
+// Rasterize a rectangle of the destination in the worker threads, returns false if it should be rasterized serially.
+bool AnimatedSVG::rasterizeRectParallel(void* dst, int dstStride, const AnimatedSVGRect& rect, float tx, float ty, bool clear)
+{
+#if defined(ANIMATED_SVG_THREADS)
+    AnimatedSVGWorkers* workers = _image->workers;
+    if (workers == NULL)
+    {
+        return false;
+    }
+
+    // Split the buffer to slots, using less workers if the slots would have less than the minimum rows.
+    // Blending straight into the destination, the slots only order the tiles, so the rectangle is split between the slots.
+    int format = getRasterizerFormat(_options);
+    int nworkers = ((format != NSVG_RAST_FORMAT_RGBA) ? rect.height : _bufferHeight) /
+                   (ANIMATED_SVG_WORKER_SLOTS * ANIMATED_SVG_MIN_TILE_ROWS);
+    nworkers = (nworkers < workers->count) ? nworkers : workers->count;
+    if (nworkers < 1)
+    {
+        return false;
+    }
+    int slotHeight = (format != NSVG_RAST_FORMAT_RGBA) ?
+                     (rect.height + nworkers * ANIMATED_SVG_WORKER_SLOTS - 1) / (nworkers * ANIMATED_SVG_WORKER_SLOTS) :
+                     _bufferHeight / (nworkers * ANIMATED_SVG_WORKER_SLOTS);
 
-            // Copy rasterized buffer.
-            unsigned char* ptr = (unsigned char*)dst + x * bufWidth * pitch + y * bufHeight * dstStride;
-            int w = (x + 1) * bufWidth <= dstWidth ? bufWidth : dstWidth - x * bufWidth;
-            int h = (y + 1) * bufHeight <= dstHeight ? bufHeight : dstHeight - y * bufHeight;
-            copyToDest(ptr, dstStride, w, h);
+    AnimatedSVGJob& job = workers->job;
+    job.tileWidth = (rect.width <= _bufferWidth || format != NSVG_RAST_FORMAT_RGBA) ? rect.width : _bufferWidth;
+    job.tileHeight = (rect.height <= slotHeight) ? rect.height : slotHeight;
+    job.nx = (rect.width + job.tileWidth - 1) / job.tileWidth;
+    job.count = job.nx * ((rect.height + job.tileHeight - 1) / job.tileHeight);
+    if (job.count <= 1)
+    {
+        return false;
+    }
+    int pitch = (_options & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 
+                (_options & ANIMATED_SVG_OPTION_RGB565) ? 2 : 0;
+    job.prepared = _image->svgPrepared;
+    job.firstShape = _image->firstShape;
+    job.shapeCount = _image->shapeCount;
+    job.buffer = _rastBuffer;
+    job.bufferStride = _bufferWidth * 4;
+    job.slotHeight = slotHeight;
+    job.rect = rect;
+    job.nworkers = (nworkers < job.count) ? nworkers : job.count;
+    job.format = format;
+    job.pitch = pitch;
+    job.quality = _quality;
+    job.tx = tx;
+    job.ty = ty;
+    if (format != NSVG_RAST_FORMAT_RGBA)
+    {
+        // Clear before the workers blend into the destination.
+        job.buffer = (unsigned char*)dst;
+        job.bufferStride = dstStride;
+        clearRect(dst, dstStride, rect, tx, ty, clear);
+    }
+
+#if defined(ANIMATED_SVG_STATS)
+    // The workers finish while the tiles are copied, so finishing is the time of the job without the copies.
+    unsigned long startUs = getTimeUs();
+    unsigned long copyUs = _stats.copyUs;
+    for (int i = 0; i < job.nworkers; i++)
+    {
+        nsvgRasterizerResetStats(workers->workers[i].rasterizer);
+    }
+#endif
+    for (int i = 0; i < job.nworkers; i++)
+    {
+        workers->workers[i].start.give();
+    }
+
+    // Copy the tiles in order, as they become ready.
+    int count = job.count;
+    for (int i = 0; i < count; i++)
+    {
+        int slot = getTileSlot(job, i);
+        AnimatedSVGRect tile;
+        getTile(rect, job.tileWidth, job.tileHeight, job.nx, i, tile);
+
+        workers->slotReady[slot].take();
+        if (format != NSVG_RAST_FORMAT_RGBA)
+        {
+            workers->slotFree[slot].give();
+            continue;
         }
+        _bandBuffer = _rastBuffer + slot * slotHeight * _bufferWidth * 4;
+        unsigned char* ptr = (unsigned char*)dst + tile.x * pitch + tile.y * dstStride;
+        clearRect(dst, dstStride, tile, tx, ty, clear);
+#if defined(ANIMATED_SVG_STATS)
+        unsigned long copyStartUs = getTimeUs();
+        copyToDest(ptr, dstStride, tile.width, tile.height);
+        _stats.copyUs += getTimeUs() - copyStartUs;
+#else
+        copyToDest(ptr, dstStride, tile.width, tile.height);
+#endif
+        workers->slotFree[slot].give();
     }
+    _bandBuffer = _rastBuffer;
+#if defined(ANIMATED_SVG_STATS)
+    // All tiles are ready, so the workers do not change their counters anymore.
+    _stats.finishUs += getTimeUs() - startUs - (_stats.copyUs - copyUs);
+    for (int i = 0; i < job.nworkers; i++)
+    {
+        addRasterizerStats(_stats, workers->workers[i].rasterizer);
+    }
+#endif
+
+    return true;
+#else
+    return false;
+#endif
 }
 
 // Set the rasterization buffer.
 void AnimatedSVG::setBuffer(unsigned char* rastBuffer, int bufferWidth, int bufferHeight)
 {
     _rastBuffer = rastBuffer;
+    _bandBuffer = rastBuffer;
     _bufferWidth = bufferWidth;
     _bufferHeight = bufferHeight;
 }
 
+// Set the antialiasing quality, the number of samples of each pixel row, the image is rasterized whole again when it changes.
+void AnimatedSVG::setQuality(int quality)
+{
+    if (_image != NULL && quality != _quality)
+    {
+        // Changed areas are not enough, the rest would stay at the previous quality.
+        _image->rasterized = false;
+    }
+    _quality = quality;
+}
+
+// Set the largest distance in pixels of flattened curves from the curves, the image is prepared again with the next rasterize.
+void AnimatedSVG::setTolerance(float tolerance)
+{
+    _tolerance = tolerance;
+    if (_image != NULL)
+    {
+        // Changed areas are not enough, the edges of all curves move.
+        _image->rasterized = false;
+    }
+}
+
+// Set the memory the image is loaded into with ANIMATED_SVG_OPTION_ARENA.
+void AnimatedSVG::setImageMemory(void* memory, int size)
+{
+    _imageMemory = memory;
+    _imageMemorySize = size;
+}
+
+// Set the memory of the static layer with ANIMATED_SVG_OPTION_STATIC_LAYER.
+void AnimatedSVG::setStaticLayerMemory(void* memory, int size)
+{
+    _layerMemory = memory;
+    _layerMemorySize = size;
+    invalidateStaticLayer();
+}
+
+// Rasterize the static layer again with the next rasterize.
+void AnimatedSVG::invalidateStaticLayer()
+{
+    if (_image != NULL)
+    {
+        _image->layerValid = false;
+        _image->rasterized = false;
+    }
+}
+
 // Get the memory used by the image.
 int AnimatedSVG::getImageUsedMemory()
 {
@@ -252,7 +1409,18 @@ int AnimatedSVG::getImageUsedMemory()
     return _image->svgImage->memorySize;
 }
 
-// Get the memory used by the rasterize mechanism.
+// Get the memory the image needs in memory set by setImageMemory(), or 0 without ANIMATED_SVG_OPTION_ARENA.
+int AnimatedSVG::getImageArenaMemory()
+{
+    if (_image == NULL)
+    {
+        return 0;
+    }
+
+    return _image->svgImage->arenaMemorySize;
+}
+
+// Get the memory used by the rasterize mechanism (prepared image, allocated static layer and shared rasterizer contexts).
 int AnimatedSVG::getRasterizerUsedMemory()
 {
     if (_image == NULL)
@@ -260,7 +1428,40 @@ int AnimatedSVG::getRasterizerUsedMemory()
         return 0;
     }
 
-    return _image->svgRasterizer->memorySize;
+    int memorySize = _image->svgPrepared->memorySize;
+    if (_image->layerAllocated)
+    {
+        memorySize += _image->layerSize;
+    }
+    lockContexts();
+    for (AnimatedSVGContext* context = g_svgContexts; context != NULL; context = context->next)
+    {
+        memorySize += context->rasterizer->memorySize;
+    }
+    unlockContexts();
+#if defined(ANIMATED_SVG_THREADS)
+    if (_image->workers != NULL)
+    {
+        for (int i = 0; i < _image->workers->count; i++)
+        {
+            memorySize += _image->workers->workers[i].rasterizer->memorySize;
+        }
+    }
+#endif
+
+    return memorySize;
+}
+
+// Get the counters and timings since the last update() or resetStats().
+const AnimatedSVGStats& AnimatedSVG::getStats()
+{
+    return _stats;
+}
+
+// Reset the counters and timings.
+void AnimatedSVG::resetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
 }
 
 // Copy rasterize buffer to destination.
@@ -304,42 +1505,201 @@ void AnimatedSVG::copyToDest(void* dstBuffer, int dstStride, int width, int heig
     }
 }
 
+// Clear destination area before rasterizing a dirty rectangle (fills with zeros).
+void AnimatedSVG::clearDest(void* dstBuffer, int dstStride, int width, int height)
+{
+    int pitch = (_options & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 
+                (_options & ANIMATED_SVG_OPTION_RGB565) ? 2 : 0;
+
+    for (int y = 0; y < height; y++)
+    {
+        memset((unsigned char*)dstBuffer + y * dstStride, 0, width * pitch);
+    }
+}
+
+// Copy a pixel in RGBA 8:8:8:8 to RGB 5:6:5.
+template <bool ANTIALIASING, bool SWAP_BYTES>
+static inline void copyPixelRgb565(const unsigned char* src, unsigned short* dst)
+{
+    unsigned short a = src[3];
+    if (a)
+    {
+        if (!ANTIALIASING || (a == 0xFF))
+        {
+            unsigned short d = ((src[0] & 0b11111000) << 8) | ((src[1] & 0b11111100) << 3) | (src[2] >> 3);
+            *dst = SWAP_BYTES ? d << 8 | (d >> 8) : d;
+        }
+        else if (ANTIALIASING)
+        {
+            // antialiasing.
+            unsigned short a_1 = 256 - a;
+            unsigned short d = *dst;
+            d = SWAP_BYTES ? d << 8 | (d >> 8) : d;
+            unsigned short c0 = (d >> 8) & 0b11111000;
+            unsigned short c1 = (d >> 3) & 0b11111100;
+            unsigned short c2 = (d << 3) & 0b11111000;
+            c0 = (c0 * a_1 + src[0] * a) >> 8;
+            c1 = (c1 * a_1 + src[1] * a) >> 8;
+            c2 = (c2 * a_1 + src[2] * a) >> 8;
+            d = ((c0 & 0b11111000) << 8) | ((c1 & 0b11111100) << 3) | (c2 >> 3);
+            *dst = SWAP_BYTES ? d << 8 | (d >> 8) : d;
+        }
+    }
+}
+
+// Copy a pixel in RGBA 8:8:8:8 to BGRA 8:8:8:8.
+template <bool ANTIALIASING>
+static inline void copyPixelBgra8888(const unsigned char* src, unsigned char* dst)
+{
+    unsigned short a = src[3];
+    if (a)
+    {
+        if (!ANTIALIASING || (a == 0xFF))
+        {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = a;
+        }
+        else if (ANTIALIASING)
+        {
+            // antialiasing.
+            unsigned short a_1 = 256 - a;
+            unsigned short d0 = dst[0];
+            unsigned short d1 = dst[1];
+            unsigned short d2 = dst[2];
+            unsigned short d3 = dst[3];
+            d0 = (d0 * a_1 + src[2] * a) >> 8;
+            d1 = (d1 * a_1 + src[1] * a) >> 8;
+            d2 = (d2 * a_1 + src[0] * a) >> 8;
+            d3 = d3 + a < 0xFF ? d3 + a : 0xFF;
+            dst[0] = d0;
+            dst[1] = d1;
+            dst[2] = d2;
+            dst[3] = d3;
+        }
+    }
+}
+
+#if defined(NSVG__SSE2)
+
+// Check that four pixels in RGBA 8:8:8:8 are opaque.
+static inline bool isOpaque4(__m128i p)
+{
+    __m128i t = _mm_cmpeq_epi8(_mm_or_si128(p, _mm_set1_epi32(0x00FFFFFF)), _mm_set1_epi32(-1));
+    return _mm_movemask_epi8(t) == 0xFFFF;
+}
+
+// Copy four opaque pixels in RGBA 8:8:8:8 to RGB 5:6:5, returns false if any is not opaque.
+template <bool SWAP_BYTES>
+static inline bool copyOpaqueRgb565x4(const unsigned char* src, unsigned short* dst)
+{
+    __m128i p = _mm_loadu_si128((const __m128i*)src);
+    if (!isOpaque4(p))
+    {
+        return false;
+    }
+    __m128i r = _mm_and_si128(p, _mm_set1_epi32(0b11111000));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0b11111100));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0b11111000));
+    __m128i d = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 8), _mm_slli_epi32(g, 3)), _mm_srli_epi32(b, 3));
+    if (SWAP_BYTES)
+    {
+        d = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(d, 8), _mm_set1_epi32(0xFF00)), _mm_srli_epi32(d, 8));
+    }
+    // Pack to 16 bits, offset for the signed saturation.
+    d = _mm_sub_epi32(d, _mm_set1_epi32(0x8000));
+    d = _mm_add_epi16(_mm_packs_epi32(d, d), _mm_set1_epi16((short)0x8000));
+    _mm_storel_epi64((__m128i*)dst, d);
+    return true;
+}
+
+// Copy four opaque pixels in RGBA 8:8:8:8 to BGRA 8:8:8:8, returns false if any is not opaque.
+static inline bool copyOpaqueBgra8888x4(const unsigned char* src, unsigned char* dst)
+{
+    __m128i p = _mm_loadu_si128((const __m128i*)src);
+    if (!isOpaque4(p))
+    {
+        return false;
+    }
+    __m128i rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0xFF)),
+                              _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xFF)), 16));
+    _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(p, _mm_set1_epi32(0xFF00FF00)), rb));
+    return true;
+}
+
+#elif defined(NSVG__NEON)
+
+// Check that four pixels in RGBA 8:8:8:8 are opaque.
+static inline bool isOpaque4(uint32x4_t p)
+{
+    uint32x4_t t = vcgeq_u32(p, vdupq_n_u32(0xFF000000));
+    uint32x2_t m = vand_u32(vget_low_u32(t), vget_high_u32(t));
+    return (vget_lane_u32(m, 0) & vget_lane_u32(m, 1)) == 0xFFFFFFFF;
+}
+
+// Copy four opaque pixels in RGBA 8:8:8:8 to RGB 5:6:5, returns false if any is not opaque.
+template <bool SWAP_BYTES>
+static inline bool copyOpaqueRgb565x4(const unsigned char* src, unsigned short* dst)
+{
+    uint32x4_t p = vreinterpretq_u32_u8(vld1q_u8(src));
+    if (!isOpaque4(p))
+    {
+        return false;
+    }
+    uint32x4_t r = vandq_u32(p, vdupq_n_u32(0b11111000));
+    uint32x4_t g = vandq_u32(vshrq_n_u32(p, 8), vdupq_n_u32(0b11111100));
+    uint32x4_t b = vandq_u32(vshrq_n_u32(p, 16), vdupq_n_u32(0b11111000));
+    uint16x4_t d = vmovn_u32(vorrq_u32(vorrq_u32(vshlq_n_u32(r, 8), vshlq_n_u32(g, 3)), vshrq_n_u32(b, 3)));
+    if (SWAP_BYTES)
+    {
+        d = vreinterpret_u16_u8(vrev16_u8(vreinterpret_u8_u16(d)));
+    }
+    vst1_u16(dst, d);
+    return true;
+}
+
+// Copy four opaque pixels in RGBA 8:8:8:8 to BGRA 8:8:8:8, returns false if any is not opaque.
+static inline bool copyOpaqueBgra8888x4(const unsigned char* src, unsigned char* dst)
+{
+    uint32x4_t p = vreinterpretq_u32_u8(vld1q_u8(src));
+    if (!isOpaque4(p))
+    {
+        return false;
+    }
+    uint32x4_t rb = vorrq_u32(vandq_u32(vshrq_n_u32(p, 16), vdupq_n_u32(0xFF)),
+                              vshlq_n_u32(vandq_u32(p, vdupq_n_u32(0xFF)), 16));
+    vst1q_u8(dst, vreinterpretq_u8_u32(vorrq_u32(vandq_u32(p, vdupq_n_u32(0xFF00FF00)), rb)));
+    return true;
+}
+
+#endif
+
 // Copy rasterization buffer in RGBA 8:8:8:8 to destination buffer in RGB 5:6:5.
 template <bool ANTIALIASING, bool SWAP_BYTES>
 void AnimatedSVG::copyRgba888ToDstRgb565(void* dstBuffer, int dstStride, int width, int height)
 {
     for (int y = 0; y < height; y++)
     {
-        unsigned char* src = _rastBuffer + y * _bufferWidth * 4;
+        unsigned char* src = _bandBuffer + y * _bufferWidth * 4;
         unsigned short* dst = (unsigned short*)((unsigned char*)dstBuffer + y * dstStride);
-        for (int x = 0; x < width; x++)
+        int x = 0;
+#if defined(NSVG__SSE2) || defined(NSVG__NEON)
+        // Convert four pixels at once when they are opaque.
+        for (; x + 4 <= width; x += 4, src += 16, dst += 4)
         {
-            unsigned short a = src[3];
-            if (a)
+            if (!copyOpaqueRgb565x4<SWAP_BYTES>(src, dst))
             {
-                if (!ANTIALIASING || (a == 0xFF))
+                for (int i = 0; i < 4; i++)
                 {
-                    unsigned short d = ((src[0] & 0b11111000) << 8) | ((src[1] & 0b11111100) << 3) | (src[2] >> 3);
-                    *dst = SWAP_BYTES ? d << 8 | (d >> 8) : d;
-                }
-                else if (ANTIALIASING)
-                {
-                    // antialiasing.
-                    unsigned short a_1 = 256 - a;
-                    unsigned short d = *dst;
-                    d = SWAP_BYTES ? d << 8 | (d >> 8) : d;
-                    unsigned short c0 = (d >> 8) & 0b11111000;
-                    unsigned short c1 = (d >> 3) & 0b11111100;
-                    unsigned short c2 = (d << 3) & 0b11111000;
-                    c0 = (c0 * a_1 + src[0] * a) >> 8;
-                    c1 = (c1 * a_1 + src[1] * a) >> 8;
-                    c2 = (c2 * a_1 + src[2] * a) >> 8;
-                    d = ((c0 & 0b11111000) << 8) | ((c1 & 0b11111100) << 3) | (c2 >> 3);
-                    *dst = SWAP_BYTES ? d << 8 | (d >> 8) : d;
+                    copyPixelRgb565<ANTIALIASING, SWAP_BYTES>(src + i * 4, dst + i);
                 }
             }
-            src += 4;
-            dst += 1;
+        }
+#endif
+        for (; x < width; x++, src += 4, dst += 1)
+        {
+            copyPixelRgb565<ANTIALIASING, SWAP_BYTES>(src, dst);
         }
     }
 }
@@ -350,40 +1710,25 @@ void AnimatedSVG::copyRgba888ToDstBgra8888(void* dstBuffer, int dstStride, int w
 {
     for (int y = 0; y < height; y++)
     {
-        unsigned char* src = _rastBuffer + y * _bufferWidth * 4;
+        unsigned char* src = _bandBuffer + y * _bufferWidth * 4;
         unsigned char* dst = (unsigned char*)dstBuffer + y * dstStride;
-        for (int x = 0; x < width; x++)
+        int x = 0;
+#if defined(NSVG__SSE2) || defined(NSVG__NEON)
+        // Swap four pixels at once when they are opaque.
+        for (; x + 4 <= width; x += 4, src += 16, dst += 16)
         {
-            unsigned short a = src[3];
-            if (a)
+            if (!copyOpaqueBgra8888x4(src, dst))
             {
-                if (!ANTIALIASING || (a == 0xFF))
+                for (int i = 0; i < 4; i++)
                 {
-                    dst[0] = src[2];
-                    dst[1] = src[1];
-                    dst[2] = src[0];
-                    dst[3] = a;
-                }
-                else if (ANTIALIASING)
-                {
-                    // antialiasing.
-                    unsigned short a_1 = 256 - a;
-                    unsigned short d0 = dst[0];
-                    unsigned short d1 = dst[1];
-                    unsigned short d2 = dst[2];
-                    unsigned short d3 = dst[3];
-                    d0 = (d0 * a_1 + src[2] * a) >> 8;
-                    d1 = (d1 * a_1 + src[1] * a) >> 8;
-                    d2 = (d2 * a_1 + src[0] * a) >> 8;
-                    d3 = d3 + a < 0xFF ? d3 + a : 0xFF;
-                    dst[0] = d0;
-                    dst[1] = d1;
-                    dst[2] = d2;
-                    dst[3] = d3;
+                    copyPixelBgra8888<ANTIALIASING>(src + i * 4, dst + i * 4);
                 }
             }
-            src += 4;
-            dst += 4;
+        }
+#endif
+        for (; x < width; x++, src += 4, dst += 4)
+        {
+            copyPixelBgra8888<ANTIALIASING>(src, dst);
         }
     }
 }
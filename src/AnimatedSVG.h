@@ -29,10 +29,60 @@
 #define ANIMATED_SVG_OPTION_LARGE_BUFFER     0x0004      // Large buffers allows for faster rasterization.
 #define ANIMATED_SVG_OPTION_BGRA8888         0x0008      // Output format is BGRA8888.
 #define ANIMATED_SVG_OPTION_RGB565           0x0010      // Output format is RGB565.
+#define ANIMATED_SVG_OPTION_COMPACT_EDGES    0x0020      // Store prepared edges in 16 bits fixed point (less memory, faster without FPU).
+#define ANIMATED_SVG_OPTION_PARALLEL         0x0040      // Rasterize parts of the buffer in worker threads (desktop and dual-core ESP32).
+#define ANIMATED_SVG_OPTION_DIRECT           0x0080      // Blend shapes straight into the RGB565 or BGRA8888 destination, without the rasterize buffer (approximate edges).
+#define ANIMATED_SVG_OPTION_IN_PLACE         0x0100      // Read the points of compiled images in place (e.g. from flash), only animated shapes are copied.
+#define ANIMATED_SVG_OPTION_ARENA            0x0200      // Allocate the image in a single block, or in the memory set by setImageMemory().
+#define ANIMATED_SVG_OPTION_STATIC_LAYER     0x0400      // Cache the shapes below the first animated shape in the destination format.
+
+#define ANIMATED_SVG_MAX_DIRTY_RECTS         8           // Maximum number of rectangles returned by rasterizeDirty.
+
+#define ANIMATED_SVG_QUALITY_DRAFT           1           // One sample per pixel row, the default with ANIMATED_SVG_OPTION_NO_ANTIALIASING.
+#define ANIMATED_SVG_QUALITY_LOW             3           // Three samples per pixel row.
+#define ANIMATED_SVG_QUALITY_NORMAL          5           // Five samples per pixel row, the default.
+#define ANIMATED_SVG_QUALITY_HIGH            15          // Fifteen samples per pixel row.
+
+#define ANIMATED_SVG_TOLERANCE_FINE          0.1f        // Curves are flattened within a tenth of a pixel.
+#define ANIMATED_SVG_TOLERANCE_NORMAL        0.25f       // Curves are flattened within a quarter of a pixel, the default.
+#define ANIMATED_SVG_TOLERANCE_COARSE        1.0f        // Curves are flattened within a pixel, with less edges.
 
 // Internal SVG image structure.
 typedef struct AnimatedSVGImage AnimatedSVGImage;
 
+// Rectangle in destination coordinates.
+typedef struct AnimatedSVGRect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} AnimatedSVGRect;
+
+// Counters and timings of a frame, only collected when the library is compiled with ANIMATED_SVG_STATS defined.
+typedef struct AnimatedSVGStats
+{
+    int shapesPrepared;             // Shapes prepared for rasterization.
+    int edgesPrepared;              // Edges prepared for rasterization.
+    int bands;                      // Parts of the destination rasterized.
+    int edgesVisited;               // Edges rasterized, summed over the bands they overlap.
+    int maxActiveEdges;             // Peak number of active edges of a scanline.
+    int pixelsBlended;              // Pixels blended, summed over the shapes covering them.
+    int activeEdgeTableGrows;       // Enlargements of the active edge tables of the rasterizers.
+    int animatesEvaluated;          // Animations evaluated by update().
+    unsigned long animateUs;        // Time of update() in microseconds.
+    unsigned long prepareUs;        // Time of preparing the image for rasterization in microseconds.
+    unsigned long finishUs;         // Time of rasterizing the prepared image in microseconds.
+    unsigned long copyUs;           // Time of copyToDest() in microseconds.
+} AnimatedSVGStats;
+
+// Callback reading the next chunk of an SVG file (e.g. from SD card or LittleFS).
+// Returns the number of bytes read into the buffer, 0 at the end of the file, or -1 on error.
+typedef int (*AnimatedSVGReadCallback)(void* userData, char* buffer, int size);
+
+// Callback receiving a band rasterized by rasterizeBands(), at x, y of the destination (e.g. to start pushing it to the display).
+typedef void (*AnimatedSVGBandCallback)(void* userData, void* band, int x, int y, int width, int height);
+
 // Class for handling animated SVGs.
 class AnimatedSVG
 {
@@ -40,10 +90,22 @@ class AnimatedSVG
 public:
     // Constructor.
     // Rasterize buffer should be in RGBA format (32 bits), but can be smaller than image size.
+    // With ANIMATED_SVG_OPTION_DIRECT the rasterize buffer and copyToDest() are not used, so the buffer can be NULL.
+    // DIRECT rounds antialiased edges and translucent colors differently, by up to 8 of 255 in BGRA8888 and 32 in RGB565.
     AnimatedSVG(const char* svg, unsigned char* rastBuffer, int bufferWidth, int bufferHeight, int options = 0);
 
-    // Destructor.
-    ~AnimatedSVG();
+    // Constructor for an image compiled by svgcompile, loaded without parsing the SVG.
+    // The compiled image is not modified, and is read again by every load().
+    AnimatedSVG(const unsigned char* binary, int binarySize, unsigned char* rastBuffer, int bufferWidth, int bufferHeight,
+                int options = 0);
+
+    // Constructor for an SVG file read in chunks by the callback, so the file does not need to be in memory.
+    // Every load() reads the file until the callback returns 0, so the file should be rewound before loading again.
+    AnimatedSVG(AnimatedSVGReadCallback readCallback, void* userData, unsigned char* rastBuffer, int bufferWidth,
+                int bufferHeight, int options = 0);
+
+    // Destructor, virtual as subclasses override copyToDest() and clearDest().
+    virtual ~AnimatedSVG();
 
 // Public methods.
 public:
@@ -60,31 +122,103 @@ public:
     // Unload the image.
     void unload();
 
-    // Update the animation according to timestamp.
+    // Update the animation according to timestamp, returns whether the image changed.
     bool update(long timeMs);
 
+    // Return the time of the next change after an update to timeMs, timeMs while the image changes continuously,
+    // or -1 if the image does not change anymore.
+    long nextChangeMs(long timeMs);
+
     // Rasterize the image with scale and position.
     void rasterize(void* dst, int dstWidth, int dstHeight, int dstStride,
                    float tx = 0, float ty = 0, float scale = 1);
 
+    // Rasterize only the areas changed since the last rasterize into a persistent destination.
+    // Changed areas are cleared with clearDest() before rendering unless an opaque shape covers them, and returned in rects
+    // (ANIMATED_SVG_MAX_DIRTY_RECTS).
+    // Returns the number of rectangles, the whole destination is returned if it was not rasterized before.
+    int rasterizeDirty(void* dst, int dstWidth, int dstHeight, int dstStride, AnimatedSVGRect* rects,
+                       float tx = 0, float ty = 0, float scale = 1);
+
+    // Rasterize the image in bands of the destination, passing each band to the callback as soon as it is rasterized, so the
+    // band can be sent to the display (e.g. by DMA) while the next one is rasterized.
+    // The bands are rasterized in turn into bandCount buffers of dstWidth x bandHeight pixels in the destination format
+    // (ANIMATED_SVG_OPTION_RGB565 or ANIMATED_SVG_OPTION_BGRA8888). A buffer is rasterized again bandCount - 1 bands
+    // after it was passed to the callback, e.g. with two buffers the callback waits for the previous band to be sent
+    // before starting to send the next one. Bands are cleared with clearDest() before rendering unless an opaque shape covers them.
+    void rasterizeBands(void** bands, int bandCount, int bandHeight, int dstWidth, int dstHeight,
+                        AnimatedSVGBandCallback callback, void* userData, float tx = 0, float ty = 0, float scale = 1);
+
     // Set the rasterization buffer.
     void setBuffer(unsigned char* rastBuffer, int bufferWidth, int bufferHeight);
 
+    // Set the antialiasing quality (ANIMATED_SVG_QUALITY_*), the number of samples of each pixel row.
+    // A change rasterizes the whole image again with the next rasterizeDirty().
+    void setQuality(int quality);
+
+    // Set the largest distance in pixels of flattened curves from the curves (ANIMATED_SVG_TOLERANCE_*).
+    // A larger tolerance prepares less edges, using less memory and rasterizing faster.
+    void setTolerance(float tolerance);
+
+    // Set the memory the image is loaded into with ANIMATED_SVG_OPTION_ARENA (e.g. in PSRAM or a static buffer).
+    // The image fails to load if it does not fit, getImageArenaMemory() returns the size it needs.
+    void setImageMemory(void* memory, int size);
+
+    // Set the memory of the static layer with ANIMATED_SVG_OPTION_STATIC_LAYER (e.g. in PSRAM), the destination size in its format.
+    // Without it the layer is allocated, and the static layer is not used if it does not fit.
+    void setStaticLayerMemory(void* memory, int size);
+
+    // Rasterize the static layer again with the next rasterize, e.g. when clearDest() fills it differently.
+    void invalidateStaticLayer();
+
     // Get the memory used by the image.
     int getImageUsedMemory();
 
-    // Get the memory used by the rasterize mechanism.
+    // Get the memory the image needs in memory set by setImageMemory(), or 0 without ANIMATED_SVG_OPTION_ARENA.
+    // Parsing SVG text needs the memory freed while parsing too, which is more than getImageUsedMemory() after compacting.
+    int getImageArenaMemory();
+
+    // Get the memory used by the rasterize mechanism (prepared image, allocated static layer and shared rasterizer contexts).
     int getRasterizerUsedMemory();
 
+    // Get the counters and timings since the last update() or resetStats(), all zeros without ANIMATED_SVG_STATS.
+    // The edges visited per band are edgesVisited / bands.
+    const AnimatedSVGStats& getStats();
+
+    // Reset the counters and timings, update() resets them to start a new frame.
+    void resetStats();
+
 // Protected methods.
 protected:
 
     // Copy rasterize buffer to destination.
     virtual void copyToDest(void* dstBuffer, int dstStride, int width, int height);
 
+    // Clear destination area before rasterizing a dirty rectangle (fills with zeros).
+    virtual void clearDest(void* dstBuffer, int dstStride, int width, int height);
+
 // Private methods.
 private:
 
+    // Prepare the rasterization of the image with the current scale, for a destination at tx, ty.
+    // Shapes outside the destination are not prepared, a destination of zero size prepares all shapes.
+    void prepare(float tx = 0, float ty = 0, int dstWidth = 0, int dstHeight = 0);
+
+    // Return whether an opaque shape of the prepared image covers a rectangle of the destination, so it need not be cleared.
+    bool isOpaque(const AnimatedSVGRect& rect, float tx, float ty);
+
+    // Rasterize the static layer if its placement changed, and set the shapes rasterized over it.
+    bool prepareStaticLayer(float tx, float ty, int dstWidth, int dstHeight);
+
+    // Clear a rectangle of the destination before rasterizing over it, or copy the static layer to it when used.
+    void clearRect(void* dst, int dstStride, const AnimatedSVGRect& rect, float tx, float ty, bool clear);
+
+    // Rasterize a rectangle of the destination in parts of the rasterize buffer size.
+    void rasterizeRect(void* dst, int dstStride, const AnimatedSVGRect& rect, float tx, float ty, bool clear);
+
+    // Rasterize a rectangle of the destination in the worker threads, returns false if it should be rasterized serially.
+    bool rasterizeRectParallel(void* dst, int dstStride, const AnimatedSVGRect& rect, float tx, float ty, bool clear);
+
     // Copy rasterization buffer in RGBA 8:8:8:8 to destination buffer in RGB 5:6:5.
     template <bool ANTIALIASING, bool SWAP_BYTES>
     void copyRgba888ToDstRgb565(void* dstBuffer, int dstStride, int width, int height);
@@ -97,11 +231,23 @@ private:
 private:
     struct AnimatedSVGImage* _image;
     const char* _svg;
+    const unsigned char* _binary;
+    int _binarySize;
+    AnimatedSVGReadCallback _readCallback;
+    void* _readUserData;
+    void* _imageMemory;
+    int _imageMemorySize;
+    void* _layerMemory;
+    int _layerMemorySize;
     unsigned char* _rastBuffer;
+    unsigned char* _bandBuffer;
     int _bufferWidth;
     int _bufferHeight;
     float _scale;
     int _options;
+    int _quality;
+    float _tolerance;
+    AnimatedSVGStats _stats;
 };
 
 #endif //ANIMATED_SVG_H
@@ -103,7 +103,13 @@ enum NSVGfillRule {
 };
 
 enum NSVGflags {
-	NSVG_FLAGS_VISIBLE = 0x01
+	NSVG_FLAGS_VISIBLE = 0x01,
+	NSVG_FLAGS_ANIMATED = 0x02,		// Animation was applied to the shape by the last update.
+	NSVG_FLAGS_CHANGED = 0x04		// Shape was changed by the last update.
+};
+
+enum NSVGbinaryFlags {
+	NSVG_BINARY_IN_PLACE = 0x01		// Use the points of shapes that are not animated from the binary image.
 };
 
 enum NSVGanimateType {
@@ -144,7 +150,8 @@ enum NSVGanimateAdditive {
 
 enum NSVGanimateFlags {
 	NSVG_ANIMATE_FLAG_GROUP_FIRST = 0x1,
-	NSVG_ANIMATE_FLAG_GROUP_LAST = 0x2
+	NSVG_ANIMATE_FLAG_GROUP_LAST = 0x2,
+	NSVG_ANIMATE_FLAG_CONSTANT = 0x4		// Source and destination values are the same.
 };
 
 typedef struct NSVGgradientStop {
@@ -164,72 +171,90 @@ typedef struct NSVGgradient {
 	NSVGgradientStop stops[1];
 } NSVGgradient;
 
+typedef struct NSVGid
+{
+	char id[64];
+	struct NSVGid* next;
+} NSVGid;
+
 typedef struct NSVGpaint {
 	signed char type;
 	union {
 		unsigned int color;
 		NSVGgradient* gradient;
+		NSVGid* ref;			// Id of the gradient while parsing, with NSVG_PAINT_UNDEF.
 	};
 } NSVGpaint;
 
+// Original values of a path for animations.
+typedef struct NSVGpathOrig
+{
+	float* pts;					// Cubic bezier points: x0,y0, [cpx1,cpx1,cpx2,cpy2,x1,y1], ... (following this struct).
+	float xform[6];				// Path transform.
+} NSVGpathOrig;
+
 typedef struct NSVGpath
 {
 	float* pts;					// Cubic bezier points: x0,y0, [cpx1,cpx1,cpx2,cpy2,x1,y1], ...
 	int npts;					// Total number of bezier points.
-	char closed;				// Flag indicating if shapes should be treated as closed.
 	float xform[6];				// Path transform.
 	float bounds[4];			// Tight bounding box of the shape [minx,miny,maxx,maxy].
 	struct NSVGpath* next;		// Pointer to next path, or NULL if last element.
-	// Original values for animations.
-	struct {
-		float* pts;				// Cubic bezier points: x0,y0, [cpx1,cpx1,cpx2,cpy2,x1,y1], ...
-		float xform[6];			// Path transform.
-	} orig;
+	NSVGpathOrig* orig;			// Original values for animations, or NULL if the shape is not animated.
+	char closed;				// Flag indicating if shapes should be treated as closed.
 	char scaled;				// Flag whether path was scaled to viewbox.
+	char inPlace;				// Flag whether the points are read from a binary image, and not owned by the path.
 } NSVGpath;
 
-typedef struct NSVGid
+// Original values of a shape for animations.
+typedef struct NSVGshapeOrig
 {
-	char id[64];
-	struct NSVGid* next;
-} NSVGid;
+	float opacity;				// Opacity of the shape.
+	float xform[6];				// Root transformation for fill/stroke gradient
+	NSVGpaint fill;				// Fill paint
+	NSVGpaint stroke;			// Stroke paint
+	float strokeWidth;			// Stroke width.
+	float strokeDashOffset;		// Stroke dash offset.
+	float strokeDashArray[8];	// Stroke dash array.
+	char strokeDashCount;		// Number of dash values in dash array.
+} NSVGshapeOrig;
 
 typedef struct NSVGshape
 {
-	NSVGid* id;					// Optional 'id' attr of the shape or its group
+	char* id;					// Optional 'id' attr of the shape or its group, or NULL.
 	NSVGpaint fill;				// Fill paint
 	NSVGpaint stroke;			// Stroke paint
 	float opacity;				// Opacity of the shape.
 	float strokeWidth;			// Stroke width (scaled).
 	float strokeDashOffset;		// Stroke dash offset (scaled).
 	float strokeDashArray[8];	// Stroke dash array (scaled).
+	float miterLimit;			// Miter limit
+	float bounds[4];			// Tight bounding box of the shape [minx,miny,maxx,maxy].
+	float xform[6];				// Root transformation for fill/stroke gradient
+	NSVGpath* paths;			// Linked list of paths in the image.
+	NSVGshapeOrig* orig;		// Original values for animations, or NULL if the shape is not animated.
+	unsigned int generation;	// Incremented whenever the shape is changed by an update.
 	char strokeDashCount;		// Number of dash values in dash array.
 	char strokeLineJoin;		// Stroke join type.
 	char strokeLineCap;			// Stroke cap type.
-	float miterLimit;			// Miter limit
 	char fillRule;				// Fill rule, see NSVGfillRule.
 	unsigned char flags;		// Logical or of NSVG_FLAGS_* flags
-	float bounds[4];			// Tight bounding box of the shape [minx,miny,maxx,maxy].
-	NSVGid* fillGradient;		// Optional 'id' of fill gradient
-	NSVGid* strokeGradient;		// Optional 'id' of stroke gradient
-	float xform[6];				// Root transformation for fill/stroke gradient
-	NSVGpath* paths;			// Linked list of paths in the image.
-	// Original values for animations.
-	struct {
-		float opacity;			// Opacity of the shape.
-		float xform[6];			// Root transformation for fill/stroke gradient
-		NSVGpaint fill;			// Fill paint
-		NSVGpaint stroke;		// Stroke paint
-		float strokeWidth;		// Stroke width.
-		float strokeDashOffset;	// Stroke dash offset.
-		float strokeDashArray[8];// Stroke dash array.
-		char strokeDashCount;	// Number of dash values in dash array.
-	} orig;
 	char strokeScaled;			// Flag whether stroke was scaled to viewbox.
 } NSVGshape;
 
 #define NSVG_ANIMATE
 
+// Number of segments of the tables that keySplines are eased with, more are closer to the splines.
+#ifndef NSVG_SPLINE_SEGMENTS
+#define NSVG_SPLINE_SEGMENTS 64
+#endif
+
+typedef struct NSVGsplineTable
+{
+	float spline[4];			// Spline of the table.
+	unsigned short values[NSVG_SPLINE_SEGMENTS+1];	// Progressions at the ends of the segments, in 1/65535.
+} NSVGsplineTable;
+
 typedef struct NSVGanimate
 {
 	long begin;					// Beginning time of animation in milliseconds.
@@ -249,6 +274,9 @@ typedef struct NSVGanimate
 	char additive;				// Animation additive mode, see NSVGanimateAdditive.
 	char fill;					// Animation fill mode, see NSVGanimateFill.
 	char flags;					// Flags for this element.
+	float progression;			// Progression applied by the last update, or -1 if not applied.
+	float xform[6];				// Transform of a transform animation at the progression.
+	int splineTable;			// Index of the table of the spline in the image, or -1 if the spline is solved.
 
 	struct NSVGanimate* next;	// Pointer to next animate, or NULL if last element.
 } NSVGanimate;
@@ -264,6 +292,24 @@ typedef struct NSVGshapeNode
 	NSVGanimate* animatesTail;		// Tail of linked list of animations for the shape.
 } NSVGshapeNode;
 
+typedef struct NSVGanimatedNode
+{
+	NSVGshapeNode* node;			// Shape node with animations.
+	NSVGshapeNode* lastNode;		// Last node affected by the animations, the node is followed by its descendants.
+	long begin;						// Time when the first animation begins in milliseconds.
+	long end;						// Time after which the animations do not change in milliseconds, or -1 for no end.
+	int update;						// Number of the update which last evaluated the animations.
+} NSVGanimatedNode;
+
+typedef struct NSVGanimateEvent
+{
+	long time;						// Time of the event in milliseconds.
+	int node;						// Index of the animated node.
+	char begin;						// Flag whether the animations of the node begin or end.
+} NSVGanimateEvent;
+
+#define NSVG_MAX_DIRTY_RECTS 8
+
 typedef struct NSVGimage
 {
 	float width;				// Width of the image.
@@ -278,16 +324,52 @@ typedef struct NSVGimage
 	int alignY;					// Alignment Y.
 	int alignType;				// Alignment type.
 	char units[3];				// Units.
+	float viewXform[6];			// Transform from user space to the viewbox, applied to the shapes.
 	NSVGshapeNode* shapes;		// Linked list of shapes in the image.
+	float dirtyRects[NSVG_MAX_DIRTY_RECTS][4];	// Areas changed by animation [minx,miny,maxx,maxy].
+	int ndirtyRects;			// Number of dirty rectangles.
+	NSVGanimatedNode* animatedNodes;	// Shape nodes with animations, and the shapes they affect.
+	int nanimatedNodes;
+	NSVGanimateEvent* events;	// Begin and end events of the animated nodes, sorted by time.
+	int nevents;
+	int nextEvent;				// First event after the last update.
+	int* liveNodes;				// Animated nodes between their begin and end events, updated by every update.
+	int nliveNodes;
+	NSVGshapeNode** changedNodes;	// Shape nodes changed by the last update.
+	int nchangedNodes;
+	int maxChangedNodes;
+	long animateTime;			// Time of the last update.
+	int nupdates;				// Number of updates.
+	NSVGsplineTable* splineTables;	// Tables of the distinct keySplines, shared by their animations.
+	int nsplineTables;
+	int nevaluatedAnimates;		// Animations evaluated by updates, only counted with NSVG_STATS defined.
 	int memorySize;				// Amount of memory in bytes that was allocated by the image.
+	int arenaMemorySize;		// Amount of memory in bytes the arena needs in memory of the user (8 bytes aligned), or 0 if not in an arena.
+	struct NSVGarenaBlock* arena;	// Blocks of the arena the image is allocated in, the current first, or NULL if allocated on the heap.
+	char arenaFull;				// Flag whether an allocation did not fit in the arena.
 } NSVGimage;
 
 // Parses SVG file from a file, returns SVG image as paths.
 NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi);
 
 // Parses SVG file from a null terminated string, returns SVG image as paths.
-// Important note: changes the string.
-NSVGimage* nsvgParse(char* input, const char* units, float dpi);
+// The string is not changed, so it can be read-only (e.g. in flash).
+NSVGimage* nsvgParse(const char* input, const char* units, float dpi);
+
+// Begins parsing SVG file in chunks, returns the parser, or NULL on error.
+// Only an element split between chunks is buffered, so the whole file does not need to be in memory.
+struct NSVGparser* nsvgParseBegin(const char* units, float dpi);
+
+// Parses the next chunk of SVG file, returns 0 on error.
+int nsvgParseFeed(struct NSVGparser* parser, const char* chunk, int len);
+
+// Ends parsing SVG file in chunks and deletes the parser, returns SVG image as paths, or NULL on error.
+NSVGimage* nsvgParseEnd(struct NSVGparser* parser);
+
+// Begins parsing SVG file in chunks like nsvgParseBegin, with the image allocated in an arena freed in one call by nsvgDelete.
+// The image is parsed into the given memory (e.g. in PSRAM or a static buffer), and is not returned if it does not fit.
+// With memory NULL, it is parsed into blocks on the heap, which are compacted into one block of the exact size by nsvgParseEnd.
+struct NSVGparser* nsvgParseBeginArena(const char* units, float dpi, void* memory, int size);
 
 // Duplicates a path.
 NSVGpath* nsvgDuplicatePath(NSVGpath* p);
@@ -295,12 +377,33 @@ NSVGpath* nsvgDuplicatePath(NSVGpath* p);
 // Deletes an image.
 void nsvgDelete(NSVGimage* image);
 
+// Serializes a parsed image into a relocatable binary blob, returns the size of the blob, or 0 on error.
+// With data NULL or too small, only the size is returned. The image should be serialized before it is animated.
+int nsvgSerialize(NSVGimage* image, unsigned char* data, int size);
+
+// Loads an image from a binary blob created by nsvgSerialize, the blob is left untouched.
+// With NSVG_BINARY_IN_PLACE, the points of shapes that are not animated are read in place from the blob instead
+// of being copied (if it is 4 bytes aligned), so it can stay in memory-mapped flash but must outlive the image.
+NSVGimage* nsvgParseBinary(const unsigned char* data, int size, int flags);
+
+// Loads an image from a binary blob like nsvgParseBinary, with the image allocated in an arena like nsvgParseBeginArena.
+NSVGimage* nsvgParseBinaryArena(const unsigned char* data, int size, int flags, void* memory, int memorySize);
+
 // Return whether SVG image is animated or not.
 int nsvgIsAnimated(NSVGimage* image);
 
 // Animate SVG by time. Returns whether image was updated.
+// Only shapes whose animations progressed are updated, and their generation is incremented.
+// The areas covered by changed shapes before and after the update are added to the dirty rectangles.
 int nsvgAnimate(NSVGimage* image, long timeMs);
 
+// Clears the dirty rectangles collected by nsvgAnimate.
+void nsvgResetDirty(NSVGimage* image);
+
+// Returns the time of the next change of an image animated to timeMs, timeMs if it changes continuously,
+// or -1 if it does not change anymore.
+long nsvgNextChange(NSVGimage* image, long timeMs);
+
 #ifndef NANOSVG_CPLUSPLUS
 #ifdef __cplusplus
 }
@@ -313,6 +416,7 @@ int nsvgAnimate(NSVGimage* image, long timeMs);
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 
 #define NSVG_PI (3.14159265358979323846264338327f)
 #define NSVG_KAPPA90 (0.5522847493f)	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
@@ -492,45 +596,123 @@ static void nsvg__parseElement(const char* elementStart, int elementLen,
 		(*endelCb)(userData, name, nameLen);
 }
 
-int nsvg__parseXML(const char* input,
-				   void (*startelCb)(void* userData, const char* elName, int elNameLen, NSVGattrValue* attr, int nattr),
-				   void (*endelCb)(void* userData, const char* elName, int elNameLen),
-				   void (*contentCb)(void* userData, const char* content, int contentLen),
-				   void* userData)
+// State of XML parsed in chunks, a tag split between chunks is kept in a buffer.
+typedef struct NSVGxmlStream
+{
+	int state;
+	char* tag;					// Start of the current tag from previous chunks, null terminated.
+	int tagLen;
+	int tagCap;
+	int tagCount;				// Number of characters of the current tag, to find comments.
+	char tagStart[3];
+	int dashes;					// Number of dashes before the current character of a comment.
+	int error;
+	void (*startelCb)(void* userData, const char* elName, int elNameLen, NSVGattrValue* attr, int nattr);
+	void (*endelCb)(void* userData, const char* elName, int elNameLen);
+	void (*contentCb)(void* userData, const char* content, int contentLen);
+	void* userData;
+} NSVGxmlStream;
+
+static int nsvg__appendXMLTag(NSVGxmlStream* x, const char* s, int len)
+{
+	if (x->tagLen + len + 1 > x->tagCap) {
+		int cap = (x->tagLen + len + 1 > x->tagCap * 2) ? x->tagLen + len + 1 : x->tagCap * 2;
+		char* tag = (char*)realloc(x->tag, cap);
+		if (tag == NULL) {
+			x->error = 1;
+			return 0;
+		}
+		x->tag = tag;
+		x->tagCap = cap;
+	}
+	memcpy(&x->tag[x->tagLen], s, len);
+	x->tagLen += len;
+	x->tag[x->tagLen] = '\0';
+	return 1;
+}
+
+// Parses the next chunk of XML, content may be passed to the callback in parts.
+static int nsvg__parseXMLChunk(NSVGxmlStream* x, const char* input, int len)
 {
 	const char* s = input;
+	const char* end = input + len;
 	const char* mark = s;
-	int state = NSVG_XML_CONTENT;
-	while (*s) {
-		if (state == NSVG_XML_CONTENT && *s == '<') {
-			if (mark < s) {
-				nsvg__parseContent(mark, s - mark, contentCb, userData);
+
+	if (x->error) return 0;
+
+	for (; s < end; s++) {
+		if (x->state == NSVG_XML_CONTENT) {
+			if (*s == '<') {
+				if (mark < s) {
+					nsvg__parseContent(mark, s - mark, x->contentCb, x->userData);
+				}
+				// Start of a tag
+				x->state = NSVG_XML_TAG;
+				x->tagLen = 0;
+				x->tagCount = 0;
+				mark = s + 1;
 			}
-			// Start of a tag
-			if (strncmp(s, "<!--", 4) == 0) {
-				state = NSVG_XML_COMMENT;
-				s += 4;
-			} else {
-				mark = ++s;
-				state = NSVG_XML_TAG;
+		} else if (x->state == NSVG_XML_TAG) {
+			if (*s == '>') {
+				// Start of a content or new tag, the tag is parsed in place unless split between chunks.
+				if (x->tagLen > 0) {
+					if (!nsvg__appendXMLTag(x, mark, s - mark)) return 0;
+					nsvg__parseElement(x->tag, x->tagLen, x->startelCb, x->endelCb, x->userData);
+					x->tagLen = 0;
+				} else {
+					nsvg__parseElement(mark, s - mark, x->startelCb, x->endelCb, x->userData);
+				}
+				x->state = NSVG_XML_CONTENT;
+				mark = s + 1;
+			} else if (x->tagCount < 3) {
+				x->tagStart[x->tagCount++] = *s;
+				if (x->tagCount == 3 && memcmp(x->tagStart, "!--", 3) == 0) {
+					x->state = NSVG_XML_COMMENT;
+					x->tagLen = 0;
+					x->dashes = 0;
+				}
 			}
-		} else if (state == NSVG_XML_TAG && *s == '>') {
-			// Start of a content or new tag.
-			nsvg__parseElement(mark, s - mark, startelCb, endelCb, userData);
-			mark = ++s;
-			state = NSVG_XML_CONTENT;
-		} else if (state == NSVG_XML_COMMENT && strncmp(s, "-->", 3) == 0) {
-			state = NSVG_XML_CONTENT;
-			s += 3;
-			mark = s;
-		} else {
-			s++;
+		} else if (x->state == NSVG_XML_COMMENT) {
+			if (*s == '>' && x->dashes >= 2) {
+				x->state = NSVG_XML_CONTENT;
+				mark = s + 1;
+			}
+			x->dashes = (*s == '-') ? x->dashes + 1 : 0;
 		}
 	}
 
+	// Keep the start of the tag for the next chunk.
+	if (x->state == NSVG_XML_TAG && mark < end) {
+		if (!nsvg__appendXMLTag(x, mark, end - mark)) return 0;
+	} else if (x->state == NSVG_XML_CONTENT && mark < end) {
+		nsvg__parseContent(mark, end - mark, x->contentCb, x->userData);
+	}
+
 	return 1;
 }
 
+int nsvg__parseXML(const char* input,
+				   void (*startelCb)(void* userData, const char* elName, int elNameLen, NSVGattrValue* attr, int nattr),
+				   void (*endelCb)(void* userData, const char* elName, int elNameLen),
+				   void (*contentCb)(void* userData, const char* content, int contentLen),
+				   void* userData)
+{
+	NSVGxmlStream x;
+	int ret;
+
+	memset(&x, 0, sizeof(x));
+	x.state = NSVG_XML_CONTENT;
+	x.startelCb = startelCb;
+	x.endelCb = endelCb;
+	x.contentCb = contentCb;
+	x.userData = userData;
+
+	ret = nsvg__parseXMLChunk(&x, input, (int)strlen(input));
+	free(x.tag);
+
+	return ret;
+}
+
 /* Simple SVG parser. */
 
 enum NSVGgradientUnits {
@@ -627,6 +809,7 @@ typedef struct NSVGparser
 	char pathFlag;
 	char defsFlag;
 	int shapeDepth;
+	NSVGxmlStream xml;
 } NSVGparser;
 
 static void nsvg__xformIdentity(float* t)
@@ -807,36 +990,111 @@ static void nsvg__curveBounds(float* bounds, float* curve)
 	}
 }
 
-static void* nsvg__malloc(NSVGimage* image, int size)
+// Size of the blocks of an arena on the heap.
+#define NSVG_ARENA_BLOCK_SIZE 4096
+
+// Size of an allocation in an arena, rounded up so all allocations stay aligned.
+#define NSVG_ARENA_SIZE(size) (((size) + 7) & ~7)
+
+// Block of an arena, followed by the allocations.
+typedef struct NSVGarenaBlock
 {
-	void* ptr = malloc(size);
-	if (ptr == NULL)
-	{
-		return NULL;
-	}
+	struct NSVGarenaBlock* next;	// Previous block, or NULL if the first.
+	int size;					// Size of the block in bytes, including this header.
+	int used;					// Number of bytes used, including this header.
+	int external;				// Flag whether the block is memory of the user, which is neither freed nor extended.
+} NSVGarenaBlock;
 
-	image->memorySize += size;
+static void* nsvg__arenaAlloc(NSVGimage* image, int size)
+{
+	NSVGarenaBlock* block = image->arena;
+	int blockSize;
+	void* ptr;
+
+	size = NSVG_ARENA_SIZE(size);
+	if (block->used + size > block->size) {
+		if (block->external) {
+			image->arenaFull = 1;
+			return NULL;
+		}
+		// The rest of the current block is left unused, it is reclaimed by compacting.
+		blockSize = NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock)) + size;
+		if (blockSize < NSVG_ARENA_BLOCK_SIZE) blockSize = NSVG_ARENA_BLOCK_SIZE;
+		block = (NSVGarenaBlock*)malloc(blockSize);
+		if (block == NULL) {
+			image->arenaFull = 1;
+			return NULL;
+		}
+		block->next = image->arena;
+		block->size = blockSize;
+		block->used = NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock));
+		block->external = 0;
+		image->arena = block;
+	}
 
+	ptr = (char*)block + block->used;
+	block->used += size;
 	return ptr;
 }
 
-static void* nsvg__realloc(NSVGimage* image, void* ptr, int size, int prevSize)
+static void nsvg__deleteArena(NSVGarenaBlock* block)
+{
+	NSVGarenaBlock* next;
+	while (block != NULL) {
+		next = block->next;
+		if (!block->external) free(block);
+		block = next;
+	}
+}
+
+// Creates an empty image at the start of an arena, in the memory of the user or in a block on the heap if memory is NULL.
+static NSVGimage* nsvg__createArenaImage(void* memory, int size)
+{
+	NSVGarenaBlock* block;
+	NSVGimage* image;
+	int offset;
+
+	if (memory != NULL) {
+		offset = (int)((8 - ((size_t)memory & 7)) & 7);
+		if (size - offset < (int)(NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock)) + NSVG_ARENA_SIZE(sizeof(NSVGimage)))) return NULL;
+		block = (NSVGarenaBlock*)((char*)memory + offset);
+		block->size = size - offset;
+		block->external = 1;
+	} else {
+		block = (NSVGarenaBlock*)malloc(NSVG_ARENA_BLOCK_SIZE);
+		if (block == NULL) return NULL;
+		block->size = NSVG_ARENA_BLOCK_SIZE;
+		block->external = 0;
+	}
+	block->next = NULL;
+	block->used = NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock));
+
+	image = (NSVGimage*)((char*)block + block->used);
+	block->used += NSVG_ARENA_SIZE(sizeof(NSVGimage));
+	memset(image, 0, sizeof(NSVGimage));
+	image->arena = block;
+
+	return image;
+}
+
+static void* nsvg__malloc(NSVGimage* image, int size)
 {
-	void* ptr2 = realloc(ptr, size);
-	if (ptr2 == NULL)
+	void* ptr = (image->arena != NULL) ? nsvg__arenaAlloc(image, size) : malloc(size);
+	if (ptr == NULL)
 	{
 		return NULL;
 	}
 
-	image->memorySize += size - prevSize;
+	image->memorySize += size;
 
-	return ptr2;
+	return ptr;
 }
 
 static void nsvg__free(NSVGimage* image, void* ptr, int size)
 {
 	if (ptr == NULL) return;
-	free(ptr);
+	// Memory of an arena is only freed with the whole arena.
+	if (image->arena == NULL) free(ptr);
 	image->memorySize -= size;
 }
 
@@ -885,14 +1143,19 @@ error:
 	return NULL;
 }
 
+// The original points follow the original values of a path in a single allocation.
+static int nsvg__pathOrigSize(int npts)
+{
+	return sizeof(NSVGpathOrig) + npts*2*sizeof(float);
+}
+
 static void nsvg__deletePaths(NSVGimage* image, NSVGpath* path)
 {
 	while (path) {
 		NSVGpath *next = path->next;
-		if (path->pts != NULL)
+		if (path->pts != NULL && !path->inPlace)
 			nsvg__free(image, path->pts, path->npts*2*sizeof(float));
-		if (path->orig.pts != NULL)
-			nsvg__free(image, path->orig.pts, path->npts*2*sizeof(float));
+		nsvg__free(image, path->orig, nsvg__pathOrigSize(path->npts));
 		nsvg__free(image, path, sizeof(NSVGpath));
 		path = next;
 	}
@@ -902,17 +1165,19 @@ static void nsvg__deletePaint(NSVGimage* image, NSVGpaint* paint)
 {
 	if (paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT)
 		nsvg__free(image, paint->gradient, sizeof(NSVGgradient));
+	else if (paint->type == NSVG_PAINT_UNDEF)
+		nsvg__free(image, paint->ref, sizeof(NSVGid));
 }
 
-static void nsvg__deleteGradientData(NSVGparser* p, NSVGgradientData* grad)
+static void nsvg__deleteGradientData(NSVGgradientData* grad)
 {
 	NSVGgradientData* next;
 	while (grad != NULL) {
 		next = grad->next;
-		nsvg__free(p->image, grad->id, sizeof(NSVGid));
-		nsvg__free(p->image, grad->ref, sizeof(NSVGid));
-		nsvg__free(p->image, grad->stops, sizeof(NSVGgradientStop)*grad->nstops);
-		nsvg__free(p->image, grad, sizeof(NSVGgradientData));
+		free(grad->id);
+		free(grad->ref);
+		free(grad->stops);
+		free(grad);
 		grad = next;
 	}
 }
@@ -924,8 +1189,9 @@ static void nsvg__deleteParser(NSVGparser* p)
 
 	if (p != NULL) {
 		nsvg__deletePaths(p->image, p->plist);
-		nsvg__deleteGradientData(p, p->gradients);
+		nsvg__deleteGradientData(p->gradients);
 		free(p->pts);
+		free(p->xml.tag);
 
 		for (attr = p->attrHead; attr != NULL;) {
 			NSVGattrib* next = attr->next;
@@ -957,7 +1223,7 @@ static void nsvg__addPoint(NSVGparser* p, float x, float y)
 {
 	if (p->npts+1 > p->cpts) {
 		int cpts = p->cpts ? p->cpts*2 : 8;
-		p->pts = (float*)nsvg__realloc(p->image, p->pts, cpts*2*sizeof(float), p->cpts*2*sizeof(float));
+		p->pts = (float*)realloc(p->pts, cpts*2*sizeof(float));
 		p->cpts = cpts;
 		if (!p->pts) return;
 	}
@@ -1315,12 +1581,21 @@ static void nsvg__addShape(NSVGparser* p)
 	if (shapeNode == NULL) goto error;
 	memset(shapeNode, 0, sizeof(NSVGshapeNode));
 
+	// Original values are kept after parsing only if the shape is animated.
+	shape->orig = (NSVGshapeOrig*)nsvg__malloc(p->image, sizeof(NSVGshapeOrig));
+	if (shape->orig == NULL) goto error;
+	memset(shape->orig, 0, sizeof(NSVGshapeOrig));
+
+	// The id is stored with its exact length.
+	if (attr->id != NULL) {
+		shape->id = (char*)nsvg__malloc(p->image, (int)strlen(attr->id->id) + 1);
+		if (shape->id == NULL) goto error;
+		strcpy(shape->id, attr->id->id);
+	}
+
 	shapeNode->shapeDepth = p->shapeDepth;
 	shapeNode->shape = shape;
 
-	shape->id = attr->id;
-	shape->fillGradient = attr->fillGradient;
-	shape->strokeGradient = attr->strokeGradient;
 	memcpy(shape->xform, attr->xform, sizeof shape->xform);
 	shape->strokeWidth = attr->strokeWidth;
 	shape->strokeDashOffset = attr->strokeDashOffset;
@@ -1336,11 +1611,6 @@ static void nsvg__addShape(NSVGparser* p)
 	shape->paths = p->plist;
 	p->plist = NULL;
 
-	// Remove the IDs from the attribute (moved to shape).
-	attr->id = NULL;
-	attr->fillGradient = NULL;
-	attr->strokeGradient = NULL;
-
 	// Calculate shape bounds
 	shape->bounds[0] = shape->paths->bounds[0];
 	shape->bounds[1] = shape->paths->bounds[1];
@@ -1362,6 +1632,8 @@ static void nsvg__addShape(NSVGparser* p)
 		shape->fill.color |= (unsigned int)(attr->fillOpacity*255) << 24;
 	} else if (attr->hasFill == 2) {
 		shape->fill.type = NSVG_PAINT_UNDEF;
+		shape->fill.ref = attr->fillGradient;
+		attr->fillGradient = NULL;
 	}
 
 	// Set stroke
@@ -1373,21 +1645,31 @@ static void nsvg__addShape(NSVGparser* p)
 		shape->stroke.color |= (unsigned int)(attr->strokeOpacity*255) << 24;
 	} else if (attr->hasStroke == 2) {
 		shape->stroke.type = NSVG_PAINT_UNDEF;
+		shape->stroke.ref = attr->strokeGradient;
+		attr->strokeGradient = NULL;
 	}
 
+	// Remove the IDs from the attribute (moved to shape).
+	nsvg__freeId(p, attr->id);
+	nsvg__freeId(p, attr->fillGradient);
+	nsvg__freeId(p, attr->strokeGradient);
+	attr->id = NULL;
+	attr->fillGradient = NULL;
+	attr->strokeGradient = NULL;
+
 	// Set flags
 	shape->flags = (attr->visible ? NSVG_FLAGS_VISIBLE : 0x00);
 
 	// Store original values for animation.
-	shape->orig.opacity = attr->opacity;
-	memcpy(shape->orig.xform, shape->xform, sizeof shape->xform);
-	memcpy(&shape->orig.fill, &shape->fill, sizeof(shape->orig.fill));
-	memcpy(&shape->orig.stroke, &shape->stroke, sizeof(shape->orig.stroke));
-	shape->orig.strokeWidth = shape->strokeWidth;
-	shape->orig.strokeDashOffset = shape->strokeDashOffset;
+	shape->orig->opacity = attr->opacity;
+	memcpy(shape->orig->xform, shape->xform, sizeof shape->xform);
+	memcpy(&shape->orig->fill, &shape->fill, sizeof(shape->orig->fill));
+	memcpy(&shape->orig->stroke, &shape->stroke, sizeof(shape->orig->stroke));
+	shape->orig->strokeWidth = shape->strokeWidth;
+	shape->orig->strokeDashOffset = shape->strokeDashOffset;
 	for (i = 0; i < shape->strokeDashCount; i++)
-		shape->orig.strokeDashArray[i] = shape->strokeDashArray[i];
-	shape->orig.strokeDashCount = shape->strokeDashCount;
+		shape->orig->strokeDashArray[i] = shape->strokeDashArray[i];
+	shape->orig->strokeDashCount = shape->strokeDashCount;
 
 	// Scale the stroke.
 	nsvg__scaleShapeStroke(shape, shape->xform);
@@ -1405,7 +1687,11 @@ static void nsvg__addShape(NSVGparser* p)
 
 error:
 	if (shapeNode) nsvg__free(p->image, shapeNode, sizeof(NSVGshapeNode));
-	if (shape) nsvg__free(p->image, shape, sizeof(NSVGshape));
+	if (shape) {
+		nsvg__free(p->image, shape->orig, sizeof(NSVGshapeOrig));
+		if (shape->id) nsvg__free(p->image, shape->id, (int)strlen(shape->id) + 1);
+		nsvg__free(p->image, shape, sizeof(NSVGshape));
+	}
 }
 
 static void nsvg__transformPath(NSVGpath* path, float* xform)
@@ -1416,7 +1702,7 @@ static void nsvg__transformPath(NSVGpath* path, float* xform)
 
 	// Transform path.
 	for (i = 0; i < path->npts; ++i)
-		nsvg__xformPoint(&path->pts[i*2], &path->pts[i*2+1], path->orig.pts[i*2], path->orig.pts[i*2+1], xform);
+		nsvg__xformPoint(&path->pts[i*2], &path->pts[i*2+1], path->orig->pts[i*2], path->orig->pts[i*2+1], xform);
 
 	// Find bounds
 	for (i = 0; i < path->npts-1; i += 3) {
@@ -1466,11 +1752,12 @@ static void nsvg__addPath(NSVGparser* p, char closed)
 	memcpy(path->pts, p->pts, p->npts*2*sizeof(float));
 	memcpy(path->xform, attr->xform, sizeof(path->xform));
 
-	// Store original values for animation.
-	path->orig.pts = (float*)nsvg__malloc(p->image, path->npts*2*sizeof(float));
-	if (path->orig.pts == NULL) goto error;
-	memcpy(path->orig.pts, path->pts, path->npts*2*sizeof(float));
-	memcpy(path->orig.xform, path->xform, sizeof(float)*6);
+	// Store original values for animation, they are kept after parsing only if the shape is animated.
+	path->orig = (NSVGpathOrig*)nsvg__malloc(p->image, nsvg__pathOrigSize(path->npts));
+	if (path->orig == NULL) goto error;
+	path->orig->pts = (float*)(path->orig + 1);
+	memcpy(path->orig->pts, path->pts, path->npts*2*sizeof(float));
+	memcpy(path->orig->xform, path->xform, sizeof(float)*6);
 
 	nsvg__transformPath(path, path->xform);
 
@@ -1482,7 +1769,6 @@ static void nsvg__addPath(NSVGparser* p, char closed)
 error:
 	if (path != NULL) {
 		if (path->pts != NULL) nsvg__free(p->image, path->pts, p->npts*2*sizeof(float));
-		if (path->orig.pts != NULL) nsvg__free(p->image, path->orig.pts, p->npts*2*sizeof(float));
 		nsvg__free(p->image, path, sizeof(NSVGpath));
 	}
 }
@@ -2311,7 +2597,10 @@ static void nsvg__parseStyle(NSVGparser* p, const char* str, int strLen)
 		++end;
 
 		nsvg__parseNameValue(p, start, end);
-		if (*str) ++str;
+		if (*str && strLen > 0) {
+			++str;
+			strLen--;
+		}
 	}
 }
 
@@ -3110,7 +3399,8 @@ static void nsvg__parseGradient(NSVGparser* p, NSVGattrValue* attr, int nattr, s
 {
 	int i, len;
 
-	NSVGgradientData* grad = (NSVGgradientData*)nsvg__malloc(p->image, sizeof(NSVGgradientData));
+	// Gradient data is only used while parsing, it is not allocated by the image.
+	NSVGgradientData* grad = (NSVGgradientData*)malloc(sizeof(NSVGgradientData));
 	if (grad == NULL) return;
 	memset(grad, 0, sizeof(NSVGgradientData));
 	grad->units = NSVG_OBJECT_SPACE;
@@ -3130,7 +3420,7 @@ static void nsvg__parseGradient(NSVGparser* p, NSVGattrValue* attr, int nattr, s
 
 	for (i = 0; i < nattr; i++) {
 		if (nsvg__strequal(attr[i].name, "id", attr[i].nameLen)) {
-			if (grad->id == NULL) grad->id = nsvg__allocId(p);
+			if (grad->id == NULL) grad->id = (NSVGid*)malloc(sizeof(NSVGid));
 			if (grad->id == NULL) return;
 			len = attr[i].valueLen < 63 ? attr[i].valueLen : 63;
 			strncpy(grad->id->id, attr[i].value, len);
@@ -3170,7 +3460,7 @@ static void nsvg__parseGradient(NSVGparser* p, NSVGattrValue* attr, int nattr, s
 					grad->spread = NSVG_SPREAD_REPEAT;
 			} else if (nsvg__strequal(attr[i].name, "xlink:href", attr[i].nameLen)) {
 				const char *href = attr[i].value;
-				if (grad->ref == NULL) grad->ref = nsvg__allocId(p);
+				if (grad->ref == NULL) grad->ref = (NSVGid*)malloc(sizeof(NSVGid));
 				if (grad->ref == NULL) return;
 				len = attr[i].valueLen < 62 ? attr[i].valueLen : 62;
 				strncpy(grad->ref->id, href+1, len);
@@ -3203,7 +3493,7 @@ static void nsvg__parseGradientStop(NSVGparser* p, NSVGattrValue* attr, int natt
 	if (grad == NULL) return;
 
 	nstops = grad->nstops + 1;
-	grad->stops = (NSVGgradientStop*)nsvg__realloc(p->image, grad->stops, sizeof(NSVGgradientStop)*nstops, sizeof(NSVGgradientStop)*grad->nstops);
+	grad->stops = (NSVGgradientStop*)realloc(grad->stops, sizeof(NSVGgradientStop)*nstops);
 	grad->nstops = nstops;
 	if (grad->stops == NULL) return;
 
@@ -3436,6 +3726,8 @@ static NSVGanimate* nsvg__addAnimate(NSVGparser* p, char animateType, long begin
 	animate->calcMode = calcMode;
 	animate->additive = additive;
 	animate->fill = fill;
+	animate->progression = -1;
+	animate->splineTable = -1;
 
 	if (*animateList == NULL) {
 		*animateList = animate;
@@ -3456,7 +3748,7 @@ static void nsvg__parseAnimate(NSVGparser* p, const char* tagName, int tagNameLe
 {
 	char it[64];
 	float args[10] = {0};
-	long unset = 0x80000000;
+	long unset = INT_MIN;		// Also fits the int repeatCount on 64 bit hosts.
 	long begin = 0;
 	long end = unset;
 	long dur = unset;
@@ -3692,7 +3984,7 @@ static void nsvg__parseAnimate(NSVGparser* p, const char* tagName, int tagNameLe
 error:
 	while (animateList != NULL) {
 		animate = animateList->next;
-		free(animateList);
+		nsvg__free(p->image, animateList, sizeof(NSVGanimate));
 		animateList = animate;
 	}
 }
@@ -3832,17 +4124,14 @@ static void nsvg__scaleGradient(NSVGgradient* grad, float tx, float ty, float sx
 	nsvg__xformMultiply (grad->xform, t);
 }
 
-static void nsvg__scaleToViewbox(NSVGimage* image)
+// Finds the transform of the shapes to the viewbox, guessing the image size if not set completely.
+static void nsvg__getViewboxTransform(NSVGimage* image, float* ptx, float* pty, float* psx, float* psy)
 {
-	NSVGshapeNode* shapeNode;
-	NSVGshape* shape;
-	NSVGpath* path;
-	float tx, ty, sx, sy, us, bounds[4], t[6], avgs;
-	int i;
-	float* pt;
+	float tx, ty, sx, sy, us, bounds[4];
 
 	// Guess image size if not set completely.
-	nsvg__imageBounds(image, bounds);
+	if (image->viewWidth == 0 || image->viewHeight == 0)
+		nsvg__imageBounds(image, bounds);
 
 	if (image->viewWidth == 0) {
 		if (image->width > 0) {
@@ -3888,49 +4177,73 @@ static void nsvg__scaleToViewbox(NSVGimage* image)
 	// Transform
 	sx *= us;
 	sy *= us;
-	avgs = (sx+sy) / 2.0f;
-	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
-		shape = shapeNode->shape;
-		if (shape == NULL) continue;
+	nsvg__xformSetScale(image->viewXform, sx, sy);
+	image->viewXform[4] = tx * sx;
+	image->viewXform[5] = ty * sy;
 
-		shape->bounds[0] = (shape->bounds[0] + tx) * sx;
-		shape->bounds[1] = (shape->bounds[1] + ty) * sy;
-		shape->bounds[2] = (shape->bounds[2] + tx) * sx;
-		shape->bounds[3] = (shape->bounds[3] + ty) * sy;
-		for (path = shape->paths; path != NULL; path = path->next) {
-			path->bounds[0] = (path->bounds[0] + tx) * sx;
-			path->bounds[1] = (path->bounds[1] + ty) * sy;
-			path->bounds[2] = (path->bounds[2] + tx) * sx;
-			path->bounds[3] = (path->bounds[3] + ty) * sy;
-			if (!path->scaled) {
-				for (i =0; i < path->npts; i++) {
-					pt = &path->pts[i*2];
-					pt[0] = (pt[0] + tx) * sx;
-					pt[1] = (pt[1] + ty) * sy;
-				}
-				path->scaled = 1;
+	*ptx = tx;
+	*pty = ty;
+	*psx = sx;
+	*psy = sy;
+}
+
+static void nsvg__scaleShapeToViewbox(NSVGshape* shape, float tx, float ty, float sx, float sy)
+{
+	NSVGpath* path;
+	float t[6], avgs;
+	int i;
+	float* pt;
+
+	avgs = (sx+sy) / 2.0f;
+	shape->bounds[0] = (shape->bounds[0] + tx) * sx;
+	shape->bounds[1] = (shape->bounds[1] + ty) * sy;
+	shape->bounds[2] = (shape->bounds[2] + tx) * sx;
+	shape->bounds[3] = (shape->bounds[3] + ty) * sy;
+	for (path = shape->paths; path != NULL; path = path->next) {
+		path->bounds[0] = (path->bounds[0] + tx) * sx;
+		path->bounds[1] = (path->bounds[1] + ty) * sy;
+		path->bounds[2] = (path->bounds[2] + tx) * sx;
+		path->bounds[3] = (path->bounds[3] + ty) * sy;
+		if (!path->scaled) {
+			for (i =0; i < path->npts; i++) {
+				pt = &path->pts[i*2];
+				pt[0] = (pt[0] + tx) * sx;
+				pt[1] = (pt[1] + ty) * sy;
 			}
+			path->scaled = 1;
 		}
+	}
 
-		if (shape->fill.type == NSVG_PAINT_LINEAR_GRADIENT || shape->fill.type == NSVG_PAINT_RADIAL_GRADIENT) {
-			nsvg__scaleGradient(shape->fill.gradient, tx,ty, sx,sy);
-			memcpy(t, shape->fill.gradient->xform, sizeof(float)*6);
-			nsvg__xformInverse(shape->fill.gradient->xform, t);
-		}
-		if (shape->stroke.type == NSVG_PAINT_LINEAR_GRADIENT || shape->stroke.type == NSVG_PAINT_RADIAL_GRADIENT) {
-			nsvg__scaleGradient(shape->stroke.gradient, tx,ty, sx,sy);
-			memcpy(t, shape->stroke.gradient->xform, sizeof(float)*6);
-			nsvg__xformInverse(shape->stroke.gradient->xform, t);
-		}
+	if (shape->fill.type == NSVG_PAINT_LINEAR_GRADIENT || shape->fill.type == NSVG_PAINT_RADIAL_GRADIENT) {
+		nsvg__scaleGradient(shape->fill.gradient, tx,ty, sx,sy);
+		memcpy(t, shape->fill.gradient->xform, sizeof(float)*6);
+		nsvg__xformInverse(shape->fill.gradient->xform, t);
+	}
+	if (shape->stroke.type == NSVG_PAINT_LINEAR_GRADIENT || shape->stroke.type == NSVG_PAINT_RADIAL_GRADIENT) {
+		nsvg__scaleGradient(shape->stroke.gradient, tx,ty, sx,sy);
+		memcpy(t, shape->stroke.gradient->xform, sizeof(float)*6);
+		nsvg__xformInverse(shape->stroke.gradient->xform, t);
+	}
 
-		if (!shape->strokeScaled)
-		{
-			shape->strokeWidth *= avgs;
-			shape->strokeDashOffset *= avgs;
-			for (i = 0; i < shape->strokeDashCount; i++)
-				shape->strokeDashArray[i] *= avgs;
-			shape->strokeScaled = 1;
-		}
+	if (!shape->strokeScaled)
+	{
+		shape->strokeWidth *= avgs;
+		shape->strokeDashOffset *= avgs;
+		for (i = 0; i < shape->strokeDashCount; i++)
+			shape->strokeDashArray[i] *= avgs;
+		shape->strokeScaled = 1;
+	}
+}
+
+static void nsvg__scaleToViewbox(NSVGimage* image)
+{
+	NSVGshapeNode* shapeNode;
+	float tx, ty, sx, sy;
+
+	nsvg__getViewboxTransform(image, &tx, &ty, &sx, &sy);
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		if (shapeNode->shape != NULL)
+			nsvg__scaleShapeToViewbox(shapeNode->shape, tx, ty, sx, sy);
 	}
 }
 
@@ -3938,34 +4251,43 @@ static void nsvg__createGradients(NSVGparser* p)
 {
 	NSVGshapeNode* shapeNode;
 	NSVGshape* shape;
+	NSVGid* ref;
 
 	for (shapeNode = p->image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
 		shape = shapeNode->shape;
 		if (shape == NULL) continue;
 
 		if (shape->fill.type == NSVG_PAINT_UNDEF) {
-			if ((shape->fillGradient != NULL) && (shape->fillGradient->id[0] != '\0')) {
+			ref = shape->fill.ref;
+			shape->fill.gradient = NULL;
+			if ((ref != NULL) && (ref->id[0] != '\0')) {
 				float inv[6], localBounds[4];
 				nsvg__xformInverse(inv, shape->xform);
 				nsvg__getLocalBounds(localBounds, shape, inv);
-				shape->fill.gradient = nsvg__createGradient(p, shape->fillGradient->id, localBounds, shape->xform, &shape->fill.type);
+				shape->fill.gradient = nsvg__createGradient(p, ref->id, localBounds, shape->xform, &shape->fill.type);
 			}
+			nsvg__freeId(p, ref);
 			if (shape->fill.type == NSVG_PAINT_UNDEF) {
 				shape->fill.type = NSVG_PAINT_NONE;
 			}
-			memcpy(&shape->orig.fill, &shape->fill, sizeof(shape->orig.fill));
+			if (shape->orig != NULL)
+				memcpy(&shape->orig->fill, &shape->fill, sizeof(shape->orig->fill));
 		}
 		if (shape->stroke.type == NSVG_PAINT_UNDEF) {
-			if ((shape->strokeGradient != NULL) && (shape->strokeGradient->id[0] != '\0')) {
+			ref = shape->stroke.ref;
+			shape->stroke.gradient = NULL;
+			if ((ref != NULL) && (ref->id[0] != '\0')) {
 				float inv[6], localBounds[4];
 				nsvg__xformInverse(inv, shape->xform);
 				nsvg__getLocalBounds(localBounds, shape, inv);
-				shape->stroke.gradient = nsvg__createGradient(p, shape->strokeGradient->id, localBounds, shape->xform, &shape->stroke.type);
+				shape->stroke.gradient = nsvg__createGradient(p, ref->id, localBounds, shape->xform, &shape->stroke.type);
 			}
+			nsvg__freeId(p, ref);
 			if (shape->stroke.type == NSVG_PAINT_UNDEF) {
 				shape->stroke.type = NSVG_PAINT_NONE;
 			}
-			memcpy(&shape->orig.stroke, &shape->stroke, sizeof(shape->orig.stroke));
+			if (shape->orig != NULL)
+				memcpy(&shape->orig->stroke, &shape->stroke, sizeof(shape->orig->stroke));
 		}
 	}
 }
@@ -3982,77 +4304,605 @@ static void nsvg__findShapeParents(NSVGparser* p)
 	}
 }
 
-NSVGimage* nsvgParse(char* input, const char* units, float dpi)
+static void nsvg__getAnimateWindow(NSVGanimate* animate, long* begin, long* end)
 {
-	NSVGparser* p;
-	NSVGimage* ret = 0;
-
-	p = nsvg__createParser();
-	if (p == NULL) {
-		return NULL;
-	}
-	p->image->dpi = dpi;
-	strncpy(p->image->units, units, 3);
+	// After its repeats or end time, an animation is either frozen or removed, and does not change anymore.
+	*begin = animate->begin;
+	*end = -1;
+	if (animate->repeatCount >= 0)
+		*end = animate->begin + animate->groupDur * animate->repeatCount;
+	if (animate->end > 0 && (*end < 0 || animate->end < *end))
+		*end = animate->end;
+}
 
-	nsvg__parseXML(input, nsvg__startElement, nsvg__endElement, nsvg__content, p);
+static int nsvg__cmpAnimateEvent(const void* p, const void* q)
+{
+	const NSVGanimateEvent* a = (const NSVGanimateEvent*)p;
+	const NSVGanimateEvent* b = (const NSVGanimateEvent*)q;
 
-	// Create gradients after all definitions have been parsed
-	nsvg__createGradients(p);
+	if (a->time < b->time) return -1;
+	if (a->time > b->time) return 1;
+	return 0;
+}
 
-	// Find the shape parents.
-	nsvg__findShapeParents(p);
+static float nsvg__evalSpline(float t, float p1, float p2)
+{
+	float it = 1.0f - t;
+	return 3.0f * it * it * t * p1 + 3.0f * it * t * t * p2 + t * t * t;
+}
 
-	// Scale to viewBox
-	nsvg__scaleToViewbox(p->image);
+// Returns the progression of the spline at x, bisecting the curve as its x increases with t.
+static float nsvg__solveSpline(float x, const float* spline)
+{
+	float t0 = 0.0f, t1 = 1.0f, t;
+	int i;
 
-	ret = p->image;
+	for (i = 0; i < 24; i++) {
+		t = (t0 + t1) * 0.5f;
+		if (nsvg__evalSpline(t, spline[0], spline[2]) < x)
+			t0 = t;
+		else
+			t1 = t;
+	}
+	return nsvg__evalSpline((t0 + t1) * 0.5f, spline[1], spline[3]);
+}
 
-	nsvg__deleteParser(p);
+// Returns the index of the table of the spline, or -1 if it has none.
+static int nsvg__findSplineTable(NSVGimage* image, const float* spline)
+{
+	int i;
 
-	return ret;
+	for (i = 0; i < image->nsplineTables; i++) {
+		if (memcmp(image->splineTables[i].spline, spline, sizeof(float)*4) == 0) return i;
+	}
+	return -1;
 }
 
-NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
+// Tabulates the distinct keySplines once, so updates interpolate the tables instead of solving the splines.
+// Animations without a table, if it cannot be allocated, solve their spline.
+static void nsvg__createSplineTables(NSVGimage* image)
 {
-	FILE* fp = NULL;
-	size_t size;
-	char* data = NULL;
-	NSVGimage* image = NULL;
+	NSVGshapeNode* shapeNode;
+	NSVGanimate* animate;
+	NSVGsplineTable* table;
+	float* splines;
+	float value;
+	int i, j, nsplines;
 
-	fp = fopen(filename, "rb");
-	if (!fp) goto error;
-	fseek(fp, 0, SEEK_END);
-	size = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	data = (char*)malloc(size+1);
-	if (data == NULL) goto error;
-	if (fread(data, 1, size, fp) != size) goto error;
-	data[size] = '\0';	// Must be null terminated.
-	fclose(fp);
-	image = nsvgParse(data, units, dpi);
-	free(data);
+	nsplines = 0;
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next) {
+			animate->splineTable = -1;
+			if (animate->calcMode == NSVG_ANIMATE_CALC_MODE_SPLINE) nsplines++;
+		}
+	}
+	if (nsplines == 0) return;
 
-	return image;
+	// Find the distinct splines first, so only their tables are allocated.
+	splines = (float*)malloc(sizeof(float)*4 * nsplines);
+	if (splines == NULL) return;
+	nsplines = 0;
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next) {
+			if (animate->calcMode != NSVG_ANIMATE_CALC_MODE_SPLINE) continue;
+			for (i = 0; i < nsplines && memcmp(&splines[i*4], animate->spline, sizeof(float)*4) != 0; i++);
+			if (i == nsplines) memcpy(&splines[nsplines++ * 4], animate->spline, sizeof(float)*4);
+		}
+	}
 
-error:
-	if (fp) fclose(fp);
-	if (data) free(data);
-	if (image) nsvgDelete(image);
-	return NULL;
+	image->splineTables = (NSVGsplineTable*)nsvg__malloc(image, sizeof(NSVGsplineTable) * nsplines);
+	if (image->splineTables == NULL) {
+		free(splines);
+		return;
+	}
+	image->nsplineTables = nsplines;
+	for (i = 0; i < nsplines; i++) {
+		table = &image->splineTables[i];
+		memcpy(table->spline, &splines[i*4], sizeof(table->spline));
+		for (j = 0; j <= NSVG_SPLINE_SEGMENTS; j++) {
+			value = nsvg__solveSpline((float)j / NSVG_SPLINE_SEGMENTS, table->spline);
+			value = nsvg__minf(nsvg__maxf(value, 0.0f), 1.0f);
+			table->values[j] = (unsigned short)(value * 65535.0f + 0.5f);
+		}
+	}
+	free(splines);
+
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next) {
+			if (animate->calcMode == NSVG_ANIMATE_CALC_MODE_SPLINE)
+				animate->splineTable = nsvg__findSplineTable(image, animate->spline);
+		}
+	}
 }
 
-NSVGpath* nsvgDuplicatePath(NSVGpath* p)
+static void nsvg__createAnimateSchedule(NSVGimage* image)
 {
-    NSVGpath* res = NULL;
+	NSVGshapeNode* shapeNode;
+	NSVGshapeNode* node;
+	NSVGanimatedNode* animNode;
+	NSVGanimate* animate;
+	long begin, end;
+	int i, nshapes;
 
-    if (p == NULL)
-        return NULL;
+	image->animateTime = LONG_MIN;
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		if (shapeNode->animates != NULL) image->nanimatedNodes++;
+	}
+	if (image->nanimatedNodes == 0) return;
+
+	image->animatedNodes = (NSVGanimatedNode*)nsvg__malloc(image, sizeof(NSVGanimatedNode) * image->nanimatedNodes);
+	image->events = (NSVGanimateEvent*)nsvg__malloc(image, sizeof(NSVGanimateEvent) * image->nanimatedNodes * 2);
+	image->liveNodes = (int*)nsvg__malloc(image, sizeof(int) * image->nanimatedNodes);
+	if (image->animatedNodes == NULL || image->events == NULL || image->liveNodes == NULL) goto error;
+	memset(image->animatedNodes, 0, sizeof(NSVGanimatedNode) * image->nanimatedNodes);
+
+	// Index the shapes affected by the animations of each node, their descendants follow them in the list.
+	nshapes = 0;
+	for (i = 0, shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		if (shapeNode->animates == NULL) continue;
+
+		animNode = &image->animatedNodes[i];
+		animNode->node = shapeNode;
+		for (node = shapeNode; node->next != NULL && node->next->shapeDepth > shapeNode->shapeDepth; node = node->next);
+		animNode->lastNode = node;
+
+		// The animations of the node do not change before the first begins, or after all have ended.
+		nsvg__getAnimateWindow(shapeNode->animates, &animNode->begin, &animNode->end);
+		for (animate = shapeNode->animates->next; animate != NULL; animate = animate->next) {
+			nsvg__getAnimateWindow(animate, &begin, &end);
+			animNode->begin = (begin < animNode->begin) ? begin : animNode->begin;
+			animNode->end = (animNode->end < 0 || end < 0) ? -1 : (end > animNode->end ? end : animNode->end);
+		}
+		image->events[image->nevents].time = animNode->begin;
+		image->events[image->nevents].node = i;
+		image->events[image->nevents].begin = 1;
+		image->nevents++;
+		if (animNode->end >= 0) {
+			image->events[image->nevents].time = animNode->end;
+			image->events[image->nevents].node = i;
+			image->events[image->nevents].begin = 0;
+			image->nevents++;
+		}
 
-    res = (NSVGpath*)malloc(sizeof(NSVGpath));
-    if (res == NULL) goto error;
-    memset(res, 0, sizeof(NSVGpath));
+		// Animations between equal values only change when they begin or end.
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next) {
+			if (animate->srcNa == animate->dstNa && memcmp(animate->src, animate->dst, sizeof(animate->src)) == 0)
+				animate->flags |= NSVG_ANIMATE_FLAG_CONSTANT;
+		}
 
-    res->pts = (float*)malloc(p->npts*2*sizeof(float));
+		// Count the affected shapes once, even if affected by several nodes.
+		for (node = shapeNode; ; node = node->next) {
+			if (node->shape != NULL && !(node->shape->flags & NSVG_FLAGS_CHANGED)) {
+				node->shape->flags |= NSVG_FLAGS_CHANGED;
+				nshapes++;
+			}
+			if (node == animNode->lastNode) break;
+		}
+		i++;
+	}
+	qsort(image->events, image->nevents, sizeof(NSVGanimateEvent), nsvg__cmpAnimateEvent);
+
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		if (shapeNode->shape != NULL) shapeNode->shape->flags &= ~NSVG_FLAGS_CHANGED;
+	}
+	image->changedNodes = (NSVGshapeNode**)nsvg__malloc(image, sizeof(NSVGshapeNode*) * nshapes);
+	if (image->changedNodes == NULL && nshapes > 0) goto error;
+	image->maxChangedNodes = nshapes;
+
+	nsvg__createSplineTables(image);
+	return;
+
+error:
+	// Animations are not run without the schedule.
+	nsvg__free(image, image->animatedNodes, sizeof(NSVGanimatedNode) * image->nanimatedNodes);
+	nsvg__free(image, image->events, sizeof(NSVGanimateEvent) * image->nanimatedNodes * 2);
+	nsvg__free(image, image->liveNodes, sizeof(int) * image->nanimatedNodes);
+	image->animatedNodes = NULL;
+	image->events = NULL;
+	image->liveNodes = NULL;
+	image->nanimatedNodes = 0;
+	image->nevents = 0;
+}
+
+static int nsvg__isGradientPaint(const NSVGpaint* paint)
+{
+	return paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT;
+}
+
+static int nsvg__gradientSize(const NSVGgradient* grad)
+{
+	return sizeof(NSVGgradient) + sizeof(NSVGgradientStop)*(grad->nstops-1);
+}
+
+// Returns whether the original paint shares the gradient of the paint, as set by the parser.
+static int nsvg__sharesGradient(const NSVGpaint* orig, const NSVGpaint* paint)
+{
+	return nsvg__isGradientPaint(paint) && orig->gradient == paint->gradient;
+}
+
+// Returns the size of an arena holding exactly the image, counted like nsvg__compactArena allocates it.
+static int nsvg__arenaImageSize(NSVGimage* image)
+{
+	NSVGshapeNode* shapeNode;
+	NSVGshape* shape;
+	NSVGpath* path;
+	NSVGanimate* animate;
+	int size = NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock)) + NSVG_ARENA_SIZE(sizeof(NSVGimage));
+
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		size += NSVG_ARENA_SIZE(sizeof(NSVGshapeNode));
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next)
+			size += NSVG_ARENA_SIZE(sizeof(NSVGanimate));
+		shape = shapeNode->shape;
+		if (shape == NULL) continue;
+
+		size += NSVG_ARENA_SIZE(sizeof(NSVGshape));
+		if (shape->id != NULL) size += NSVG_ARENA_SIZE(strlen(shape->id) + 1);
+		if (nsvg__isGradientPaint(&shape->fill))
+			size += NSVG_ARENA_SIZE(nsvg__gradientSize(shape->fill.gradient));
+		if (nsvg__isGradientPaint(&shape->stroke))
+			size += NSVG_ARENA_SIZE(nsvg__gradientSize(shape->stroke.gradient));
+		if (shape->orig != NULL) {
+			size += NSVG_ARENA_SIZE(sizeof(NSVGshapeOrig));
+			if (nsvg__isGradientPaint(&shape->orig->fill) && !nsvg__sharesGradient(&shape->orig->fill, &shape->fill))
+				size += NSVG_ARENA_SIZE(nsvg__gradientSize(shape->orig->fill.gradient));
+			if (nsvg__isGradientPaint(&shape->orig->stroke) && !nsvg__sharesGradient(&shape->orig->stroke, &shape->stroke))
+				size += NSVG_ARENA_SIZE(nsvg__gradientSize(shape->orig->stroke.gradient));
+		}
+
+		for (path = shape->paths; path != NULL; path = path->next) {
+			size += NSVG_ARENA_SIZE(sizeof(NSVGpath));
+			if (path->pts != NULL && !path->inPlace) size += NSVG_ARENA_SIZE(path->npts*2*sizeof(float));
+			if (path->orig != NULL) size += NSVG_ARENA_SIZE(nsvg__pathOrigSize(path->npts));
+		}
+	}
+
+	if (image->animatedNodes != NULL) {
+		size += NSVG_ARENA_SIZE(sizeof(NSVGanimatedNode) * image->nanimatedNodes);
+		size += NSVG_ARENA_SIZE(sizeof(NSVGanimateEvent) * image->nanimatedNodes * 2);
+		size += NSVG_ARENA_SIZE(sizeof(int) * image->nanimatedNodes);
+	}
+	if (image->changedNodes != NULL)
+		size += NSVG_ARENA_SIZE(sizeof(NSVGshapeNode*) * image->maxChangedNodes);
+	if (image->splineTables != NULL)
+		size += NSVG_ARENA_SIZE(sizeof(NSVGsplineTable) * image->nsplineTables);
+
+	return size;
+}
+
+static void* nsvg__arenaCopy(NSVGimage* image, const void* ptr, int size)
+{
+	void* copy;
+
+	if (ptr == NULL) return NULL;
+	copy = nsvg__malloc(image, size);
+	if (copy != NULL) memcpy(copy, ptr, size);
+	return copy;
+}
+
+static NSVGshape* nsvg__copyArenaShape(NSVGimage* image, NSVGshape* shape)
+{
+	NSVGshape* copy = (NSVGshape*)nsvg__arenaCopy(image, shape, sizeof(NSVGshape));
+	NSVGpath *path, *pathCopy, *tail = NULL;
+
+	if (shape->id != NULL)
+		copy->id = (char*)nsvg__arenaCopy(image, shape->id, (int)strlen(shape->id) + 1);
+	if (nsvg__isGradientPaint(&shape->fill))
+		copy->fill.gradient = (NSVGgradient*)nsvg__arenaCopy(image, shape->fill.gradient, nsvg__gradientSize(shape->fill.gradient));
+	if (nsvg__isGradientPaint(&shape->stroke))
+		copy->stroke.gradient = (NSVGgradient*)nsvg__arenaCopy(image, shape->stroke.gradient, nsvg__gradientSize(shape->stroke.gradient));
+	if (shape->orig != NULL) {
+		copy->orig = (NSVGshapeOrig*)nsvg__arenaCopy(image, shape->orig, sizeof(NSVGshapeOrig));
+		if (nsvg__isGradientPaint(&shape->orig->fill)) {
+			copy->orig->fill.gradient = nsvg__sharesGradient(&shape->orig->fill, &shape->fill) ? copy->fill.gradient :
+				(NSVGgradient*)nsvg__arenaCopy(image, shape->orig->fill.gradient, nsvg__gradientSize(shape->orig->fill.gradient));
+		}
+		if (nsvg__isGradientPaint(&shape->orig->stroke)) {
+			copy->orig->stroke.gradient = nsvg__sharesGradient(&shape->orig->stroke, &shape->stroke) ? copy->stroke.gradient :
+				(NSVGgradient*)nsvg__arenaCopy(image, shape->orig->stroke.gradient, nsvg__gradientSize(shape->orig->stroke.gradient));
+		}
+	}
+
+	copy->paths = NULL;
+	for (path = shape->paths; path != NULL; path = path->next) {
+		pathCopy = (NSVGpath*)nsvg__arenaCopy(image, path, sizeof(NSVGpath));
+		if (!path->inPlace)
+			pathCopy->pts = (float*)nsvg__arenaCopy(image, path->pts, path->npts*2*sizeof(float));
+		if (path->orig != NULL) {
+			pathCopy->orig = (NSVGpathOrig*)nsvg__arenaCopy(image, path->orig, nsvg__pathOrigSize(path->npts));
+			pathCopy->orig->pts = (float*)(pathCopy->orig + 1);
+		}
+		pathCopy->next = NULL;
+		if (tail != NULL)
+			tail->next = pathCopy;
+		else
+			copy->paths = pathCopy;
+		tail = pathCopy;
+	}
+
+	return copy;
+}
+
+// Copies an image in blocks on the heap into a single block of the exact size, and deletes the blocks.
+// Returns the image unchanged if the block cannot be allocated.
+static NSVGimage* nsvg__compactArena(NSVGimage* image)
+{
+	NSVGarenaBlock* block;
+	NSVGimage* copy;
+	NSVGshapeNode *shapeNode, *node, *prev = NULL;
+	NSVGanimate *animate, *animateCopy;
+	int size, i;
+
+	size = nsvg__arenaImageSize(image);
+	block = (NSVGarenaBlock*)malloc(size);
+	if (block == NULL) return image;
+	block->next = NULL;
+	block->size = size;
+	block->used = NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock));
+	block->external = 0;
+
+	copy = (NSVGimage*)((char*)block + block->used);
+	block->used += NSVG_ARENA_SIZE(sizeof(NSVGimage));
+	memcpy(copy, image, sizeof(NSVGimage));
+	copy->arena = block;
+	copy->shapes = NULL;
+
+	// Nodes are copied in order, and the old nodes point to their copies with prev, so parents and
+	// the nodes of the schedule are found.
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		node = (NSVGshapeNode*)nsvg__arenaCopy(copy, shapeNode, sizeof(NSVGshapeNode));
+		node->prev = prev;
+		node->next = NULL;
+		node->parent = (shapeNode->parent != NULL) ? shapeNode->parent->prev : NULL;
+		if (prev != NULL)
+			prev->next = node;
+		else
+			copy->shapes = node;
+
+		node->animates = NULL;
+		node->animatesTail = NULL;
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next) {
+			animateCopy = (NSVGanimate*)nsvg__arenaCopy(copy, animate, sizeof(NSVGanimate));
+			animateCopy->next = NULL;
+			if (node->animatesTail != NULL)
+				node->animatesTail->next = animateCopy;
+			else
+				node->animates = animateCopy;
+			node->animatesTail = animateCopy;
+		}
+		if (shapeNode->shape != NULL)
+			node->shape = nsvg__copyArenaShape(copy, shapeNode->shape);
+
+		shapeNode->prev = node;
+		prev = node;
+	}
+
+	if (image->animatedNodes != NULL) {
+		copy->animatedNodes = (NSVGanimatedNode*)nsvg__arenaCopy(copy, image->animatedNodes, sizeof(NSVGanimatedNode) * image->nanimatedNodes);
+		copy->events = (NSVGanimateEvent*)nsvg__arenaCopy(copy, image->events, sizeof(NSVGanimateEvent) * image->nanimatedNodes * 2);
+		copy->liveNodes = (int*)nsvg__arenaCopy(copy, image->liveNodes, sizeof(int) * image->nanimatedNodes);
+		for (i = 0; i < image->nanimatedNodes; i++) {
+			copy->animatedNodes[i].node = image->animatedNodes[i].node->prev;
+			copy->animatedNodes[i].lastNode = image->animatedNodes[i].lastNode->prev;
+		}
+	}
+	if (image->changedNodes != NULL) {
+		copy->changedNodes = (NSVGshapeNode**)nsvg__arenaCopy(copy, image->changedNodes, sizeof(NSVGshapeNode*) * image->maxChangedNodes);
+		for (i = 0; i < image->nchangedNodes; i++)
+			copy->changedNodes[i] = image->changedNodes[i]->prev;
+	}
+	if (image->splineTables != NULL)
+		copy->splineTables = (NSVGsplineTable*)nsvg__arenaCopy(copy, image->splineTables, sizeof(NSVGsplineTable) * image->nsplineTables);
+
+	nsvg__deleteArena(image->arena);
+
+	return copy;
+}
+
+// Ends allocating an image in its arena, compacting blocks on the heap into one block of the exact size.
+// Returns NULL and deletes the image if an allocation did not fit.
+static NSVGimage* nsvg__finishArena(NSVGimage* image)
+{
+	NSVGarenaBlock* block;
+
+	if (image == NULL || image->arena == NULL) return image;
+	if (image->arenaFull) {
+		nsvgDelete(image);
+		return NULL;
+	}
+
+	// Memory of the user is not compacted, so it needs the memory freed while parsing too (but not the rests of blocks).
+	image->arenaMemorySize = NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock));
+	for (block = image->arena; block != NULL; block = block->next)
+		image->arenaMemorySize += block->used - NSVG_ARENA_SIZE(sizeof(NSVGarenaBlock));
+
+	if (!image->arena->external)
+		image = nsvg__compactArena(image);
+
+	// The image uses all of its arena.
+	image->memorySize = 0;
+	for (block = image->arena; block != NULL; block = block->next)
+		image->memorySize += block->used;
+
+	return image;
+}
+
+NSVGparser* nsvgParseBegin(const char* units, float dpi)
+{
+	NSVGparser* p;
+
+	p = nsvg__createParser();
+	if (p == NULL) {
+		return NULL;
+	}
+	p->image->dpi = dpi;
+	strncpy(p->image->units, units, 3);
+
+	p->xml.state = NSVG_XML_CONTENT;
+	p->xml.startelCb = nsvg__startElement;
+	p->xml.endelCb = nsvg__endElement;
+	p->xml.contentCb = nsvg__content;
+	p->xml.userData = p;
+
+	return p;
+}
+
+int nsvgParseFeed(NSVGparser* p, const char* chunk, int len)
+{
+	if (p == NULL) return 0;
+	return nsvg__parseXMLChunk(&p->xml, chunk, len);
+}
+
+// Returns whether a node is affected by animations, of its own or of its ancestors.
+static int nsvg__isNodeAnimated(NSVGshapeNode* shapeNode)
+{
+	for (; shapeNode != NULL; shapeNode = shapeNode->parent) {
+		if (shapeNode->animates != NULL) return 1;
+	}
+	return 0;
+}
+
+// Frees the original values of shapes that are not animated, they are only used to reset animations.
+static void nsvg__freeStaticOrig(NSVGimage* image)
+{
+	NSVGshapeNode* shapeNode;
+	NSVGshape* shape;
+	NSVGpath* path;
+
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		shape = shapeNode->shape;
+		if (shape == NULL || nsvg__isNodeAnimated(shapeNode)) continue;
+		nsvg__free(image, shape->orig, sizeof(NSVGshapeOrig));
+		shape->orig = NULL;
+		for (path = shape->paths; path != NULL; path = path->next) {
+			nsvg__free(image, path->orig, nsvg__pathOrigSize(path->npts));
+			path->orig = NULL;
+		}
+	}
+}
+
+NSVGimage* nsvgParseEnd(NSVGparser* p)
+{
+	NSVGimage* ret = 0;
+
+	if (p == NULL) return NULL;
+
+	// An image missing elements that did not fit in memory is not returned.
+	if (p->xml.error) {
+		ret = p->image;
+		nsvg__deleteParser(p);
+		nsvgDelete(ret);
+		return NULL;
+	}
+
+	// Create gradients after all definitions have been parsed
+	nsvg__createGradients(p);
+
+	// Find the shape parents.
+	nsvg__findShapeParents(p);
+
+	// Scale to viewBox
+	nsvg__scaleToViewbox(p->image);
+
+	// Keep the original values only for animated shapes.
+	nsvg__freeStaticOrig(p->image);
+
+	// Find the shapes affected by animations, and when they are animated.
+	nsvg__createAnimateSchedule(p->image);
+
+	ret = p->image;
+
+	nsvg__deleteParser(p);
+
+	return nsvg__finishArena(ret);
+}
+
+NSVGparser* nsvgParseBeginArena(const char* units, float dpi, void* memory, int size)
+{
+	NSVGparser* p;
+	NSVGimage* image;
+	NSVGarenaBlock* arena;
+
+	p = nsvgParseBegin(units, dpi);
+	if (p == NULL) {
+		return NULL;
+	}
+
+	// Nothing is allocated by the image yet, so it is moved to the arena.
+	image = nsvg__createArenaImage(memory, size);
+	if (image == NULL) {
+		free(p->image);
+		nsvg__deleteParser(p);
+		return NULL;
+	}
+	arena = image->arena;
+	memcpy(image, p->image, sizeof(NSVGimage));
+	image->arena = arena;
+	free(p->image);
+	p->image = image;
+
+	return p;
+}
+
+NSVGimage* nsvgParse(const char* input, const char* units, float dpi)
+{
+	NSVGparser* p;
+
+	p = nsvgParseBegin(units, dpi);
+	if (p == NULL) {
+		return NULL;
+	}
+	nsvgParseFeed(p, input, (int)strlen(input));
+
+	return nsvgParseEnd(p);
+}
+
+// Size of the chunks read from files.
+#define NSVG_FILE_CHUNK_SIZE 1024
+
+NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
+{
+	FILE* fp = NULL;
+	size_t size;
+	char* data = NULL;
+	NSVGparser* p = NULL;
+
+	fp = fopen(filename, "rb");
+	if (!fp) goto error;
+	data = (char*)malloc(NSVG_FILE_CHUNK_SIZE);
+	if (data == NULL) goto error;
+	p = nsvgParseBegin(units, dpi);
+	if (p == NULL) goto error;
+
+	// The file is parsed in chunks, without reading it whole.
+	while ((size = fread(data, 1, NSVG_FILE_CHUNK_SIZE, fp)) > 0) {
+		if (!nsvgParseFeed(p, data, (int)size)) break;
+	}
+	if (ferror(fp)) goto error;
+	fclose(fp);
+	free(data);
+
+	return nsvgParseEnd(p);
+
+error:
+	if (fp) fclose(fp);
+	if (data) free(data);
+	if (p) nsvgDelete(nsvgParseEnd(p));
+	return NULL;
+}
+
+NSVGpath* nsvgDuplicatePath(NSVGpath* p)
+{
+    NSVGpath* res = NULL;
+
+    if (p == NULL)
+        return NULL;
+
+    res = (NSVGpath*)malloc(sizeof(NSVGpath));
+    if (res == NULL) goto error;
+    memset(res, 0, sizeof(NSVGpath));
+
+    res->pts = (float*)malloc(p->npts*2*sizeof(float));
     if (res->pts == NULL) goto error;
     memcpy(res->pts, p->pts, p->npts * sizeof(float) * 2);
     res->npts = p->npts;
@@ -4076,6 +4926,11 @@ void nsvgDelete(NSVGimage* image)
 	NSVGshapeNode *next, *shapeNode;
 	NSVGshape *shape;
 	if (image == NULL) return;
+	// The image is allocated in its arena.
+	if (image->arena != NULL) {
+		nsvg__deleteArena(image->arena);
+		return;
+	}
 	shapeNode = image->shapes;
 	while (shapeNode != NULL) {
 		next = shapeNode->next;
@@ -4084,9 +4939,8 @@ void nsvgDelete(NSVGimage* image)
 			nsvg__deletePaths(image, shape->paths);
 			nsvg__deletePaint(image, &shape->fill);
 			nsvg__deletePaint(image, &shape->stroke);
-			nsvg__free(image, shape->id, sizeof(NSVGid));
-			nsvg__free(image, shape->fillGradient, sizeof(NSVGid));
-			nsvg__free(image, shape->strokeGradient, sizeof(NSVGid));
+			if (shape->id != NULL) nsvg__free(image, shape->id, (int)strlen(shape->id) + 1);
+			nsvg__free(image, shape->orig, sizeof(NSVGshapeOrig));
 			nsvg__free(image, shape, sizeof(NSVGshape));
 		}
 		while (shapeNode->animates != NULL) {
@@ -4097,31 +4951,620 @@ void nsvgDelete(NSVGimage* image)
 		nsvg__free(image, shapeNode, sizeof(NSVGshapeNode));
 		shapeNode = next;
 	}
+	nsvg__free(image, image->animatedNodes, sizeof(NSVGanimatedNode) * image->nanimatedNodes);
+	nsvg__free(image, image->events, sizeof(NSVGanimateEvent) * image->nanimatedNodes * 2);
+	nsvg__free(image, image->liveNodes, sizeof(int) * image->nanimatedNodes);
+	nsvg__free(image, image->changedNodes, sizeof(NSVGshapeNode*) * image->maxChangedNodes);
+	nsvg__free(image, image->splineTables, sizeof(NSVGsplineTable) * image->nsplineTables);
 	free(image);
 }
 
-void nsvg__animateApplyTransform(float* xform, float* args, int na, char type, char additive)
+// Binary images are a sequence of little endian 32 bit values, starting with a header of magic, version and size.
+// Shape nodes follow in order, each with its shape and animations, all references are either implied or indices.
+#define NSVG_BINARY_MAGIC	0x4256534e	// "NSVB"
+#define NSVG_BINARY_VERSION	2
+
+typedef struct NSVGbinaryWriter {
+	unsigned char* data;
+	int size;
+	int pos;
+} NSVGbinaryWriter;
+
+typedef struct NSVGbinaryReader {
+	const unsigned char* data;
+	int size;
+	int pos;
+	int error;
+	int inPlace;		// Points can be read in place.
+} NSVGbinaryReader;
+
+static void nsvg__writeInt(NSVGbinaryWriter* w, int v)
+{
+	unsigned int u = (unsigned int)v;
+	if (w->data != NULL && w->pos + 4 <= w->size) {
+		w->data[w->pos+0] = (unsigned char)(u);
+		w->data[w->pos+1] = (unsigned char)(u >> 8);
+		w->data[w->pos+2] = (unsigned char)(u >> 16);
+		w->data[w->pos+3] = (unsigned char)(u >> 24);
+	}
+	w->pos += 4;
+}
+
+static void nsvg__writeFloats(NSVGbinaryWriter* w, const float* v, int n)
+{
+	unsigned int u;
+	int i;
+	for (i = 0; i < n; i++) {
+		memcpy(&u, &v[i], 4);
+		nsvg__writeInt(w, (int)u);
+	}
+}
+
+static void nsvg__writeId(NSVGbinaryWriter* w, const char* id)
+{
+	int i, len = (id != NULL) ? (int)strlen(id) : -1;
+
+	// Strings are written with their length, or -1 for no id, padded to 4 bytes.
+	nsvg__writeInt(w, len);
+	for (i = 0; i < len; i += 4) {
+		unsigned int u = 0;
+		memcpy(&u, &id[i], (len - i < 4) ? len - i : 4);
+		nsvg__writeInt(w, (int)u);
+	}
+}
+
+static void nsvg__writePaint(NSVGbinaryWriter* w, const NSVGpaint* paint)
+{
+	const NSVGgradient* grad;
+	int i;
+
+	nsvg__writeInt(w, paint->type);
+	if (paint->type == NSVG_PAINT_COLOR) {
+		nsvg__writeInt(w, (int)paint->color);
+	} else if (paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT) {
+		grad = paint->gradient;
+		nsvg__writeFloats(w, grad->xform, 6);
+		nsvg__writeFloats(w, grad->orig.xform, 6);
+		nsvg__writeInt(w, grad->spread);
+		nsvg__writeFloats(w, &grad->fx, 1);
+		nsvg__writeFloats(w, &grad->fy, 1);
+		nsvg__writeInt(w, grad->nstops);
+		for (i = 0; i < grad->nstops; i++) {
+			nsvg__writeInt(w, (int)grad->stops[i].color);
+			nsvg__writeFloats(w, &grad->stops[i].offset, 1);
+		}
+	}
+}
+
+static void nsvg__writeShape(NSVGbinaryWriter* w, const NSVGshape* shape)
+{
+	const NSVGpath* path;
+	int npaths = 0, hasOrig = shape->orig != NULL;
+
+	nsvg__writeId(w, shape->id);
+	nsvg__writePaint(w, &shape->fill);
+	nsvg__writePaint(w, &shape->stroke);
+	nsvg__writeFloats(w, &shape->opacity, 1);
+	nsvg__writeFloats(w, &shape->strokeWidth, 1);
+	nsvg__writeFloats(w, &shape->strokeDashOffset, 1);
+	nsvg__writeFloats(w, shape->strokeDashArray, 8);
+	nsvg__writeInt(w, shape->strokeDashCount);
+	nsvg__writeInt(w, shape->strokeLineJoin);
+	nsvg__writeInt(w, shape->strokeLineCap);
+	nsvg__writeFloats(w, &shape->miterLimit, 1);
+	nsvg__writeInt(w, shape->fillRule);
+	nsvg__writeInt(w, shape->flags);
+	nsvg__writeFloats(w, shape->bounds, 4);
+	nsvg__writeFloats(w, shape->xform, 6);
+	nsvg__writeInt(w, shape->strokeScaled);
+
+	// Original values are only written for animated shapes.
+	// The original paints share the gradients of the paints, only their types and colors are written.
+	nsvg__writeInt(w, hasOrig);
+	if (hasOrig) {
+		nsvg__writeFloats(w, &shape->orig->opacity, 1);
+		nsvg__writeFloats(w, shape->orig->xform, 6);
+		nsvg__writeInt(w, shape->orig->fill.type);
+		nsvg__writeInt(w, (shape->orig->fill.type == NSVG_PAINT_COLOR) ? (int)shape->orig->fill.color : 0);
+		nsvg__writeInt(w, shape->orig->stroke.type);
+		nsvg__writeInt(w, (shape->orig->stroke.type == NSVG_PAINT_COLOR) ? (int)shape->orig->stroke.color : 0);
+		nsvg__writeFloats(w, &shape->orig->strokeWidth, 1);
+		nsvg__writeFloats(w, &shape->orig->strokeDashOffset, 1);
+		nsvg__writeFloats(w, shape->orig->strokeDashArray, 8);
+		nsvg__writeInt(w, shape->orig->strokeDashCount);
+	}
+
+	for (path = shape->paths; path != NULL; path = path->next) npaths++;
+	nsvg__writeInt(w, npaths);
+	for (path = shape->paths; path != NULL; path = path->next) {
+		nsvg__writeInt(w, path->npts);
+		nsvg__writeInt(w, path->closed);
+		nsvg__writeInt(w, path->scaled);
+		nsvg__writeFloats(w, path->xform, 6);
+		nsvg__writeFloats(w, path->bounds, 4);
+		nsvg__writeFloats(w, path->pts, path->npts*2);
+		if (hasOrig) {
+			nsvg__writeFloats(w, path->orig->xform, 6);
+			nsvg__writeFloats(w, path->orig->pts, path->npts*2);
+		}
+	}
+}
+
+static void nsvg__writeAnimate(NSVGbinaryWriter* w, const NSVGanimate* animate)
 {
-	float xform2[6];
+	nsvg__writeInt(w, (int)animate->begin);
+	nsvg__writeInt(w, (int)animate->end);
+	nsvg__writeInt(w, (int)animate->dur);
+	nsvg__writeInt(w, (int)animate->groupDur);
+	nsvg__writeInt(w, animate->repeatCount);
+	nsvg__writeFloats(w, animate->src, 10);
+	nsvg__writeFloats(w, animate->dst, 10);
+	nsvg__writeFloats(w, animate->spline, 4);
+	nsvg__writeInt(w, animate->srcNa);
+	nsvg__writeInt(w, animate->dstNa);
+	nsvg__writeInt(w, animate->type);
+	nsvg__writeInt(w, animate->calcMode);
+	nsvg__writeInt(w, animate->additive);
+	nsvg__writeInt(w, animate->fill);
+	nsvg__writeInt(w, animate->flags);
+}
+
+int nsvgSerialize(NSVGimage* image, unsigned char* data, int size)
+{
+	NSVGbinaryWriter w;
+	NSVGshapeNode *shapeNode, *node;
+	NSVGanimate* animate;
+	unsigned int units = 0;
+	int nnodes = 0, nanimates, parent;
+
+	if (image == NULL) return 0;
+	w.data = data;
+	w.size = size;
+	w.pos = 0;
+
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) nnodes++;
+
+	nsvg__writeInt(&w, NSVG_BINARY_MAGIC);
+	nsvg__writeInt(&w, NSVG_BINARY_VERSION);
+	nsvg__writeInt(&w, 0);	// Size, written last.
+	nsvg__writeInt(&w, nnodes);
+
+	nsvg__writeFloats(&w, &image->width, 1);
+	nsvg__writeFloats(&w, &image->height, 1);
+	nsvg__writeFloats(&w, &image->viewMinx, 1);
+	nsvg__writeFloats(&w, &image->viewMiny, 1);
+	nsvg__writeFloats(&w, &image->viewWidth, 1);
+	nsvg__writeFloats(&w, &image->viewHeight, 1);
+	nsvg__writeFloats(&w, &image->fontSize, 1);
+	nsvg__writeFloats(&w, &image->dpi, 1);
+	nsvg__writeInt(&w, image->alignX);
+	nsvg__writeInt(&w, image->alignY);
+	nsvg__writeInt(&w, image->alignType);
+	memcpy(&units, image->units, 3);
+	nsvg__writeInt(&w, (int)units);
+	nsvg__writeFloats(&w, image->viewXform, 6);
+
+	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		// Parents are written as the index of their node.
+		parent = -1;
+		if (shapeNode->parent != NULL) {
+			parent = 0;
+			for (node = image->shapes; node != shapeNode->parent; node = node->next) parent++;
+		}
+		nanimates = 0;
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next) nanimates++;
+
+		nsvg__writeInt(&w, shapeNode->shapeDepth);
+		nsvg__writeInt(&w, parent);
+		nsvg__writeInt(&w, shapeNode->shape != NULL);
+		nsvg__writeInt(&w, nanimates);
+		if (shapeNode->shape != NULL)
+			nsvg__writeShape(&w, shapeNode->shape);
+		for (animate = shapeNode->animates; animate != NULL; animate = animate->next)
+			nsvg__writeAnimate(&w, animate);
+	}
+
+	if (data != NULL && w.pos <= size) {
+		size = w.pos;
+		w.pos = 8;
+		nsvg__writeInt(&w, size);
+		w.pos = size;
+	}
+
+	return w.pos;
+}
+
+static int nsvg__readInt(NSVGbinaryReader* r)
+{
+	const unsigned char* d = &r->data[r->pos];
+	if (r->pos + 4 > r->size) {
+		r->error = 1;
+		return 0;
+	}
+	r->pos += 4;
+	return (int)((unsigned int)d[0] | ((unsigned int)d[1] << 8) | ((unsigned int)d[2] << 16) | ((unsigned int)d[3] << 24));
+}
+
+static void nsvg__readFloats(NSVGbinaryReader* r, float* v, int n)
+{
+	unsigned int u;
+	int i;
+	for (i = 0; i < n; i++) {
+		u = (unsigned int)nsvg__readInt(r);
+		memcpy(&v[i], &u, 4);
+	}
+}
+
+static float nsvg__readFloat(NSVGbinaryReader* r)
+{
+	float v;
+	nsvg__readFloats(r, &v, 1);
+	return v;
+}
+
+static char* nsvg__readId(NSVGimage* image, NSVGbinaryReader* r)
+{
+	char* id;
+	int len = nsvg__readInt(r);
+
+	if (len < 0) return NULL;
+	if (len >= (int)sizeof(((NSVGid*)0)->id) || r->pos + len > r->size) {
+		r->error = 1;
+		return NULL;
+	}
+	id = (char*)nsvg__malloc(image, len + 1);
+	if (id == NULL) {
+		r->error = 1;
+		return NULL;
+	}
+	memcpy(id, &r->data[r->pos], len);
+	id[len] = '\0';
+	r->pos += (len + 3) & ~3;
+	return id;
+}
+
+static void nsvg__readPaint(NSVGimage* image, NSVGbinaryReader* r, NSVGpaint* paint)
+{
+	NSVGgradient* grad;
+	float xform[6], origXform[6], fx, fy;
+	int type, spread, nstops, i;
+
+	// The paint has no gradient to delete until it is read completely.
+	type = nsvg__readInt(r);
+	paint->type = NSVG_PAINT_NONE;
+	if (type == NSVG_PAINT_COLOR) {
+		paint->color = (unsigned int)nsvg__readInt(r);
+	} else if (type == NSVG_PAINT_LINEAR_GRADIENT || type == NSVG_PAINT_RADIAL_GRADIENT) {
+		nsvg__readFloats(r, xform, 6);
+		nsvg__readFloats(r, origXform, 6);
+		spread = nsvg__readInt(r);
+		fx = nsvg__readFloat(r);
+		fy = nsvg__readFloat(r);
+		nstops = nsvg__readInt(r);
+		if (r->error || nstops < 1 || nstops > (r->size - r->pos) / 8) {
+			r->error = 1;
+			return;
+		}
+
+		grad = (NSVGgradient*)nsvg__malloc(image, sizeof(NSVGgradient) + sizeof(NSVGgradientStop)*(nstops-1));
+		if (grad == NULL) {
+			r->error = 1;
+			return;
+		}
+		memcpy(grad->xform, xform, sizeof(xform));
+		memcpy(grad->orig.xform, origXform, sizeof(origXform));
+		grad->spread = (char)spread;
+		grad->fx = fx;
+		grad->fy = fy;
+		grad->nstops = nstops;
+		for (i = 0; i < nstops; i++) {
+			grad->stops[i].color = (unsigned int)nsvg__readInt(r);
+			grad->stops[i].offset = nsvg__readFloat(r);
+		}
+		paint->gradient = grad;
+	}
+	paint->type = (signed char)type;
+}
+
+static void nsvg__readOrigPaint(NSVGbinaryReader* r, NSVGpaint* orig, const NSVGpaint* paint)
+{
+	int type = nsvg__readInt(r);
+	unsigned int color = (unsigned int)nsvg__readInt(r);
+
+	if (type == NSVG_PAINT_LINEAR_GRADIENT || type == NSVG_PAINT_RADIAL_GRADIENT) {
+		memcpy(orig, paint, sizeof(NSVGpaint));
+		if (paint->type != type) r->error = 1;
+	} else {
+		orig->type = (signed char)type;
+		orig->color = color;
+	}
+}
+
+static float* nsvg__readPoints(NSVGimage* image, NSVGbinaryReader* r, int npts, int inPlace)
+{
+	float* pts;
+
+	if (npts == 0) return NULL;
+	if (inPlace) {
+		// The points are never written, unless the shape is animated.
+		pts = (float*)&r->data[r->pos];
+		r->pos += npts*2*sizeof(float);
+		return pts;
+	}
+	pts = (float*)nsvg__malloc(image, npts*2*sizeof(float));
+	if (pts == NULL) {
+		r->error = 1;
+		return NULL;
+	}
+	nsvg__readFloats(r, pts, npts*2);
+	return pts;
+}
+
+static void nsvg__readShape(NSVGimage* image, NSVGbinaryReader* r, NSVGshape* shape)
+{
+	NSVGpath *path, *tail = NULL;
+	int npaths, hasOrig, i;
+
+	shape->id = nsvg__readId(image, r);
+	nsvg__readPaint(image, r, &shape->fill);
+	nsvg__readPaint(image, r, &shape->stroke);
+	shape->opacity = nsvg__readFloat(r);
+	shape->strokeWidth = nsvg__readFloat(r);
+	shape->strokeDashOffset = nsvg__readFloat(r);
+	nsvg__readFloats(r, shape->strokeDashArray, 8);
+	shape->strokeDashCount = (char)nsvg__readInt(r);
+	shape->strokeLineJoin = (char)nsvg__readInt(r);
+	shape->strokeLineCap = (char)nsvg__readInt(r);
+	shape->miterLimit = nsvg__readFloat(r);
+	shape->fillRule = (char)nsvg__readInt(r);
+	shape->flags = (unsigned char)nsvg__readInt(r);
+	nsvg__readFloats(r, shape->bounds, 4);
+	nsvg__readFloats(r, shape->xform, 6);
+	shape->strokeScaled = (char)nsvg__readInt(r);
+	if (shape->strokeDashCount < 0 || shape->strokeDashCount > 8)
+		r->error = 1;
+
+	// Only animated shapes have original values.
+	hasOrig = nsvg__readInt(r);
+	if (hasOrig && !r->error) {
+		shape->orig = (NSVGshapeOrig*)nsvg__malloc(image, sizeof(NSVGshapeOrig));
+		if (shape->orig == NULL) {
+			r->error = 1;
+			return;
+		}
+		memset(shape->orig, 0, sizeof(NSVGshapeOrig));
+		shape->orig->opacity = nsvg__readFloat(r);
+		nsvg__readFloats(r, shape->orig->xform, 6);
+		nsvg__readOrigPaint(r, &shape->orig->fill, &shape->fill);
+		nsvg__readOrigPaint(r, &shape->orig->stroke, &shape->stroke);
+		shape->orig->strokeWidth = nsvg__readFloat(r);
+		shape->orig->strokeDashOffset = nsvg__readFloat(r);
+		nsvg__readFloats(r, shape->orig->strokeDashArray, 8);
+		shape->orig->strokeDashCount = (char)nsvg__readInt(r);
+		if (shape->orig->strokeDashCount < 0 || shape->orig->strokeDashCount > 8)
+			r->error = 1;
+	}
+
+	npaths = nsvg__readInt(r);
+	for (i = 0; i < npaths && !r->error; i++) {
+		path = (NSVGpath*)nsvg__malloc(image, sizeof(NSVGpath));
+		if (path == NULL) {
+			r->error = 1;
+			return;
+		}
+		memset(path, 0, sizeof(NSVGpath));
+		if (tail != NULL)
+			tail->next = path;
+		else
+			shape->paths = path;
+		tail = path;
+
+		path->npts = nsvg__readInt(r);
+		path->closed = (char)nsvg__readInt(r);
+		path->scaled = (char)nsvg__readInt(r);
+		nsvg__readFloats(r, path->xform, 6);
+		nsvg__readFloats(r, path->bounds, 4);
+		if (r->error || path->npts < 0 || path->npts > (r->size - r->pos) / 8) {
+			path->npts = 0;
+			r->error = 1;
+			return;
+		}
+		// Paths without original points are not animated.
+		path->inPlace = (char)(r->inPlace && !hasOrig && path->npts > 0);
+		path->pts = nsvg__readPoints(image, r, path->npts, path->inPlace);
+		if (hasOrig && !r->error) {
+			path->orig = (NSVGpathOrig*)nsvg__malloc(image, nsvg__pathOrigSize(path->npts));
+			if (path->orig == NULL) {
+				r->error = 1;
+				return;
+			}
+			path->orig->pts = (float*)(path->orig + 1);
+			nsvg__readFloats(r, path->orig->xform, 6);
+			nsvg__readFloats(r, path->orig->pts, path->npts*2);
+		}
+	}
+}
+
+static void nsvg__readAnimate(NSVGbinaryReader* r, NSVGanimate* animate)
+{
+	animate->begin = nsvg__readInt(r);
+	animate->end = nsvg__readInt(r);
+	animate->dur = nsvg__readInt(r);
+	animate->groupDur = nsvg__readInt(r);
+	animate->repeatCount = nsvg__readInt(r);
+	nsvg__readFloats(r, animate->src, 10);
+	nsvg__readFloats(r, animate->dst, 10);
+	nsvg__readFloats(r, animate->spline, 4);
+	animate->srcNa = nsvg__readInt(r);
+	animate->dstNa = nsvg__readInt(r);
+	animate->type = (char)nsvg__readInt(r);
+	animate->calcMode = (char)nsvg__readInt(r);
+	animate->additive = (char)nsvg__readInt(r);
+	animate->fill = (char)nsvg__readInt(r);
+	animate->flags = (char)nsvg__readInt(r);
+	animate->progression = -1;
+	animate->splineTable = -1;
+	if (animate->srcNa < 0 || animate->srcNa > 10 || animate->dstNa < 0 || animate->dstNa > 10)
+		r->error = 1;
+}
+
+static NSVGimage* nsvg__parseBinary(const unsigned char* data, int size, int flags, int arena, void* memory, int memorySize)
+{
+	NSVGbinaryReader r;
+	NSVGimage* image = NULL;
+	NSVGshapeNode** nodes = NULL;
+	NSVGshapeNode* shapeNode;
+	NSVGanimate* animate;
+	unsigned int units, one = 1;
+	int nnodes, parent, hasShape, nanimates, i, j;
+
+	if (data == NULL) return NULL;
+	r.data = data;
+	r.size = size;
+	r.pos = 0;
+	r.error = 0;
+
+	// Points are read in place if their floats are aligned and stored in the native order.
+	r.inPlace = (flags & NSVG_BINARY_IN_PLACE) && ((size_t)data & 3) == 0 && *(unsigned char*)&one == 1;
+	if (nsvg__readInt(&r) != NSVG_BINARY_MAGIC || nsvg__readInt(&r) != NSVG_BINARY_VERSION) return NULL;
+	r.size = nsvg__readInt(&r);
+	nnodes = nsvg__readInt(&r);
+	if (r.error || r.size < r.pos || r.size > size) return NULL;
+	if (nnodes < 0 || nnodes > (r.size - r.pos) / 16) return NULL;
+
+	if (arena) {
+		image = nsvg__createArenaImage(memory, memorySize);
+		if (image == NULL) return NULL;
+	} else {
+		image = (NSVGimage*)malloc(sizeof(NSVGimage));
+		if (image == NULL) return NULL;
+		memset(image, 0, sizeof(NSVGimage));
+	}
+
+	image->width = nsvg__readFloat(&r);
+	image->height = nsvg__readFloat(&r);
+	image->viewMinx = nsvg__readFloat(&r);
+	image->viewMiny = nsvg__readFloat(&r);
+	image->viewWidth = nsvg__readFloat(&r);
+	image->viewHeight = nsvg__readFloat(&r);
+	image->fontSize = nsvg__readFloat(&r);
+	image->dpi = nsvg__readFloat(&r);
+	image->alignX = nsvg__readInt(&r);
+	image->alignY = nsvg__readInt(&r);
+	image->alignType = nsvg__readInt(&r);
+	units = (unsigned int)nsvg__readInt(&r);
+	memcpy(image->units, &units, 3);
+	nsvg__readFloats(&r, image->viewXform, 6);
+
+	// Parents are written as indices of the nodes, they precede their children.
+	nodes = (NSVGshapeNode**)malloc(sizeof(NSVGshapeNode*) * (nnodes > 0 ? nnodes : 1));
+	if (nodes == NULL) goto error;
+
+	for (i = 0; i < nnodes && !r.error; i++) {
+		// Everything is linked to the image as soon as it is allocated, so it is deleted on errors.
+		shapeNode = (NSVGshapeNode*)nsvg__malloc(image, sizeof(NSVGshapeNode));
+		if (shapeNode == NULL) goto error;
+		memset(shapeNode, 0, sizeof(NSVGshapeNode));
+		if (i > 0) {
+			shapeNode->prev = nodes[i-1];
+			nodes[i-1]->next = shapeNode;
+		} else {
+			image->shapes = shapeNode;
+		}
+		nodes[i] = shapeNode;
+
+		shapeNode->shapeDepth = nsvg__readInt(&r);
+		parent = nsvg__readInt(&r);
+		hasShape = nsvg__readInt(&r);
+		nanimates = nsvg__readInt(&r);
+		if (parent >= i) goto error;
+		shapeNode->parent = (parent >= 0) ? nodes[parent] : NULL;
+
+		if (hasShape) {
+			shapeNode->shape = (NSVGshape*)nsvg__malloc(image, sizeof(NSVGshape));
+			if (shapeNode->shape == NULL) goto error;
+			memset(shapeNode->shape, 0, sizeof(NSVGshape));
+			nsvg__readShape(image, &r, shapeNode->shape);
+		}
+
+		for (j = 0; j < nanimates && !r.error; j++) {
+			animate = (NSVGanimate*)nsvg__malloc(image, sizeof(NSVGanimate));
+			if (animate == NULL) goto error;
+			memset(animate, 0, sizeof(NSVGanimate));
+			if (shapeNode->animatesTail != NULL)
+				shapeNode->animatesTail->next = animate;
+			else
+				shapeNode->animates = animate;
+			shapeNode->animatesTail = animate;
+			nsvg__readAnimate(&r, animate);
+		}
+	}
+	if (r.error) goto error;
+	free(nodes);
+
+	// Find the shapes affected by animations, and when they are animated.
+	nsvg__createAnimateSchedule(image);
+
+	return nsvg__finishArena(image);
+
+error:
+	free(nodes);
+	nsvgDelete(image);
+	return NULL;
+}
+
+NSVGimage* nsvgParseBinary(const unsigned char* data, int size, int flags)
+{
+	return nsvg__parseBinary(data, size, flags, 0, NULL, 0);
+}
+
+NSVGimage* nsvgParseBinaryArena(const unsigned char* data, int size, int flags, void* memory, int memorySize)
+{
+	return nsvg__parseBinary(data, size, flags, 1, memory, memorySize);
+}
+
+static int nsvg__animateIsTransform(char type)
+{
+	return type == NSVG_ANIMATE_TYPE_TRANSFORM_TRANSLATE ||
+		type == NSVG_ANIMATE_TYPE_TRANSFORM_SCALE ||
+		type == NSVG_ANIMATE_TYPE_TRANSFORM_ROTATE ||
+		type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWX ||
+		type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWY;
+}
+
+// Finds the transform of a transform animation at its progression, once per update for all the shapes it affects.
+static void nsvg__animateUpdateTransform(NSVGanimate* animate)
+{
+	float* xform2 = animate->xform;
+	float args[10];
+	int na, i;
+
+	for (i = 0; i < 10; i++) {
+		args[i] = animate->src[i] + (animate->dst[i] - animate->src[i]) * animate->progression;
+	}
+	na = (animate->srcNa > animate->dstNa) ? animate->srcNa : animate->dstNa;
 
 	nsvg__xformIdentity(xform2);
 
-	if (type == NSVG_ANIMATE_TYPE_TRANSFORM_TRANSLATE) {
+	if (animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_TRANSLATE) {
 		nsvg__xformSetTranslation(xform2, args[0], args[1]);
-	} else if (type == NSVG_ANIMATE_TYPE_TRANSFORM_SCALE) {
+	} else if (animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_SCALE) {
 		nsvg__xformSetScale(xform2, args[0], args[1]);
-	} else if (type == NSVG_ANIMATE_TYPE_TRANSFORM_ROTATE) {
+	} else if (animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_ROTATE) {
 		if (na > 1) {
 			nsvg__xformSetNonCenterRotation(xform2, args[0], args[1], args[2]);
 		} else {
 			nsvg__xformSetRotation(xform2, args[0]);
 		}
-	} else if (type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWX) {
+	} else if (animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWX) {
 		nsvg__xformSetSkewX(xform2, args[0]);
-	} else if (type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWY) {
+	} else if (animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWY) {
 		nsvg__xformSetSkewY(xform2, args[0]);
 	}
+}
 
+void nsvg__animateApplyTransform(float* xform, float* xform2, char additive)
+{
 	if (additive == NSVG_ANIMATE_ADDITIVE_REPLACE) {
 		nsvg__xformIdentity(xform);
 	}
@@ -4224,59 +5667,120 @@ float nsvg__animateApplySpline(float progression, float* spline)
 	return y;
 }
 
-int nsvg__animateApplyGroup(NSVGshape* shape, NSVGanimate* animate, long timeMs)
+// Returns the progression eased by the table of a spline, interpolating between the ends of its segments.
+static float nsvg__animateApplySplineTable(float progression, const NSVGsplineTable* table)
+{
+	float x;
+	int i;
+
+	if (progression <= 0.0f) return 0.0f;
+	if (progression >= 1.0f) return 1.0f;
+
+	x = progression * NSVG_SPLINE_SEGMENTS;
+	i = (int)x;
+	if (i > NSVG_SPLINE_SEGMENTS - 1) i = NSVG_SPLINE_SEGMENTS - 1;
+	x -= i;
+
+	return ((float)table->values[i] + ((float)table->values[i+1] - (float)table->values[i]) * x) * (1.0f / 65535.0f);
+}
+
+// Returns the progression of the animation at the time, or -1 if it should not be applied.
+static float nsvg__animateGetProgression(NSVGimage* image, NSVGanimate* animate, long timeMs)
 {
-	NSVGpath* path;
 	long relativeTime;
 	float progression;
-	float splineValue;
-	float args[10];
-	int animateApplied;
-	char groupHasAnimate;
-	char scaleStroke;
 	char ended;
 	int count;
-	int na;
-	int i;
 
-	animateApplied = 0;
+	// Verify animation time.
+	ended = 0;
+	relativeTime = (timeMs - animate->begin) % animate->groupDur + animate->begin;
+	if (relativeTime < animate->begin) return -1;
+	if (relativeTime >= (animate->begin + animate->dur)) ended = 1;
+	if (animate->end > 0 && timeMs >= animate->end) ended = 1;
+	if (animate->repeatCount >= 0) {
+		count = (timeMs - animate->begin) / animate->groupDur;
+		if (count + 1 > animate->repeatCount) ended = 1;
+	}
+
+	// If ended, apply this only if last and fill is freeze.
+	if (ended && !(animate->flags & NSVG_ANIMATE_FLAG_GROUP_LAST && animate->fill == NSVG_ANIMATE_FILL_FREEZE)) return -1;
+
+	// Calculate relative progression.
+	progression = 1;
+	if (!ended) {
+		// Linear progression.
+		if (animate->calcMode != NSVG_ANIMATE_CALC_MODE_DISCRETE) {
+			progression = (float)(relativeTime - animate->begin) / (float)animate->dur;
+		}
+
+		// Handle spline calculation.
+		if (animate->calcMode == NSVG_ANIMATE_CALC_MODE_SPLINE) {
+			if (animate->splineTable >= 0)
+				progression = nsvg__animateApplySplineTable(progression, &image->splineTables[animate->splineTable]);
+			else
+				progression = nsvg__animateApplySpline(progression, animate->spline);
+		}
+	}
+
+	return progression;
+}
+
+// Updates the progression of the animations of a shape node, returns whether any changed since the last update.
+static int nsvg__animateUpdateGroup(NSVGimage* image, NSVGanimate* animate, long timeMs)
+{
+	float progression;
+	char groupHasAnimate;
+	int changed;
+
+	changed = 0;
 	groupHasAnimate = 0;
 	for (; animate != NULL; animate = animate->next) {
 
 		if (animate->flags & NSVG_ANIMATE_FLAG_GROUP_FIRST) groupHasAnimate = 0;
-		ended = 0;
-		scaleStroke = 0;
 
-		// Check if already applied another animation from same group.
-		if (groupHasAnimate) continue;
+		// Only one animation of the group is applied.
+		progression = -1;
+		if (!groupHasAnimate) progression = nsvg__animateGetProgression(image, animate, timeMs);
+		if (progression >= 0) groupHasAnimate = 1;
+		if (progression > 0 && (animate->flags & NSVG_ANIMATE_FLAG_CONSTANT)) progression = 0;
+
+		if (progression == animate->progression) continue;
+		changed = 1;
+		animate->progression = progression;
+		if (progression >= 0 && nsvg__animateIsTransform(animate->type))
+			nsvg__animateUpdateTransform(animate);
+	}
 
-		// Verify animation time.
-		relativeTime = (timeMs - animate->begin) % animate->groupDur + animate->begin;
-		if (relativeTime < animate->begin) continue;
-		if (relativeTime >= (animate->begin + animate->dur)) ended = 1;
-		if (animate->end > 0 && timeMs >= animate->end) ended = 1;
-		if (animate->repeatCount >= 0) {
-			count = (timeMs - animate->begin) / animate->groupDur;
-			if (count + 1 > animate->repeatCount) ended = 1;
-		}
+	return changed;
+}
+
+int nsvg__animateApplyGroup(NSVGshape* shape, NSVGanimate* animate)
+{
+	NSVGpath* path;
+	float progression;
+	float args[10];
+	int animateApplied;
+	int i;
 
-		// If ended, apply this only if last and fill is freeze.
-		if (ended && !(animate->flags & NSVG_ANIMATE_FLAG_GROUP_LAST && animate->fill == NSVG_ANIMATE_FILL_FREEZE)) continue;
+	animateApplied = 0;
+	for (; animate != NULL; animate = animate->next) {
 
-		groupHasAnimate = 1;
+		// Progression was found by nsvg__animateUpdateGroup().
+		progression = animate->progression;
+		if (progression < 0) continue;
 
-		// Calculate relative progression.
-		progression = 1;
-		if (!ended) {
-			// Linear progression.
-			if (animate->calcMode != NSVG_ANIMATE_CALC_MODE_DISCRETE) {
-				progression = (float)(relativeTime - animate->begin) / (float)animate->dur;
-			}
+		// Transforms were found by nsvg__animateUpdateGroup(), once for all the shapes they affect.
+		if (nsvg__animateIsTransform(animate->type)) {
+			// Transform the strokes.
+			nsvg__animateApplyTransform(shape->xform, animate->xform, animate->additive);
 
-			// Handle spline calculation.
-			if (animate->calcMode == NSVG_ANIMATE_CALC_MODE_SPLINE) {
-				progression = nsvg__animateApplySpline(progression, animate->spline);
+			// Transform the paths, their points are transformed once by nsvg__animateTransformPaths().
+			for (path = shape->paths; path != NULL; path = path->next) {
+				nsvg__animateApplyTransform(path->xform, animate->xform, animate->additive);
 			}
+			animateApplied = 1;
+			continue;
 		}
 
 		// Apply the value interpolation.
@@ -4284,24 +5788,7 @@ int nsvg__animateApplyGroup(NSVGshape* shape, NSVGanimate* animate, long timeMs)
 			args[i] = animate->src[i] + (animate->dst[i] - animate->src[i]) * progression;
 		}
 
-		// Check if this is a transform.
-		if (animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_TRANSLATE ||
-			animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_SCALE ||
-			animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_ROTATE ||
-			animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWX ||
-			animate->type == NSVG_ANIMATE_TYPE_TRANSFORM_SKEWY) {
-			// Transform the strokes.
-			na = (animate->srcNa > animate->dstNa) ? animate->srcNa : animate->dstNa;
-			nsvg__animateApplyTransform(shape->xform, args, na, animate->type, animate->additive);
-			scaleStroke = 1;
-
-			// Transform the paths.
-			for (path = shape->paths; path != NULL; path = path->next) {
-				nsvg__animateApplyTransform(path->xform, args, na, animate->type, animate->additive);
-				nsvg__transformPath(path, path->xform);
-				path->scaled = 0;
-			}
-		} else if (animate->type == NSVG_ANIMATE_TYPE_FILL) {
+		if (animate->type == NSVG_ANIMATE_TYPE_FILL) {
 			nsvg__animateApplyPaint(&shape->fill, args, animate->additive);
 		} else if (animate->type == NSVG_ANIMATE_TYPE_STROKE) {
 			nsvg__animateApplyPaint(&shape->stroke, args, animate->additive);
@@ -4319,7 +5806,6 @@ int nsvg__animateApplyGroup(NSVGshape* shape, NSVGanimate* animate, long timeMs)
 			nsvg__animateApplyValue(&shape->strokeWidth, args, animate->additive);
 		} else if (animate->type == NSVG_ANIMATE_TYPE_STROKE_DASHOFFSET) {
 			nsvg__animateApplyValue(&shape->strokeDashOffset, args, animate->additive);
-			scaleStroke = 1;
 		} else if (animate->type == NSVG_ANIMATE_TYPE_STROKE_DASHARRAY) {
 			if (animate->srcNa != animate->dstNa) {
 				memcpy(shape->strokeDashArray, animate->dst, sizeof(float)*(animate->dstNa-1));
@@ -4335,15 +5821,15 @@ int nsvg__animateApplyGroup(NSVGshape* shape, NSVGanimate* animate, long timeMs)
 	return animateApplied;
 }
 
-int nsvg__animateApplyGroupRecursive(NSVGshape* shape, NSVGshapeNode* shapeNode, long timeMs)
+int nsvg__animateApplyGroupRecursive(NSVGshape* shape, NSVGshapeNode* shapeNode)
 {
 	int animateApplied = 0;
 
 	if (shapeNode->parent != NULL) {
-		animateApplied |= nsvg__animateApplyGroupRecursive(shape, shapeNode->parent, timeMs);
+		animateApplied |= nsvg__animateApplyGroupRecursive(shape, shapeNode->parent);
 	}
 	
-	animateApplied |= nsvg__animateApplyGroup(shape, shapeNode->animates, timeMs);
+	animateApplied |= nsvg__animateApplyGroup(shape, shapeNode->animates);
 
 	return animateApplied;
 }
@@ -4352,21 +5838,36 @@ void nsvg__animateReset(NSVGshape* shape)
 {
 	NSVGpath* path;
 
+	// Shapes that are not animated have no original values.
+	if (shape->orig == NULL) return;
+
 	// Reset paint.
-	shape->opacity = shape->orig.opacity;
-	memcpy(&shape->fill, &shape->orig.fill, sizeof(shape->fill));
-	memcpy(&shape->stroke, &shape->orig.stroke, sizeof(shape->stroke));
-	shape->strokeWidth = shape->orig.strokeWidth;
-	shape->strokeDashOffset = shape->orig.strokeDashOffset;
-	shape->strokeDashCount = shape->orig.strokeDashCount;
-	memcpy(shape->strokeDashArray, shape->orig.strokeDashArray, sizeof(shape->strokeDashArray));
+	shape->opacity = shape->orig->opacity;
+	memcpy(&shape->fill, &shape->orig->fill, sizeof(shape->fill));
+	memcpy(&shape->stroke, &shape->orig->stroke, sizeof(shape->stroke));
+	shape->strokeWidth = shape->orig->strokeWidth;
+	shape->strokeDashOffset = shape->orig->strokeDashOffset;
+	shape->strokeDashCount = shape->orig->strokeDashCount;
+	memcpy(shape->strokeDashArray, shape->orig->strokeDashArray, sizeof(shape->strokeDashArray));
 
 	// Reset the shape transforms.
-	memcpy(shape->xform, shape->orig.xform, sizeof(shape->xform));
+	memcpy(shape->xform, shape->orig->xform, sizeof(shape->xform));
+
+	// Reset all path transforms, the points are transformed after the animations are applied.
+	for (path = shape->paths; path != NULL; path = path->next) {
+		memcpy(path->xform, path->orig->xform, sizeof(path->xform));
+		path->scaled = 0;
+	}
+}
+
+// Transforms the points of the paths from their original points, once the transforms of all animations are applied.
+void nsvg__animateTransformPaths(NSVGshape* shape)
+{
+	NSVGpath* path;
+
+	if (shape->orig == NULL) return;
 
-	// Reset all path transform and points.
 	for (path = shape->paths; path != NULL; path = path->next) {
-		memcpy(path->xform, path->orig.xform, sizeof(path->xform));
 		nsvg__transformPath(path, path->xform);
 	}
 }
@@ -4382,35 +5883,243 @@ int nsvgIsAnimated(NSVGimage* image)
 	return 0;
 }
 
+static int nsvg__rectsOverlap(const float* a, const float* b)
+{
+	return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+static void nsvg__addDirtyRect(NSVGimage* image, const float* bounds)
+{
+	float rect[4], grow, minGrow;
+	int i, merge;
+
+	if (bounds[0] > bounds[2] || bounds[1] > bounds[3]) return;
+	memcpy(rect, bounds, sizeof(rect));
+
+	for (;;) {
+		// Find a rectangle overlapping the new one.
+		merge = -1;
+		for (i = 0; i < image->ndirtyRects; i++) {
+			if (nsvg__rectsOverlap(rect, image->dirtyRects[i])) {
+				merge = i;
+				break;
+			}
+		}
+		if (merge == -1) {
+			if (image->ndirtyRects < NSVG_MAX_DIRTY_RECTS) {
+				memcpy(image->dirtyRects[image->ndirtyRects++], rect, sizeof(rect));
+				return;
+			}
+			// List is full, merge with the rectangle that grows the least.
+			minGrow = 0;
+			for (i = 0; i < image->ndirtyRects; i++) {
+				float* r = image->dirtyRects[i];
+				grow = (nsvg__maxf(r[2], rect[2]) - nsvg__minf(r[0], rect[0])) * (nsvg__maxf(r[3], rect[3]) - nsvg__minf(r[1], rect[1]))
+					 - (r[2] - r[0]) * (r[3] - r[1]);
+				if (merge == -1 || grow < minGrow) {
+					merge = i;
+					minGrow = grow;
+				}
+			}
+		}
+
+		// Remove the merged rectangle and add the union again, as it may overlap others now.
+		rect[0] = nsvg__minf(rect[0], image->dirtyRects[merge][0]);
+		rect[1] = nsvg__minf(rect[1], image->dirtyRects[merge][1]);
+		rect[2] = nsvg__maxf(rect[2], image->dirtyRects[merge][2]);
+		rect[3] = nsvg__maxf(rect[3], image->dirtyRects[merge][3]);
+		image->ndirtyRects--;
+		memcpy(image->dirtyRects[merge], image->dirtyRects[image->ndirtyRects], sizeof(rect));
+	}
+}
+
+static void nsvg__getShapeDirtyBounds(NSVGshape* shape, float* bounds)
+{
+	float pad = 0;
+
+	// Include the stroke, miters and square caps may extend beyond half the stroke width.
+	if (shape->stroke.type != NSVG_PAINT_NONE) {
+		pad = shape->strokeWidth * 0.5f;
+		if (shape->strokeLineJoin == NSVG_JOIN_MITER)
+			pad *= nsvg__maxf(shape->miterLimit, 1.5f);
+		else
+			pad *= 1.5f;
+	}
+	bounds[0] = shape->bounds[0] - pad;
+	bounds[1] = shape->bounds[1] - pad;
+	bounds[2] = shape->bounds[2] + pad;
+	bounds[3] = shape->bounds[3] + pad;
+}
+
+static void nsvg__animateUpdateNode(NSVGimage* image, NSVGanimatedNode* animNode, long timeMs)
+{
+	NSVGshapeNode* shapeNode;
+
+	// Update the animations once per update.
+	if (animNode->update == image->nupdates) return;
+	animNode->update = image->nupdates;
+#if defined(NSVG_STATS)
+	{
+		NSVGanimate* animate;
+		for (animate = animNode->node->animates; animate != NULL; animate = animate->next)
+			image->nevaluatedAnimates++;
+	}
+#endif
+	if (!nsvg__animateUpdateGroup(image, animNode->node->animates, timeMs)) return;
+
+	// The node and its descendants are changed.
+	for (shapeNode = animNode->node; ; shapeNode = shapeNode->next) {
+		if (shapeNode->shape != NULL && !(shapeNode->shape->flags & NSVG_FLAGS_CHANGED)) {
+			shapeNode->shape->flags |= NSVG_FLAGS_CHANGED;
+			image->changedNodes[image->nchangedNodes++] = shapeNode;
+		}
+		if (shapeNode == animNode->lastNode) break;
+	}
+}
+
 int nsvgAnimate(NSVGimage* image, long timeMs)
 {
-	NSVGshapeNode* shapeNode = image->shapes;
+	NSVGanimatedNode* animNode;
+	NSVGanimateEvent* event;
+	NSVGshapeNode* shapeNode;
 	NSVGshape* shape;
-	int retVal = 0;
-	int count;
+	float bounds[4], tx, ty, sx, sy;
+	int i;
 
-	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+	// Shapes changed by the previous update are not changed, unless changed again.
+	for (i = 0; i < image->nchangedNodes; i++) {
+		image->changedNodes[i]->shape->flags &= ~NSVG_FLAGS_CHANGED;
+	}
+	image->nchangedNodes = 0;
+	image->nupdates++;
+
+	if (timeMs < image->animateTime) {
+		// Going back in time, update all animations and find again the nodes between their begin and end.
+		image->nliveNodes = 0;
+		for (i = 0; i < image->nanimatedNodes; i++) {
+			animNode = &image->animatedNodes[i];
+			nsvg__animateUpdateNode(image, animNode, timeMs);
+			if (animNode->begin <= timeMs && (animNode->end < 0 || timeMs < animNode->end))
+				image->liveNodes[image->nliveNodes++] = i;
+		}
+		for (image->nextEvent = 0; image->nextEvent < image->nevents && image->events[image->nextEvent].time <= timeMs; image->nextEvent++);
+	} else {
+		// Begin and end the animations of nodes by the events until the time.
+		for (; image->nextEvent < image->nevents && image->events[image->nextEvent].time <= timeMs; image->nextEvent++) {
+			event = &image->events[image->nextEvent];
+			if (event->begin) {
+				image->liveNodes[image->nliveNodes++] = event->node;
+			} else {
+				for (i = 0; i < image->nliveNodes; i++) {
+					if (image->liveNodes[i] == event->node) {
+						image->liveNodes[i] = image->liveNodes[--image->nliveNodes];
+						break;
+					}
+				}
+				// Update once more to the final state.
+				nsvg__animateUpdateNode(image, &image->animatedNodes[event->node], timeMs);
+			}
+		}
+
+		// Only the animations between their begin and end may change.
+		for (i = 0; i < image->nliveNodes; i++) {
+			nsvg__animateUpdateNode(image, &image->animatedNodes[image->liveNodes[i]], timeMs);
+		}
+	}
+	image->animateTime = timeMs;
+
+	if (image->nchangedNodes == 0)
+		return 0;
+
+	nsvg__getViewboxTransform(image, &tx, &ty, &sx, &sy);
+	for (i = 0; i < image->nchangedNodes; i++) {
+		shapeNode = image->changedNodes[i];
 		shape = shapeNode->shape;
-		if (shape == NULL) continue;
+		shape->generation++;
+
+		// Area covered before the update.
+		nsvg__getShapeDirtyBounds(shape, bounds);
+		nsvg__addDirtyRect(image, bounds);
 
 		// Reset the shape transforms.
 		nsvg__animateReset(shape);
 
 		// Apply the shape transformations recursively (including parents).
-		retVal |= nsvg__animateApplyGroupRecursive(shape, shapeNode, timeMs);
+		// A shape whose animation stopped changes once more, back to its original state.
+		if (nsvg__animateApplyGroupRecursive(shape, shapeNode)) {
+			shape->flags |= NSVG_FLAGS_ANIMATED;
+		} else {
+			shape->flags &= ~NSVG_FLAGS_ANIMATED;
+		}
+		nsvg__animateTransformPaths(shape);
 
 		// Scale shape strokes.
 		nsvg__scaleShapeStroke(shape, shape->xform);
 
 		// Update shape bounds.
 		nsvg__updateShapeBounds(shape);
+
+		// The shape was reset to its original coordinates, scale it back.
+		nsvg__scaleShapeToViewbox(shape, tx, ty, sx, sy);
+
+		// Area covered after the update.
+		nsvg__getShapeDirtyBounds(shape, bounds);
+		nsvg__addDirtyRect(image, bounds);
+	}
+
+	return 1;
+}
+
+void nsvgResetDirty(NSVGimage* image)
+{
+	image->ndirtyRects = 0;
+}
+
+static long nsvg__animateNextChange(NSVGanimate* animate, long timeMs)
+{
+	long begin, end, relativeTime, next;
+
+	// The animation does not change after its end.
+	nsvg__getAnimateWindow(animate, &begin, &end);
+	if (end >= 0 && timeMs >= end) return -1;
+
+	if (timeMs < animate->begin) {
+		next = animate->begin;
+	} else {
+		relativeTime = (timeMs - animate->begin) % animate->groupDur + animate->begin;
+		if (relativeTime < animate->begin + animate->dur) {
+			// Continuous animations change all the time, discrete and constant ones at the end of their duration.
+			if (animate->calcMode != NSVG_ANIMATE_CALC_MODE_DISCRETE && !(animate->flags & NSVG_ANIMATE_FLAG_CONSTANT)) return timeMs;
+			next = timeMs + (animate->begin + animate->dur - relativeTime);
+		} else {
+			// Wait for the next repeat.
+			next = timeMs + (animate->groupDur - (relativeTime - animate->begin));
+		}
 	}
 
-	if (retVal) {
-		nsvg__scaleToViewbox(image);
+	return (end >= 0 && end < next) ? end : next;
+}
+
+long nsvgNextChange(NSVGimage* image, long timeMs)
+{
+	NSVGanimatedNode* animNode;
+	NSVGanimate* animate;
+	long next = -1, change;
+	int i;
+
+	for (i = 0; i < image->nanimatedNodes; i++) {
+		animNode = &image->animatedNodes[i];
+		if (animNode->end >= 0 && timeMs >= animNode->end) continue;
+
+		for (animate = animNode->node->animates; animate != NULL; animate = animate->next) {
+			change = nsvg__animateNextChange(animate, timeMs);
+			if (change < 0) continue;
+			if (change <= timeMs) return timeMs;
+			next = (next < 0 || change < next) ? change : next;
+		}
 	}
 
-	return retVal;
+	return next;
 }
 
 #endif // NANOSVG_IMPLEMENTATION
@@ -34,6 +34,7 @@ extern "C" {
 #endif
 
 typedef struct NSVGrasterizer NSVGrasterizer;
+typedef struct NSVGrasterizedImage NSVGrasterizedImage;
 
 /* Example Usage:
 	// Load SVG
@@ -76,12 +77,13 @@ typedef struct NSVGrasterizer NSVGrasterizer;
 // Allocated rasterizer context.
 NSVGrasterizer* nsvgCreateRasterizer(void);
 
-// Rasterizes SVG image, returns RGBA image (non-premultiplied alpha)
+// Rasterizes SVG image, returns RGBA image (non-premultiplied alpha), or blends it in the format of the context.
+// Shapes outside the destination are skipped, and edges are clipped to it.
 //   r - pointer to rasterizer context
 //   image - pointer to image to rasterize
 //   tx,ty - image offset (applied after scaling)
 //   scale - image scale
-//   dst - pointer to destination image data, 4 bytes per pixel (RGBA)
+//   dst - pointer to destination image data, in the format set by nsvgRasterizerSetFormat() (RGBA by default)
 //   w - width of the image to render
 //   h - height of the image to render
 //   stride - number of bytes per scaleline in the destination buffer
@@ -92,6 +94,43 @@ void nsvgRasterize(NSVGrasterizer* r,
 // Deletes rasterizer context.
 void nsvgDeleteRasterizer(NSVGrasterizer*);
 
+enum NSVGrasterizerFlags {
+	NSVG_RAST_COMPACT_EDGES = 0x01,		// Prepare edges in 16-bit fixed point, and rasterize them in integer arithmetic.
+};
+
+// Sets flags used when preparing images (NSVGrasterizerFlags).
+//   r - pointer to rasterizer context
+//   flags - combination of NSVGrasterizerFlags
+void nsvgRasterizerSetFlags(NSVGrasterizer* r, int flags);
+
+enum NSVGrasterizerFormat {
+	NSVG_RAST_FORMAT_RGBA = 0,				// RGBA with non-premultiplied alpha, shapes are composited in the cleared destination.
+	NSVG_RAST_FORMAT_RGB565 = 1,			// RGB 5:6:5, shapes are blended over the destination pixels.
+	NSVG_RAST_FORMAT_RGB565_SWAPPED = 2,	// RGB 5:6:5 with bytes in reverse order, shapes are blended over the destination pixels.
+	NSVG_RAST_FORMAT_BGRA8888 = 3,			// BGRA 8:8:8:8, shapes are blended over the destination pixels.
+	NSVG_RAST_FORMAT_MASK = 0xff,
+	NSVG_RAST_FORMAT_ALIASED = 0x100,		// Pixels are either covered or not, without antialiasing (not with NSVG_RAST_FORMAT_RGBA).
+};
+
+// Sets the format of the destination of rasterizations (NSVGrasterizerFormat).
+// Other than NSVG_RAST_FORMAT_RGBA, coverage is blended straight into the destination pixels, without an intermediate buffer.
+//   r - pointer to rasterizer context
+//   format - one of NSVGrasterizerFormat, optionally with NSVG_RAST_FORMAT_ALIASED
+void nsvgRasterizerSetFormat(NSVGrasterizer* r, int format);
+
+// Sets the number of samples of each pixel row used for antialiasing, 5 by default.
+// Less samples rasterize faster, and 1 takes a single sample per row. The count should divide 255 (1, 3, 5, 15, 17, 51)
+// so that covered pixels are opaque, other counts use the default.
+//   r - pointer to rasterizer context
+//   subsamples - number of vertical samples per pixel
+void nsvgRasterizerSetSubsamples(NSVGrasterizer* r, int subsamples);
+
+// Sets the largest distance in pixels of flattened curves from the curves, 0.25 by default.
+// Curves are split to less edges with a larger tolerance, it applies to images prepared or rasterized after it is set.
+//   r - pointer to rasterizer context
+//   tolerance - distance in pixels, larger than 0 (other values use the default)
+void nsvgRasterizerSetTolerance(NSVGrasterizer* r, float tolerance);
+
 // Prepare an image for rasterization.
 // This is used to split rasterization calculations from actual writing the destination, allowing for rasterization in segments or
 // rasterizing multiple times quickly.
@@ -109,6 +148,88 @@ void nsvgRasterizePrepare(NSVGrasterizer* r, NSVGimage* image, float scale);
 //   stride - number of bytes per scaleline in the destination buffer
 void nsvgRasterizeFinish(NSVGrasterizer* r, float tx, float ty, unsigned char* dst, int w, int h, int stride);
 
+// Allocated prepared image, keeping the prepared edges and paints of one image apart from the rasterizer context.
+// A rasterizer context then only holds scratch memory, and can be shared by many prepared images.
+NSVGrasterizedImage* nsvgCreateRasterizedImage(void);
+
+// Deletes prepared image.
+void nsvgDeleteRasterizedImage(NSVGrasterizedImage* rImage);
+
+// Prepare an image for rasterization into a prepared image, same as nsvgRasterizePrepare().
+// When the same image is prepared again with the same scale and flags, only the shapes whose generation changed
+// (see nsvgAnimate()) are prepared again, so a prepared image should only be used for one image.
+//   r - pointer to rasterizer context, used for scratch memory
+//   rImage - pointer to prepared image
+//   image - pointer to image to rasterize
+//   scale - image scale
+void nsvgRasterizePrepareImage(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGimage* image, float scale);
+
+// Prepare an image for rasterization into a destination only, same as nsvgRasterizePrepareImage() otherwise.
+// Shapes outside the destination are not prepared and edges are clipped to it, so the prepared image should only be
+// finished within the destination (e.g. in bands of it). It is prepared again if finished in a larger destination.
+//   r - pointer to rasterizer context, used for scratch memory
+//   rImage - pointer to prepared image
+//   image - pointer to image to rasterize
+//   scale - image scale
+//   tx,ty - image offset in the destination (applied after scaling)
+//   w - width of the destination
+//   h - height of the destination
+void nsvgRasterizePrepareImageViewport(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGimage* image, float scale,
+									   float tx, float ty, int w, int h);
+
+// Rasterizes a prepared image, returns RGBA image (non-premultiplied alpha), or blends it in the format of the context.
+// The prepared image is not modified, so several threads can finish the same prepared image, each with its own context.
+// Shapes entirely covered in the destination by later shapes with an opaque fill are skipped.
+//   r - pointer to rasterizer context, used for scratch memory
+//   rImage - pointer to prepared image
+//   tx,ty - image offset (applied after scaling)
+//   dst - pointer to destination image data, in the format set by nsvgRasterizerSetFormat() (RGBA by default)
+//   w - width of the image to render
+//   h - height of the image to render
+//   stride - number of bytes per scaleline in the destination buffer
+void nsvgRasterizeFinishImage(NSVGrasterizer* r, const NSVGrasterizedImage* rImage, float tx, float ty,
+							  unsigned char* dst, int w, int h, int stride);
+
+// Rasterizes a range of the shapes of a prepared image, same as nsvgRasterizeFinishImage() otherwise.
+// This is used to rasterize layers of an image apart, e.g. the shapes that do not change once and the others over them.
+//   first - index of the first shape, in the order of the shapes of the image
+//   count - number of shapes, limited to the shapes of the image
+void nsvgRasterizeFinishImageShapes(NSVGrasterizer* r, const NSVGrasterizedImage* rImage, int first, int count,
+									float tx, float ty, unsigned char* dst, int w, int h, int stride);
+
+// Returns whether a shape of a prepared image covers the whole destination with opaque pixels, so it need not be cleared
+// before the image is finished there. Only rectangles inside opaque fills found when preparing are considered.
+//   rImage - pointer to prepared image
+//   tx,ty - image offset (applied after scaling)
+//   w - width of the destination
+//   h - height of the destination
+int nsvgRasterizeIsOpaque(const NSVGrasterizedImage* rImage, float tx, float ty, int w, int h);
+
+// Returns whether a shape in a range of the shapes of a prepared image covers the whole destination with opaque pixels,
+// same as nsvgRasterizeIsOpaque() otherwise.
+//   first - index of the first shape
+//   count - number of shapes, limited to the shapes of the image
+int nsvgRasterizeIsOpaqueShapes(const NSVGrasterizedImage* rImage, int first, int count, float tx, float ty, int w, int h);
+
+// Counters of the work done by a rasterizer context, only collected when compiled with NSVG_STATS defined.
+typedef struct NSVGrasterizerStats {
+	int shapes;				// Shapes prepared.
+	int edges;				// Edges prepared.
+	int bands;				// Parts of images rasterized (calls of nsvgRasterizeFinishImage() or nsvgRasterize()).
+	int edgesVisited;		// Edges rasterized, summed over the bands they overlap.
+	int maxActiveEdges;		// Peak number of active edges of a scanline.
+	int pixels;				// Pixels blended, summed over the shapes covering them.
+	int activeGrows;		// Enlargements of the active edge table.
+} NSVGrasterizerStats;
+
+// Returns the counters of the rasterizer context since it was created or its counters were reset.
+//   r - pointer to rasterizer context
+//   stats - counters to fill, all zeros without NSVG_STATS
+void nsvgRasterizerGetStats(NSVGrasterizer* r, NSVGrasterizerStats* stats);
+
+// Resets the counters of the rasterizer context.
+void nsvgRasterizerResetStats(NSVGrasterizer* r);
+
 #ifndef NANOSVGRAST_CPLUSPLUS
 #ifdef __cplusplus
 }
@@ -121,26 +242,53 @@ void nsvgRasterizeFinish(NSVGrasterizer* r, float tx, float ty, unsigned char* d
 #include <stdlib.h>
 #include <string.h>
 
+// Vector blending is selected at compile time, define NSVG_NO_SIMD to use only the scalar code.
+#if !defined(NSVG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define NSVG__SSE2
+#elif !defined(NSVG_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NSVG__NEON
+#endif
+
+// Counters of NSVGrasterizerStats are only updated with NSVG_STATS, so they cost nothing otherwise.
+#if defined(NSVG_STATS)
+#define NSVG__STAT(x)		x
+#else
+#define NSVG__STAT(x)
+#endif
+
 #define NSVG__SUBSAMPLES	5
+#define NSVG__TOLERANCE		0.25f
+#define NSVG__MAXCURVESEGMENTS	1024
 #define NSVG__FIXSHIFT		10
 #define NSVG__FIX			(1 << NSVG__FIXSHIFT)
 #define NSVG__FIXMASK		(NSVG__FIX-1)
-#define NSVG__MEMPAGE_SIZE	1024
+#define NSVG__BUCKET_ROWS	16
+#define NSVG__COMPACTSHIFT	4
+#define NSVG__COMPACT		(1 << NSVG__COMPACTSHIFT)
+#define NSVG__COMPACTMAX	(32766.0f / NSVG__COMPACT)		// Largest compact coordinate in pixels, leaving room for rounding.
+#define NSVG__MAXDELTASCALE	1.25f	// Largest scale of a transform applied to flattened edges, before they are flattened again.
+#define NSVG__OCCLUDERS		4		// Opaque rectangles kept for finding the shapes covered in a destination.
 
 typedef struct NSVGedge {
 	float x0,y0, x1,y1;
 	int dir;
 } NSVGedge;
 
-typedef struct NSVGedgeNode {
-	NSVGedge edge;
-	struct NSVGedgeNode* next;
-} NSVGedgeNode;
+typedef struct NSVGcompactEdge {
+	short x0, y0, x1;		// Coordinates in 1/NSVG__COMPACT pixels.
+	short dy;				// Height of the edge, negative for edges going up.
+} NSVGcompactEdge;
 
 typedef struct NSVGedgeList {
-	struct NSVGedgeNode* head;
-	struct NSVGedgeNode* tail;
+	int offset;				// Offset of the edges in the prepared edges, sorted by y0.
 	int count;
+	int compact;			// Edges are in the compact edges.
+	float xmin, xmax;		// Extent of the edges.
+	float ymin, ymax;
+	int buckets;			// Offset of the first edge not ending above each NSVG__BUCKET_ROWS rows of the extent.
+	int nbuckets;
 } NSVGedgeList;
 
 typedef struct NSVGpoint {
@@ -153,33 +301,43 @@ typedef struct NSVGpoint {
 
 typedef struct NSVGactiveEdge {
 	int x,dx;
-	float ey;
+	int ey;					// First subsample below the edge.
 	int dir;
-	struct NSVGactiveEdge *next;
 } NSVGactiveEdge;
 
-typedef struct NSVGmemPage {
-	unsigned char mem[NSVG__MEMPAGE_SIZE];
-	int size;
-	struct NSVGmemPage* next;
-} NSVGmemPage;
-
 typedef struct NSVGcachedPaint {
 	signed char type;
 	char spread;
 	float xform[6];
-	unsigned int colors[256];
+	unsigned int color;			// Color of solid paint.
+	unsigned int* colors;		// Gradient colors (256 entries).
 } NSVGcachedPaint;
 
+typedef struct NSVGshapeBase
+{
+	float xform[6];				// Transform from the shape to the base edges.
+	float strokeWidth;			// Stroke of the shape when the base edges were flattened.
+	float strokeDashOffset;
+	float strokeDashArray[8];
+	char strokeDashCount;
+	int fillOffset, nfillEdges;	// Base edges of the fill and stroke in the base edges of the image.
+	int strokeOffset, nstrokeEdges;
+} NSVGshapeBase;
+
 typedef struct NSVGrasterizedShape
 {
 	struct NSVGshape* shape;
+	unsigned int generation;	// Generation of the shape when it was prepared.
+	int base;					// Index of the base of a shape changed by animation, or -1.
 
 	NSVGedgeList fillEdges;
 	NSVGcachedPaint fillCache;
 
 	NSVGedgeList strokeEdges;
 	NSVGcachedPaint strokeCache;
+
+	int opaque;					// The fill covers the rectangle with opaque pixels, in scaled image coordinates.
+	float opaquexmin, opaqueymin, opaquexmax, opaqueymax;
 } NSVGrasterizedShape;
 
 struct NSVGrasterizer
@@ -199,9 +357,8 @@ struct NSVGrasterizer
 	int npoints2;
 	int cpoints2;
 
-	NSVGactiveEdge* freelist;
-	NSVGmemPage* pages;
-	NSVGmemPage* curpage;
+	NSVGactiveEdge* active;			// Active edge table, sorted by x, sized for the edges of the largest shape.
+	int cactive;
 
 	unsigned char* scanline;
 	int cscanline;
@@ -209,26 +366,73 @@ struct NSVGrasterizer
 	unsigned char* bitmap;
 	int width, height, stride;
 
-	NSVGrasterizedShape* shapes;
-	int nshapes;
-	int cshapes;
+	int keepHorizontal;				// Horizontal edges are kept, as they may be transformed later.
 
-	NSVGedgeList freeEdges;
+	int clip;						// Shapes and edges are clipped to the rectangle, in scaled image coordinates.
+	float clipxmin, clipymin, clipxmax, clipymax;
+	int clipped;					// Shapes or edges were clipped since the rectangle was set.
 
-	float scale;
+	NSVGrasterizedImage* prepared;	// Image prepared by nsvgRasterizePrepare().
+
+	unsigned char* occluded;		// Shapes covered by later opaque shapes in the destination being finished.
+	int coccluded;
+
+	int flags;
+	int format;
+	int subsamples;
 	int memorySize;
 	int viewxmin;
 	int viewxmax;
 	int viewymin;
 	int viewymax;
+
+	NSVGrasterizerStats stats;
 };
 
 struct NSVGrasterizedImage
 {
-	NSVGrasterizer* r;
+	NSVGrasterizedShape* shapes;
+	int nshapes;
+	int cshapes;
 
-	NSVGimage* image;
+	NSVGedge* shapeEdges;		// Prepared edges of all shapes.
+	int nshapeEdges;
+	int cshapeEdges;
+
+	NSVGcompactEdge* compactEdges;	// Prepared edges of all shapes, with NSVG_RAST_COMPACT_EDGES.
+	int ncompactEdges;
+	int ccompactEdges;
+
+	int* buckets;				// Prepared edge buckets of all shapes.
+	int nbuckets;
+	int cbuckets;
+
+	int nunusedEdges;			// Prepared edges and buckets left unused by shapes prepared again.
+	int nunusedBuckets;
+
+	NSVGshapeBase* bases;		// Flattened edges of shapes changed by animation, before their transform changes.
+	int nbases;
+	int cbases;
+
+	NSVGedge* baseEdges;		// Base edges of all shapes, including horizontal edges.
+	int nbaseEdges;
+	int cbaseEdges;
+	int nunusedBaseEdges;
+
+	unsigned int* colors;		// Prepared gradient colors of all shapes.
+	int ccolors;
+
+	struct NSVGimage* image;	// Image that was prepared, or NULL.
+	int flags;
 	float scale;
+	float tessTol;
+	int clipped;				// Shapes or edges were clipped to the rectangle, which should contain the destination.
+	float clipxmin, clipymin, clipxmax, clipymax;
+	int memorySize;
+	int viewxmin;
+	int viewxmax;
+	int viewymin;
+	int viewymax;
 };
 
 NSVGrasterizer* nsvgCreateRasterizer(void)
@@ -237,8 +441,9 @@ NSVGrasterizer* nsvgCreateRasterizer(void)
 	if (r == NULL) goto error;
 	memset(r, 0, sizeof(NSVGrasterizer));
 
-	r->tessTol = 0.25f;
+	r->tessTol = NSVG__TOLERANCE;
 	r->distTol = 0.01f;
+	r->subsamples = NSVG__SUBSAMPLES;
 
 	return r;
 
@@ -249,117 +454,98 @@ error:
 
 void nsvgDeleteRasterizer(NSVGrasterizer* r)
 {
-	NSVGmemPage* p;
-	NSVGedgeNode* e;
-	int i;
-
 	if (r == NULL) return;
 
-	p = r->pages;
-	while (p != NULL) {
-		NSVGmemPage* next = p->next;
-		free(p);
-		p = next;
-	}
-
+	if (r->active) free(r->active);
 	if (r->edges) free(r->edges);
 	if (r->points) free(r->points);
 	if (r->points2) free(r->points2);
 	if (r->scanline) free(r->scanline);
+	if (r->occluded) free(r->occluded);
 
-	for (i = 0; i < r->nshapes; i++) {
-		for (e = r->shapes[i].fillEdges.head; e != NULL;) {
-			NSVGedgeNode* next = e->next;
-			free(e);
-			e = next;
-		}
-		for (e = r->shapes[i].strokeEdges.head; e != NULL;) {
-			NSVGedgeNode* next = e->next;
-			free(e);
-			e = next;
-		}
-	}
-
-	for (e = r->freeEdges.head; e != NULL;) {
-		NSVGedgeNode* next = e->next;
-		free(e);
-		e = next;
-	}
-	
-	free(r->shapes);
+	nsvgDeleteRasterizedImage(r->prepared);
 
 	free(r);
 }
 
-static void* nsvgr__malloc(NSVGrasterizer* r, int size)
+NSVGrasterizedImage* nsvgCreateRasterizedImage(void)
 {
-	void* ptr = malloc(size);
-	if (ptr == NULL)
-	{
-		return NULL;
-	}
+	NSVGrasterizedImage* rImage = (NSVGrasterizedImage*)malloc(sizeof(NSVGrasterizedImage));
+	if (rImage == NULL) return NULL;
+	memset(rImage, 0, sizeof(NSVGrasterizedImage));
 
-	r->memorySize += size;
-
-	return ptr;
+	return rImage;
 }
 
-static void* nsvgr__realloc(NSVGrasterizer* r, void* ptr, int size, int prevSize)
+void nsvgDeleteRasterizedImage(NSVGrasterizedImage* rImage)
 {
-	void* ptr2 = realloc(ptr, size);
-	if (ptr2 == NULL)
-	{
-		return NULL;
-	}
+	if (rImage == NULL) return;
 
-	r->memorySize += size - prevSize;
+	if (rImage->shapeEdges) free(rImage->shapeEdges);
+	if (rImage->compactEdges) free(rImage->compactEdges);
+	if (rImage->buckets) free(rImage->buckets);
+	if (rImage->bases) free(rImage->bases);
+	if (rImage->baseEdges) free(rImage->baseEdges);
+	if (rImage->colors) free(rImage->colors);
+	free(rImage->shapes);
 
-	return ptr2;
+	free(rImage);
 }
 
-static NSVGmemPage* nsvg__nextPage(NSVGrasterizer* r, NSVGmemPage* cur)
+void nsvgRasterizerSetFlags(NSVGrasterizer* r, int flags)
 {
-	NSVGmemPage *newp;
+	r->flags = flags;
+}
 
-	// If using existing chain, return the next page in chain
-	if (cur != NULL && cur->next != NULL) {
-		return cur->next;
-	}
+void nsvgRasterizerSetFormat(NSVGrasterizer* r, int format)
+{
+	r->format = format;
+}
 
-	// Alloc new page
-	newp = (NSVGmemPage*)nsvgr__malloc(r, sizeof(NSVGmemPage));
-	if (newp == NULL) return NULL;
-	memset(newp, 0, sizeof(NSVGmemPage));
+void nsvgRasterizerGetStats(NSVGrasterizer* r, NSVGrasterizerStats* stats)
+{
+	memcpy(stats, &r->stats, sizeof(NSVGrasterizerStats));
+}
 
-	// Add to linked list
-	if (cur != NULL)
-		cur->next = newp;
-	else
-		r->pages = newp;
+void nsvgRasterizerResetStats(NSVGrasterizer* r)
+{
+	memset(&r->stats, 0, sizeof(NSVGrasterizerStats));
+}
 
-	return newp;
+void nsvgRasterizerSetSubsamples(NSVGrasterizer* r, int subsamples)
+{
+	r->subsamples = (subsamples >= 1 && subsamples <= 255 && 255 % subsamples == 0) ? subsamples : NSVG__SUBSAMPLES;
 }
 
-static void nsvg__resetPool(NSVGrasterizer* r)
+void nsvgRasterizerSetTolerance(NSVGrasterizer* r, float tolerance)
 {
-	NSVGmemPage* p = r->pages;
-	while (p != NULL) {
-		p->size = 0;
-		p = p->next;
-	}
-	r->curpage = r->pages;
+	r->tessTol = (tolerance > 0.0f) ? tolerance : NSVG__TOLERANCE;
 }
 
-static unsigned char* nsvg__alloc(NSVGrasterizer* r, int size)
+static void* nsvgr__resize(int* memorySize, void* ptr, int size, int prevSize)
 {
-	unsigned char* buf;
-	if (size > NSVG__MEMPAGE_SIZE) return NULL;
-	if (r->curpage == NULL || r->curpage->size+size > NSVG__MEMPAGE_SIZE) {
-		r->curpage = nsvg__nextPage(r, r->curpage);
+	void* ptr2;
+	if (size == 0)
+	{
+		free(ptr);
+		*memorySize -= prevSize;
+		return NULL;
+	}
+
+	ptr2 = realloc(ptr, size);
+	if (ptr2 == NULL)
+	{
+		return NULL;
 	}
-	buf = &r->curpage->mem[r->curpage->size];
-	r->curpage->size += size;
-	return buf;
+
+	*memorySize += size - prevSize;
+
+	return ptr2;
+}
+
+static void* nsvgr__realloc(NSVGrasterizer* r, void* ptr, int size, int prevSize)
+{
+	return nsvgr__resize(&r->memorySize, ptr, size, prevSize);
 }
 
 static int nsvg__ptEquals(float x1, float y1, float x2, float y2, float tol)
@@ -425,7 +611,7 @@ static void nsvg__addEdge(NSVGrasterizer* r, float x0, float y0, float x1, float
 	NSVGedge* e;
 
 	// Skip horizontal edges
-	if (y0 == y1)
+	if (y0 == y1 && !r->keepHorizontal)
 		return;
 
 	if (r->nedges+1 > r->cedges) {
@@ -453,80 +639,335 @@ static void nsvg__addEdge(NSVGrasterizer* r, float x0, float y0, float x1, float
 	}
 }
 
-static void nsvg__copyEdgesToList(NSVGrasterizer* r, NSVGedgeList* edgeList)
+static int nsvg__cmpEdge(const void *p, const void *q)
 {
-	NSVGedgeNode* e;
-	int i,j;
+	const NSVGedge* a = (const NSVGedge*)p;
+	const NSVGedge* b = (const NSVGedge*)q;
 
-	// Make sure edges exist.
-	if (r->nedges == 0) {
-		edgeList->head = NULL;
-		edgeList->tail = NULL;
-		edgeList->count = 0;
-		return;
+	if (a->y0 < b->y0) return -1;
+	if (a->y0 > b->y0) return  1;
+	return 0;
+}
+
+static void nsvg__edgesExtent(NSVGedge* edges, int nedges, float* ymin, float* ymax)
+{
+	int i;
+
+	// Edges are sorted by y0, so only the end needs to be searched.
+	*ymin = edges[0].y0;
+	*ymax = edges[0].y1;
+	for (i = 1; i < nedges; i++) {
+		if (edges[i].y1 > *ymax) *ymax = edges[i].y1;
+	}
+}
+
+static float nsvgr__absf(float x) { return x < 0 ? -x : x; }
+static float nsvg__roundf(float x) { return (x >= 0) ? floorf(x + 0.5) : ceilf(x - 0.5); }
+
+static int nsvg__edgesFitCompact(NSVGedge* edges, int nedges)
+{
+	int i;
+
+	for (i = 0; i < nedges; i++) {
+		NSVGedge* e = &edges[i];
+		if (nsvgr__absf(e->x0) > NSVG__COMPACTMAX || nsvgr__absf(e->x1) > NSVG__COMPACTMAX ||
+			nsvgr__absf(e->y0) > NSVG__COMPACTMAX || nsvgr__absf(e->y1) > NSVG__COMPACTMAX ||
+			e->y1 - e->y0 > NSVG__COMPACTMAX)
+			return 0;
+	}
+	return 1;
+}
+
+static int nsvg__reserveShapeEdges(NSVGrasterizedImage* rImage, int count)
+{
+	if (rImage->nshapeEdges + count > rImage->cshapeEdges) {
+		int cedges = rImage->cshapeEdges + rImage->cshapeEdges / 2;
+		cedges = (cedges > rImage->nshapeEdges + count) ? cedges : rImage->nshapeEdges + count;
+		rImage->shapeEdges = (NSVGedge*)nsvgr__resize(&rImage->memorySize, rImage->shapeEdges, sizeof(NSVGedge) * cedges, sizeof(NSVGedge) * rImage->cshapeEdges);
+		if (rImage->shapeEdges == NULL) return 0;
+		rImage->cshapeEdges = cedges;
 	}
+	return 1;
+}
 
-	// Copy edges that can be filled from free edges.
-	edgeList->head = r->freeEdges.head;
-	edgeList->tail = edgeList->head;
-	for (i = 0, e = edgeList->head; e != NULL && i < r->nedges; e = e->next, i++) {
-		e->edge = r->edges[i];
-		edgeList->tail = e;
+static int nsvg__reserveCompactEdges(NSVGrasterizedImage* rImage, int count)
+{
+	if (rImage->ncompactEdges + count > rImage->ccompactEdges) {
+		int cedges = rImage->ccompactEdges + rImage->ccompactEdges / 2;
+		cedges = (cedges > rImage->ncompactEdges + count) ? cedges : rImage->ncompactEdges + count;
+		rImage->compactEdges = (NSVGcompactEdge*)nsvgr__resize(&rImage->memorySize, rImage->compactEdges, sizeof(NSVGcompactEdge) * cedges,
+														   sizeof(NSVGcompactEdge) * rImage->ccompactEdges);
+		if (rImage->compactEdges == NULL) return 0;
+		rImage->ccompactEdges = cedges;
 	}
-	edgeList->count = i;
+	return 1;
+}
 
-	// Move free edges.
-	if (edgeList->tail != NULL) {
-		r->freeEdges.head = edgeList->tail->next;
-		edgeList->tail->next = NULL;
+static int nsvg__reserveBuckets(NSVGrasterizedImage* rImage, int count)
+{
+	if (rImage->nbuckets + count > rImage->cbuckets) {
+		int cbuckets = rImage->cbuckets + rImage->cbuckets / 2;
+		cbuckets = (cbuckets > rImage->nbuckets + count) ? cbuckets : rImage->nbuckets + count;
+		rImage->buckets = (int*)nsvgr__resize(&rImage->memorySize, rImage->buckets, sizeof(int) * cbuckets, sizeof(int) * rImage->cbuckets);
+		if (rImage->buckets == NULL) return 0;
+		rImage->cbuckets = cbuckets;
 	}
-	if (r->freeEdges.head == NULL) {
-		r->freeEdges.tail = NULL;
+	return 1;
+}
+
+static int nsvg__reserveBases(NSVGrasterizedImage* rImage, int count)
+{
+	if (rImage->nbases + count > rImage->cbases) {
+		int cbases = rImage->cbases + rImage->cbases / 2;
+		cbases = (cbases > rImage->nbases + count) ? cbases : rImage->nbases + count;
+		rImage->bases = (NSVGshapeBase*)nsvgr__resize(&rImage->memorySize, rImage->bases, sizeof(NSVGshapeBase) * cbases, sizeof(NSVGshapeBase) * rImage->cbases);
+		if (rImage->bases == NULL) return 0;
+		rImage->cbases = cbases;
 	}
-	r->freeEdges.count -= i;
+	return 1;
+}
 
-	// Allocate any missing edges.
-	while (i < r->nedges) {
-		e = (NSVGedgeNode*)nsvgr__malloc(r, sizeof(NSVGedgeNode));
-		if (e == NULL) return;
-		e->edge = r->edges[i++];
-		e->next = NULL;
+static int nsvg__reserveBaseEdges(NSVGrasterizedImage* rImage, int count)
+{
+	if (rImage->nbaseEdges + count > rImage->cbaseEdges) {
+		int cedges = rImage->cbaseEdges + rImage->cbaseEdges / 2;
+		cedges = (cedges > rImage->nbaseEdges + count) ? cedges : rImage->nbaseEdges + count;
+		rImage->baseEdges = (NSVGedge*)nsvgr__resize(&rImage->memorySize, rImage->baseEdges, sizeof(NSVGedge) * cedges, sizeof(NSVGedge) * rImage->cbaseEdges);
+		if (rImage->baseEdges == NULL) return 0;
+		rImage->cbaseEdges = cedges;
+	}
+	return 1;
+}
 
-		if (edgeList->tail != NULL) {
-			edgeList->tail->next = e;
-		} else {
-			edgeList->head = e;
-		}
-		edgeList->tail = e;
-		edgeList->count++;
+static int nsvg__copyBaseEdges(NSVGrasterizer* r, NSVGrasterizedImage* rImage, int* offset, int* count)
+{
+	// The edges replace the previous base edges, and are copied over them if they fit.
+	rImage->nunusedBaseEdges += *count;
+	if (r->nedges > *count) {
+		if (!nsvg__reserveBaseEdges(rImage, r->nedges))
+			return 0;
+		*offset = rImage->nbaseEdges;
+		rImage->nbaseEdges += r->nedges;
+	} else {
+		rImage->nunusedBaseEdges -= r->nedges;
 	}
+	if (r->nedges > 0)
+		memcpy(&rImage->baseEdges[*offset], r->edges, sizeof(NSVGedge) * r->nedges);
+	*count = r->nedges;
+	return 1;
 }
 
-static void nsvg__copyEdgeListToEdges(NSVGrasterizer* r, NSVGedgeList* edgeList)
+static void nsvg__removeHorizontalEdges(NSVGrasterizer* r)
 {
-	NSVGedgeNode* e;
+	int i, n;
+
+	for (i = 0, n = 0; i < r->nedges; i++) {
+		if (r->edges[i].y0 != r->edges[i].y1)
+			r->edges[n++] = r->edges[i];
+	}
+	r->nedges = n;
+}
 
-	for (r->nedges = 0, e = edgeList->head; r->nedges <= r->cedges && e != NULL; r->nedges++, e = e->next) {
-		r->edges[r->nedges] = e->edge;
+// Returns whether the shape, including its stroke, is outside the clip rectangle.
+static int nsvg__isShapeClipped(NSVGrasterizer* r, NSVGshape* shape, float scale)
+{
+	float pad = 0;
+
+	if (!r->clip)
+		return 0;
+
+	// Miters and square caps may extend beyond half the stroke width.
+	if (shape->stroke.type != NSVG_PAINT_NONE) {
+		pad = shape->strokeWidth * 0.5f;
+		if (shape->strokeLineJoin == NSVG_JOIN_MITER)
+			pad *= (shape->miterLimit > 1.5f) ? shape->miterLimit : 1.5f;
+		else
+			pad *= 1.5f;
 	}
+	if ((shape->bounds[0] - pad) * scale >= r->clipxmax || (shape->bounds[2] + pad) * scale <= r->clipxmin ||
+		(shape->bounds[1] - pad) * scale >= r->clipymax || (shape->bounds[3] + pad) * scale <= r->clipymin) {
+		r->clipped = 1;
+		return 1;
+	}
+	return 0;
 }
 
-static void nsvg__freeEdgeList(NSVGrasterizer* r, NSVGedgeList* edgeList)
+static float nsvg__edgeXAt(const NSVGedge* e, float y)
 {
-	if ((edgeList == NULL) || (edgeList->head == NULL)) {
+	if (y <= e->y0) return e->x0;
+	if (y >= e->y1) return e->x1;
+	return e->x0 + (e->x1 - e->x0) * (y - e->y0) / (e->y1 - e->y0);
+}
+
+static float nsvg__clipX(float x, float xmin, float xmax)
+{
+	return x < xmin ? xmin : (x > xmax ? xmax : x);
+}
+
+// Clips the sorted edges to the clip rectangle, only edges not inside it are changed.
+// Edges above or below the rectangle are removed, and parts left or right of it are moved onto its sides, which keeps
+// the winding of the pixels inside the rectangle.
+static void nsvg__clipEdges(NSVGrasterizer* r)
+{
+	float xmin = r->clipxmin, ymin = r->clipymin, xmax = r->clipxmax, ymax = r->clipymax;
+	float ys[4], xa, xb;
+	int i, k, n, nedges = r->nedges, changed = 0;
+
+	if (!r->clip)
 		return;
+
+	for (i = 0; i < nedges; i++) {
+		NSVGedge e = r->edges[i];
+		if (e.x0 >= xmin && e.x0 <= xmax && e.x1 >= xmin && e.x1 <= xmax && e.y0 >= ymin && e.y1 <= ymax)
+			continue;
+
+		// The edge is replaced by its parts inside the rectangle.
+		r->edges[i].dir = 0;
+		changed = 1;
+		if (e.y1 <= ymin || e.y0 >= ymax || e.y0 >= e.y1)
+			continue;
+		if (e.y0 < ymin) {
+			e.x0 = nsvg__edgeXAt(&e, ymin);
+			e.y0 = ymin;
+		}
+		if (e.y1 > ymax) {
+			e.x1 = nsvg__edgeXAt(&e, ymax);
+			e.y1 = ymax;
+		}
+
+		// Split where the edge crosses the sides.
+		n = 0;
+		ys[n++] = e.y0;
+		if ((e.x0 < xmin) != (e.x1 < xmin))
+			ys[n++] = e.y0 + (e.y1 - e.y0) * (xmin - e.x0) / (e.x1 - e.x0);
+		if ((e.x0 > xmax) != (e.x1 > xmax))
+			ys[n++] = e.y0 + (e.y1 - e.y0) * (xmax - e.x0) / (e.x1 - e.x0);
+		if (n == 3 && ys[1] > ys[2]) {
+			float t = ys[1];
+			ys[1] = ys[2];
+			ys[2] = t;
+		}
+		ys[n++] = e.y1;
+
+		for (k = 0; k < n-1; k++) {
+			if (ys[k+1] <= ys[k])
+				continue;
+			xa = nsvg__clipX(nsvg__edgeXAt(&e, ys[k]), xmin, xmax);
+			xb = nsvg__clipX(nsvg__edgeXAt(&e, ys[k+1]), xmin, xmax);
+			if (e.dir > 0)
+				nsvg__addEdge(r, xa, ys[k], xb, ys[k+1]);
+			else
+				nsvg__addEdge(r, xb, ys[k+1], xa, ys[k]);
+			if (r->edges == NULL) {
+				r->nedges = 0;
+				return;
+			}
+		}
 	}
+	if (!changed)
+		return;
+	r->clipped = 1;
 
-	edgeList->tail->next = r->freeEdges.head;
-	r->freeEdges.head = edgeList->head;
-	if (r->freeEdges.tail == NULL) {
-		r->freeEdges.tail = edgeList->tail;
+	for (i = 0, n = 0; i < r->nedges; i++) {
+		if (r->edges[i].dir != 0)
+			r->edges[n++] = r->edges[i];
 	}
-	r->freeEdges.count += edgeList->count;
+	r->nedges = n;
+	if (r->nedges != 0)
+		qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+}
 
-	edgeList->head = NULL;
-	edgeList->tail = NULL;
+static void nsvg__copyEdgesToList(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGedgeList* edgeList)
+{
+	NSVGedge* e;
+	float top;
+	int* buckets;
+	int i, k, nbuckets, compact, offset, bucketOffset, reuseEdges, reuseBuckets;
+
+	// The previous edges of a list prepared again are left unused, unless the new edges fit in their place.
+	reuseEdges = edgeList->count;
+	reuseBuckets = edgeList->nbuckets;
+	rImage->nunusedEdges += edgeList->count;
+	rImage->nunusedBuckets += edgeList->nbuckets;
 	edgeList->count = 0;
+	edgeList->nbuckets = 0;
+
+	// Make sure edges exist.
+	nsvg__clipEdges(r);
+	if (r->nedges == 0)
+		return;
+	NSVG__STAT(r->stats.edges += r->nedges);
+
+	// Append the sorted edges to the prepared edges, compact edges are used if the coordinates fit.
+	nsvg__edgesExtent(r->edges, r->nedges, &edgeList->ymin, &edgeList->ymax);
+	edgeList->xmin = edgeList->xmax = r->edges[0].x0;
+	for (i = 0; i < r->nedges; i++) {
+		e = &r->edges[i];
+		edgeList->xmin = (e->x0 < edgeList->xmin) ? e->x0 : edgeList->xmin;
+		edgeList->xmin = (e->x1 < edgeList->xmin) ? e->x1 : edgeList->xmin;
+		edgeList->xmax = (e->x0 > edgeList->xmax) ? e->x0 : edgeList->xmax;
+		edgeList->xmax = (e->x1 > edgeList->xmax) ? e->x1 : edgeList->xmax;
+	}
+	nbuckets = (int)((edgeList->ymax - edgeList->ymin) / NSVG__BUCKET_ROWS) + 1;
+	compact = (r->flags & NSVG_RAST_COMPACT_EDGES) && nsvg__edgesFitCompact(r->edges, r->nedges);
+	reuseEdges = (r->nedges <= reuseEdges && compact == edgeList->compact);
+	reuseBuckets = (nbuckets <= reuseBuckets);
+	if (!reuseBuckets && !nsvg__reserveBuckets(rImage, nbuckets))
+		return;
+	if (!reuseEdges && !(compact ? nsvg__reserveCompactEdges(rImage, r->nedges) : nsvg__reserveShapeEdges(rImage, r->nedges)))
+		return;
+
+	if (reuseEdges) {
+		offset = edgeList->offset;
+		rImage->nunusedEdges -= r->nedges;
+	} else if (compact) {
+		offset = rImage->ncompactEdges;
+		rImage->ncompactEdges += r->nedges;
+	} else {
+		offset = rImage->nshapeEdges;
+		rImage->nshapeEdges += r->nedges;
+	}
+	if (compact) {
+		for (i = 0; i < r->nedges; i++) {
+			NSVGcompactEdge* ce = &rImage->compactEdges[offset + i];
+			e = &r->edges[i];
+			ce->x0 = (short)nsvg__roundf(e->x0 * NSVG__COMPACT);
+			ce->y0 = (short)nsvg__roundf(e->y0 * NSVG__COMPACT);
+			ce->x1 = (short)nsvg__roundf(e->x1 * NSVG__COMPACT);
+			ce->dy = (short)(((short)nsvg__roundf(e->y1 * NSVG__COMPACT) - ce->y0) * e->dir);
+		}
+	} else {
+		memcpy(&rImage->shapeEdges[offset], r->edges, sizeof(NSVGedge) * r->nedges);
+	}
+	edgeList->offset = offset;
+	edgeList->count = r->nedges;
+	edgeList->compact = compact;
+
+	// Split the extent to buckets of rows, and find the first edge that does not end above each bucket.
+	if (reuseBuckets) {
+		bucketOffset = edgeList->buckets;
+		rImage->nunusedBuckets -= nbuckets;
+	} else {
+		bucketOffset = rImage->nbuckets;
+		rImage->nbuckets += nbuckets;
+	}
+	buckets = &rImage->buckets[bucketOffset];
+	edgeList->buckets = bucketOffset;
+	edgeList->nbuckets = nbuckets;
+	for (i = 0, k = 0; i < r->nedges && k < nbuckets; i++) {
+		for (top = edgeList->ymin + k * NSVG__BUCKET_ROWS; k < nbuckets && top < r->edges[i].y1; top += NSVG__BUCKET_ROWS)
+			buckets[k++] = i;
+	}
+	while (k < nbuckets)
+		buckets[k++] = r->nedges;
+}
+
+static int nsvg__firstEdgeInList(const NSVGrasterizedImage* rImage, const NSVGedgeList* edgeList, float ymin)
+{
+	// First edge that does not end above the bucket of the range top.
+	int k = (int)((ymin - edgeList->ymin) / NSVG__BUCKET_ROWS);
+	k = (k < 0) ? 0 : (k >= edgeList->nbuckets ? edgeList->nbuckets - 1 : k);
+	return rImage->buckets[edgeList->buckets + k];
 }
 
 static float nsvg__normalize(float *x, float* y)
@@ -540,45 +981,66 @@ static float nsvg__normalize(float *x, float* y)
 	return d;
 }
 
-static float nsvgr__absf(float x) { return x < 0 ? -x : x; }
-static float nsvg__roundf(float x) { return (x >= 0) ? floorf(x + 0.5) : ceilf(x - 0.5); }
 
+// Flattens a cubic bezier to the number of segments given by Wang's formula for the tolerance, stepped by forward differencing.
 static void nsvg__flattenCubicBez(NSVGrasterizer* r,
 								  float x1, float y1, float x2, float y2,
 								  float x3, float y3, float x4, float y4,
-								  int level, int type)
+								  int type)
 {
-	float x12,y12,x23,y23,x34,y34,x123,y123,x234,y234,x1234,y1234;
-	float dx,dy,d2,d3;
-
-	if (level > 10) return;
-
-	x12 = (x1+x2)*0.5f;
-	y12 = (y1+y2)*0.5f;
-	x23 = (x2+x3)*0.5f;
-	y23 = (y2+y3)*0.5f;
-	x34 = (x3+x4)*0.5f;
-	y34 = (y3+y4)*0.5f;
-	x123 = (x12+x23)*0.5f;
-	y123 = (y12+y23)*0.5f;
+	float ax,ay,bx,by,cx,cy,dx,dy,ddx,ddy,dddx,dddy,d0,d1,n2,h;
+	int i, n;
 
+	// The curve is at most 3/4 of the distance of its control points from its chord, so it is a single segment
+	// when they are near it.
 	dx = x4 - x1;
 	dy = y4 - y1;
-	d2 = nsvgr__absf((x2 - x4) * dy - (y2 - y4) * dx);
-	d3 = nsvgr__absf((x3 - x4) * dy - (y3 - y4) * dx);
-
-	if ((d2 + d3)*(d2 + d3) < r->tessTol * (dx*dx + dy*dy)) {
+	d0 = nsvgr__absf((x2 - x1) * dy - (y2 - y1) * dx);
+	d1 = nsvgr__absf((x3 - x1) * dy - (y3 - y1) * dx);
+	if (0.75f * (d0 > d1 ? d0 : d1) < r->tessTol * sqrtf(dx*dx + dy*dy)) {
 		nsvg__addPathPoint(r, x4, y4, type);
 		return;
 	}
 
-	x234 = (x23+x34)*0.5f;
-	y234 = (y23+y34)*0.5f;
-	x1234 = (x123+x234)*0.5f;
-	y1234 = (y123+y234)*0.5f;
-
-	nsvg__flattenCubicBez(r, x1,y1, x12,y12, x123,y123, x1234,y1234, level+1, 0);
-	nsvg__flattenCubicBez(r, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
+	// Otherwise the segments are within the tolerance of the curve when n^2 >= 3/4 * max|p[i] - 2p[i+1] + p[i+2]| / tolerance.
+	ddx = x1 - 2*x2 + x3;
+	ddy = y1 - 2*y2 + y3;
+	d0 = ddx*ddx + ddy*ddy;
+	ddx = x2 - 2*x3 + x4;
+	ddy = y2 - 2*y3 + y4;
+	d1 = ddx*ddx + ddy*ddy;
+	n2 = 0.75f * sqrtf(d0 > d1 ? d0 : d1) / r->tessTol;
+	if (n2 < (float)NSVG__MAXCURVESEGMENTS * NSVG__MAXCURVESEGMENTS)
+		n = (int)ceilf(sqrtf(n2));
+	else
+		n = NSVG__MAXCURVESEGMENTS;	// Also when the points are not finite.
+
+	if (n > 1) {
+		// Coefficients of the polynomial, and its differences for steps of 1/n.
+		h = 1.0f / n;
+		ax = -x1 + 3*x2 - 3*x3 + x4;
+		ay = -y1 + 3*y2 - 3*y3 + y4;
+		bx = 3*x1 - 6*x2 + 3*x3;
+		by = 3*y1 - 6*y2 + 3*y3;
+		cx = 3*(x2 - x1);
+		cy = 3*(y2 - y1);
+		dddx = 6*ax*h*h*h;
+		dddy = 6*ay*h*h*h;
+		ddx = dddx + 2*bx*h*h;
+		ddy = dddy + 2*by*h*h;
+		dx = ax*h*h*h + bx*h*h + cx*h;
+		dy = ay*h*h*h + by*h*h + cy*h;
+		for (i = 1; i < n; i++) {
+			x1 += dx;
+			y1 += dy;
+			dx += ddx;
+			dy += ddy;
+			ddx += dddx;
+			ddy += dddy;
+			nsvg__addPathPoint(r, x1, y1, 0);
+		}
+	}
+	nsvg__addPathPoint(r, x4, y4, type);
 }
 
 static void nsvg__flattenShape(NSVGrasterizer* r, NSVGshape* shape, float scale)
@@ -592,7 +1054,7 @@ static void nsvg__flattenShape(NSVGrasterizer* r, NSVGshape* shape, float scale)
 		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, 0);
 		for (i = 0; i < path->npts-1; i += 3) {
 			float* p = &path->pts[i*2];
-			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0, 0);
+			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0);
 		}
 		// Close path
 		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, 0);
@@ -961,7 +1423,7 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float
 		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, NSVG_PT_CORNER);
 		for (i = 0; i < path->npts-1; i += 3) {
 			float* p = &path->pts[i*2];
-			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0, NSVG_PT_CORNER);
+			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, NSVG_PT_CORNER);
 		}
 		if (r->npoints < 2)
 			continue;
@@ -1019,10 +1481,7 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float
 					// Calculate intermediate point
 					float d = (dashLen - totalDist) / dist;
 					if (j == r->npoints2-1) {
-						float ptdx = r->points2[j].dx;
-						float ptdy = r->points2[j].dy;
-						float dlen = sqrtf(ptdx * ptdx + ptdy * ptdy);
-						d = (d > dlen) ? dlen : d;
+						d = (d > 1.0f) ? 1.0f : d;
 					}
 					float x = cur.x + dx * d;
 					float y = cur.y + dy * d;
@@ -1063,31 +1522,9 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float
 	}
 }
 
-static int nsvg__cmpEdge(const void *p, const void *q)
-{
-	const NSVGedge* a = (const NSVGedge*)p;
-	const NSVGedge* b = (const NSVGedge*)q;
-
-	if (a->y0 < b->y0) return -1;
-	if (a->y0 > b->y0) return  1;
-	return 0;
-}
-
 
-static NSVGactiveEdge* nsvg__addActive(NSVGrasterizer* r, NSVGedge* e, float startPoint)
+static void nsvg__initActive(NSVGactiveEdge* z, NSVGedge* e, float startPoint)
 {
-	 NSVGactiveEdge* z;
-
-	if (r->freelist != NULL) {
-		// Restore from freelist.
-		z = r->freelist;
-		r->freelist = z->next;
-	} else {
-		// Alloc new edge.
-		z = (NSVGactiveEdge*)nsvg__alloc(r, sizeof(NSVGactiveEdge));
-		if (z == NULL) return NULL;
-	}
-
 	float dxdy = (e->x1 - e->x0) / (e->y1 - e->y0);
 //	STBTT_assert(e->y0 <= start_point);
 	// round dx down to avoid going too far
@@ -1097,17 +1534,46 @@ static NSVGactiveEdge* nsvg__addActive(NSVGrasterizer* r, NSVGedge* e, float sta
 		z->dx = (int)nsvg__roundf(NSVG__FIX * dxdy);
 	z->x = (int)nsvg__roundf(NSVG__FIX * (e->x0 + dxdy * (startPoint - e->y0)));
 //	z->x -= off_x * FIX;
-	z->ey = e->y1;
-	z->next = 0;
+	z->ey = (int)ceilf(e->y1 - 0.5f);
 	z->dir = e->dir;
+}
+
+static int nsvg__ceilDiv(int a, int b)
+{
+	return (a >= 0) ? (a + b - 1) / b : -(-a / b);
+}
+
+static long long nsvg__roundDiv(long long a, long long b)
+{
+	return (a >= 0) ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
 
-	return z;
+static void nsvg__initActiveCompact(NSVGactiveEdge* z, int subsamples, const NSVGcompactEdge* e, int tx, int ty, int sub)
+{
+	int x0 = e->x0 + tx, y0 = e->y0 + ty;
+	int dx = e->x1 - e->x0;
+	int dy = (e->dy < 0) ? -e->dy : e->dy;
+
+	// Slope in subsamples is dx / (dy * subsamples), distances are in units of 1/(2*NSVG__COMPACT) subsamples
+	// so that the centers of subsamples are integers.
+	z->dx = (int)nsvg__roundDiv((long long)NSVG__FIX * dx, subsamples * dy);
+	z->x = x0 * (1 << (NSVG__FIXSHIFT - NSVG__COMPACTSHIFT)) +
+		   (int)nsvg__roundDiv((long long)NSVG__FIX * dx * (2 * NSVG__COMPACT * sub + NSVG__COMPACT - 2 * subsamples * y0),
+							   2 * NSVG__COMPACT * subsamples * dy);
+	z->ey = nsvg__ceilDiv(2 * subsamples * (y0 + dy) - NSVG__COMPACT, 2 * NSVG__COMPACT);
+	z->dir = (e->dy < 0) ? -1 : 1;
 }
 
-static void nsvg__freeActive(NSVGrasterizer* r, NSVGactiveEdge* z)
+// Returns the index in the active edges where a new edge is inserted: after the edges left of it,
+// and after the first edge also when they start at the same x.
+static int nsvg__insertActiveIndex(const NSVGactiveEdge* active, int nactive, int x)
 {
-	z->next = r->freelist;
-	r->freelist = z;
+	int i = nactive;
+	while (i > 0 && active[i-1].x >= x)
+		i--;
+	if (i == 0 && nactive > 0 && active[0].x == x)
+		i = 1;
+	return i;
 }
 
 static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1, int maxWeight, int* xmin, int* xmax)
@@ -1140,14 +1606,15 @@ static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1,
 // note: this routine clips fills that extend off the edges... ideally this
 // wouldn't happen, but it could happen if the truetype glyph bounding boxes
 // are wrong, or if the user supplies a too-small bitmap
-static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEdge* e, int maxWeight, int* xmin, int* xmax, char fillRule)
+static void nsvg__fillActiveEdges(unsigned char* scanline, int len, const NSVGactiveEdge* e, int nactive, int maxWeight, int* xmin, int* xmax, char fillRule)
 {
 	// non-zero winding fill
+	const NSVGactiveEdge* end = e + nactive;
 	int x0 = 0, w = 0;
 
 	if (fillRule == NSVG_FILLRULE_NONZERO) {
 		// Non-zero
-		while (e != NULL) {
+		for (; e < end; e++) {
 			if (w == 0) {
 				// if we're currently at zero, we need to record the edge start point
 				x0 = e->x; w += e->dir;
@@ -1157,11 +1624,10 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
 				if (w == 0)
 					nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
 			}
-			e = e->next;
 		}
 	} else if (fillRule == NSVG_FILLRULE_EVENODD) {
 		// Even-odd
-		while (e != NULL) {
+		for (; e < end; e++) {
 			if (w == 0) {
 				// if we're currently at zero, we need to record the edge start point
 				x0 = e->x; w = 1;
@@ -1169,7 +1635,6 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
 				int x1 = e->x; w = 0;
 				nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
 			}
-			e = e->next;
 		}
 	}
 }
@@ -1206,225 +1671,452 @@ static inline int nsvg__div255(int x)
     return ((x+1) * 257) >> 16;
 }
 
-static void nsvg__scanlineSolid(unsigned char* dst, int count, unsigned char* cover, int x, int y,
-								float tx, float ty, float scale, NSVGcachedPaint* cache)
+// Premultiplies a color by alpha and blends it over a pixel.
+static inline void nsvg__blendPremultiplied(unsigned char* dst, int cr, int cg, int cb, int a)
 {
+	int ia = 255 - a;
 
-	if (cache->type == NSVG_PAINT_COLOR) {
-		int i, cr, cg, cb, ca;
-		cr = cache->colors[0] & 0xff;
-		cg = (cache->colors[0] >> 8) & 0xff;
-		cb = (cache->colors[0] >> 16) & 0xff;
-		ca = (cache->colors[0] >> 24) & 0xff;
-
-		for (i = 0; i < count; i++) {
-			int r,g,b;
-			int a = nsvg__div255((int)cover[0] * ca);
-			int ia = 255 - a;
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-		}
-	} else if (cache->type == NSVG_PAINT_LINEAR_GRADIENT) {
-		// TODO: spread modes.
-		// TODO: plenty of opportunities to optimize.
-		float fx, fy, dx, gy;
-		float* t = cache->xform;
-		int i, cr, cg, cb, ca;
-		unsigned int c;
-
-		fx = ((float)x - tx) / scale;
-		fy = ((float)y - ty) / scale;
-		dx = 1.0f / scale;
-
-		for (i = 0; i < count; i++) {
-			int r,g,b,a,ia;
-			gy = fx*t[1] + fy*t[3] + t[5];
-			c = cache->colors[(int)nsvg__clampf(gy*255.0f, 0, 255.0f)];
-			cr = (c) & 0xff;
-			cg = (c >> 8) & 0xff;
-			cb = (c >> 16) & 0xff;
-			ca = (c >> 24) & 0xff;
-
-			a = nsvg__div255((int)cover[0] * ca);
-			ia = 255 - a;
-
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-			fx += dx;
-		}
-	} else if (cache->type == NSVG_PAINT_RADIAL_GRADIENT) {
-		// TODO: spread modes.
-		// TODO: plenty of opportunities to optimize.
-		// TODO: focus (fx,fy)
-		float fx, fy, dx, gx, gy, gd;
-		float* t = cache->xform;
-		int i, cr, cg, cb, ca;
-		unsigned int c;
+	dst[0] = (unsigned char)(nsvg__div255(cr * a) + nsvg__div255(ia * (int)dst[0]));
+	dst[1] = (unsigned char)(nsvg__div255(cg * a) + nsvg__div255(ia * (int)dst[1]));
+	dst[2] = (unsigned char)(nsvg__div255(cb * a) + nsvg__div255(ia * (int)dst[2]));
+	dst[3] = (unsigned char)(a + nsvg__div255(ia * (int)dst[3]));
+}
 
-		fx = ((float)x - tx) / scale;
-		fy = ((float)y - ty) / scale;
-		dx = 1.0f / scale;
+#if defined(NSVG__SSE2)
+// Same as nsvg__blendPremultiplied() for two pixels, in 16-bit lanes where div255(x) is the high half of (x+1)*257.
+static inline void nsvg__blendPremultiplied2(unsigned char* dst, int cr, int cg, int cb, int a0, int a1)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi16(1);
+	__m128i m257 = _mm_set1_epi16(257);
+	__m128i c = _mm_set_epi16(255, (short)cb, (short)cg, (short)cr, 255, (short)cb, (short)cg, (short)cr);
+	__m128i a = _mm_set_epi16((short)a1, (short)a1, (short)a1, (short)a1, (short)a0, (short)a0, (short)a0, (short)a0);
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	__m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)dst), zero);
+
+	c = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(c, a), one), m257);
+	d = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(d, ia), one), m257);
+	_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(_mm_add_epi16(c, d), zero));
+}
+#elif defined(NSVG__NEON)
+// Same as nsvg__blendPremultiplied() for two pixels, in 16-bit lanes where div255(x) is (y + (y >> 8)) >> 8 with y = x+1.
+static inline void nsvg__blendPremultiplied2(unsigned char* dst, int cr, int cg, int cb, int a0, int a1)
+{
+	const uint16_t cv[8] = { (uint16_t)cr, (uint16_t)cg, (uint16_t)cb, 255, (uint16_t)cr, (uint16_t)cg, (uint16_t)cb, 255 };
+	const uint16_t av[8] = { (uint16_t)a0, (uint16_t)a0, (uint16_t)a0, (uint16_t)a0, (uint16_t)a1, (uint16_t)a1, (uint16_t)a1, (uint16_t)a1 };
+	uint16x8_t one = vdupq_n_u16(1);
+	uint16x8_t a = vld1q_u16(av);
+	uint16x8_t ia = vsubq_u16(vdupq_n_u16(255), a);
+	uint16x8_t c = vaddq_u16(vmulq_u16(vld1q_u16(cv), a), one);
+	uint16x8_t d = vaddq_u16(vmulq_u16(vmovl_u8(vld1_u8(dst)), ia), one);
+
+	c = vshrq_n_u16(vsraq_n_u16(c, c, 8), 8);
+	d = vshrq_n_u16(vsraq_n_u16(d, d, 8), 8);
+	vst1_u8(dst, vmovn_u16(vaddq_u16(c, d)));
+}
+#endif
 
-		for (i = 0; i < count; i++) {
-			int r,g,b,a,ia;
-			gx = fx*t[0] + fy*t[2] + t[4];
-			gy = fx*t[1] + fy*t[3] + t[5];
-			gd = sqrtf(gx*gx + gy*gy);
-			c = cache->colors[(int)nsvg__clampf(gd*255.0f, 0, 255.0f)];
-			cr = (c) & 0xff;
-			cg = (c >> 8) & 0xff;
-			cb = (c >> 16) & 0xff;
-			ca = (c >> 24) & 0xff;
-
-			a = nsvg__div255((int)cover[0] * ca);
-			ia = 255 - a;
-
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-			fx += dx;
-		}
+// Gradient colors along a span, stepped incrementally from one pixel to the next.
+typedef struct NSVGgradientSpan {
+	const unsigned int* colors;
+	signed char type;
+	char spread;
+	char fixed;			// Linear index is stepped in fixed point.
+	int t, dt;			// Linear index in 16.16 fixed point, and its step.
+	float tf, dtf;		// Linear index when out of the fixed point range, and its step.
+	float d, dd, ddd;	// Radial squared index, and its forward differences.
+	int s;				// Last radial index.
+} NSVGgradientSpan;
+
+// Largest radial squared index stepped with integer square roots.
+#define NSVG__MAXSQUAREDINDEX	1073741824.0f
+
+static void nsvg__initGradientSpan(NSVGgradientSpan* span, const NSVGcachedPaint* cache, int x, int y, int count,
+								   float tx, float ty, float scale)
+{
+	const float* t = cache->xform;
+	float fx = ((float)x - tx) / scale;
+	float fy = ((float)y - ty) / scale;
+	float dx = 1.0f / scale;
+
+	span->colors = cache->colors;
+	span->type = cache->type;
+	span->spread = cache->spread;
+
+	if (cache->type == NSVG_PAINT_LINEAR_GRADIENT) {
+		// The index is linear along the span, stepped with one add per pixel.
+		span->tf = (fx*t[1] + fy*t[3] + t[5]) * 255.0f;
+		span->dtf = t[1]*dx * 255.0f;
+		span->fixed = nsvgr__absf(span->tf) < 32767.0f && nsvgr__absf(span->tf + span->dtf * count) < 32767.0f;
+		span->t = (int)(span->tf * 65536.0f);
+		span->dt = (int)(span->dtf * 65536.0f);
+	} else {
+		// The squared index is quadratic along the span, stepped by forward differences.
+		float gx = fx*t[0] + fy*t[2] + t[4];
+		float gy = fx*t[1] + fy*t[3] + t[5];
+		float ax = t[0]*dx, ay = t[1]*dx;
+		span->d = 65025.0f * (gx*gx + gy*gy);
+		span->dd = 65025.0f * (2.0f*(gx*ax + gy*ay) + ax*ax + ay*ay);
+		span->ddd = 65025.0f * 2.0f * (ax*ax + ay*ay);
+		span->s = (span->d < NSVG__MAXSQUAREDINDEX) ? (int)sqrtf(span->d) : 0;
 	}
 }
 
-static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r, float tx, float ty, float scale, NSVGcachedPaint* cache, char fillRule)
+// Returns the integer square root of n, stepping the root of the previous pixel.
+static inline int nsvg__isqrtStep(int n, int s)
 {
-	NSVGactiveEdge *active = NULL;
-	int y, s;
+	if (s * s > n) {
+		s--;
+		if (s * s > n) return (int)sqrtf((float)n);
+	} else if ((s + 1) * (s + 1) <= n) {
+		s++;
+		if ((s + 1) * (s + 1) <= n) return (int)sqrtf((float)n);
+	}
+	return s;
+}
+
+// Applies the spread mode to a gradient index, where 255 is the end of the gradient.
+static inline int nsvg__spreadIndex(int i, int spread)
+{
+	if (spread == NSVG_SPREAD_REPEAT) {
+		i %= 255;
+		return (i < 0) ? i + 255 : i;
+	} else if (spread == NSVG_SPREAD_REFLECT) {
+		i %= 510;
+		i = (i < 0) ? i + 510 : i;
+		return (i > 255) ? 510 - i : i;
+	}
+	return (i < 0) ? 0 : (i > 255) ? 255 : i;
+}
+
+// Fills the gradient colors of the next pixels of the span, one loop for each kind of stepping.
+static void nsvg__gradientColors(NSVGgradientSpan* span, unsigned int* colors, int count)
+{
+	const unsigned int* ramp = span->colors;
+	int spread = span->spread;
+	int i, n;
+
+	if (span->type == NSVG_PAINT_LINEAR_GRADIENT && span->fixed) {
+		int t = span->t, dt = span->dt;
+		if (spread == NSVG_SPREAD_PAD) {
+			for (i = 0; i < count; i++, t += dt) {
+				n = t >> 16;
+				colors[i] = ramp[(n < 0) ? 0 : (n > 255) ? 255 : n];
+			}
+		} else {
+			for (i = 0; i < count; i++, t += dt)
+				colors[i] = ramp[nsvg__spreadIndex(t >> 16, spread)];
+		}
+		span->t = t;
+	} else if (span->type == NSVG_PAINT_LINEAR_GRADIENT) {
+		float t = span->tf, dt = span->dtf;
+		for (i = 0; i < count; i++, t += dt)
+			colors[i] = ramp[nsvg__spreadIndex((int)floorf(nsvg__clampf(t, -1.0e9f, 1.0e9f)), spread)];
+		span->tf = t;
+	} else {
+		float d = span->d, dd = span->dd, ddd = span->ddd;
+		int s = span->s;
+		for (i = 0; i < count; i++, d += dd, dd += ddd) {
+			if (spread == NSVG_SPREAD_PAD && d >= 65025.0f)
+				n = 255;
+			else if (d < NSVG__MAXSQUAREDINDEX)
+				n = s = nsvg__isqrtStep((d > 0) ? (int)d : 0, s);
+			else
+				n = (int)sqrtf(nsvg__clampf(d, 0, 1.0e18f));
+			colors[i] = ramp[nsvg__spreadIndex(n, spread)];
+		}
+		span->d = d;
+		span->dd = dd;
+		span->s = s;
+	}
+}
+
+// Number of gradient colors computed at a time.
+#define NSVG__GRADIENTBATCH	64
+
+static void nsvg__scanlineSolid(unsigned char* dst, int count, unsigned char* cover, int x, int y,
+								float tx, float ty, float scale, const NSVGcachedPaint* cache)
+{
+
+	if (cache->type == NSVG_PAINT_COLOR) {
+		int i, cr, cg, cb, ca;
+		cr = cache->color & 0xff;
+		cg = (cache->color >> 8) & 0xff;
+		cb = (cache->color >> 16) & 0xff;
+		ca = (cache->color >> 24) & 0xff;
+
+		for (i = 0; i < count; ) {
+			// Uncovered pixels are left as is, runs of covered opaque pixels are written without blending.
+			if (cover[i] == 0) {
+				i++;
+			} else if (cover[i] == 255 && ca == 255) {
+				for (; i < count && cover[i] == 255; i++) {
+					dst[i*4+0] = (unsigned char)cr;
+					dst[i*4+1] = (unsigned char)cg;
+					dst[i*4+2] = (unsigned char)cb;
+					dst[i*4+3] = 255;
+				}
+#if defined(NSVG__SSE2) || defined(NSVG__NEON)
+			} else if (i + 1 < count) {
+				nsvg__blendPremultiplied2(&dst[i*4], cr, cg, cb, nsvg__div255((int)cover[i] * ca), nsvg__div255((int)cover[i+1] * ca));
+				i += 2;
+#endif
+			} else {
+				nsvg__blendPremultiplied(&dst[i*4], cr, cg, cb, nsvg__div255((int)cover[i] * ca));
+				i++;
+			}
+		}
+	} else if (cache->type == NSVG_PAINT_LINEAR_GRADIENT || cache->type == NSVG_PAINT_RADIAL_GRADIENT) {
+		// TODO: focus (fx,fy)
+		NSVGgradientSpan span;
+		unsigned int colors[NSVG__GRADIENTBATCH];
+		int i, j, n, cr, cg, cb, ca;
+		unsigned int c;
+
+		nsvg__initGradientSpan(&span, cache, x, y, count, tx, ty, scale);
+
+		for (i = 0; i < count; i += n) {
+			n = (count - i < NSVG__GRADIENTBATCH) ? count - i : NSVG__GRADIENTBATCH;
+			nsvg__gradientColors(&span, colors, n);
+			for (j = 0; j < n; j++) {
+				c = colors[j];
+				cr = (c) & 0xff;
+				cg = (c >> 8) & 0xff;
+				cb = (c >> 16) & 0xff;
+				ca = (c >> 24) & 0xff;
+
+				if (cover[0] != 0)
+					nsvg__blendPremultiplied(dst, cr, cg, cb, nsvg__div255((int)cover[0] * ca));
+
+				cover++;
+				dst += 4;
+			}
+		}
+	}
+}
+
+// Returns the alpha of a pixel covered by a paint, and sets its color.
+static inline int nsvg__coverAlpha(unsigned int c, int cover, int aliased)
+{
+	if (aliased) cover = (cover > 127) ? 255 : 0;
+	if (cover == 0) return 0;
+	return nsvg__div255(cover * (int)(c >> 24));
+}
+
+static inline void nsvg__blendRGB565(unsigned char* dst, unsigned int c, int a, int swap)
+{
+	unsigned short d = *(unsigned short*)dst;
+	int r, g, b, ia = 255 - a;
+
+	// Opaque pixels replace the destination, the same as blending.
+	if (a == 255) {
+		d = (unsigned short)(((c & 0xf8) << 8) | ((c >> 5) & 0x7e0) | ((c >> 19) & 0x1f));
+		*(unsigned short*)dst = swap ? (unsigned short)((d << 8) | (d >> 8)) : d;
+		return;
+	}
+
+	if (swap) d = (unsigned short)((d << 8) | (d >> 8));
+	r = nsvg__div255((int)(c & 0xff) * a + ((d >> 8) & 0xf8) * ia);
+	g = nsvg__div255((int)((c >> 8) & 0xff) * a + ((d >> 3) & 0xfc) * ia);
+	b = nsvg__div255((int)((c >> 16) & 0xff) * a + ((d << 3) & 0xf8) * ia);
+	d = (unsigned short)(((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3));
+	if (swap) d = (unsigned short)((d << 8) | (d >> 8));
+	*(unsigned short*)dst = d;
+}
+
+static inline void nsvg__blendBGRA8888(unsigned char* dst, unsigned int c, int a)
+{
+	int ia = 255 - a;
+
+	// Opaque pixels replace the destination, the same as blending.
+	if (a == 255) {
+		dst[0] = (unsigned char)(c >> 16);
+		dst[1] = (unsigned char)(c >> 8);
+		dst[2] = (unsigned char)c;
+		dst[3] = 255;
+		return;
+	}
+
+	dst[0] = (unsigned char)nsvg__div255((int)((c >> 16) & 0xff) * a + dst[0] * ia);
+	dst[1] = (unsigned char)nsvg__div255((int)((c >> 8) & 0xff) * a + dst[1] * ia);
+	dst[2] = (unsigned char)nsvg__div255((int)(c & 0xff) * a + dst[2] * ia);
+	dst[3] = (unsigned char)(a + nsvg__div255(dst[3] * ia));
+}
+
+// Blends the coverage of a scanline straight into destination pixels, one loop for each pixel writer.
+// The colors are indexed by colorStep, 0 for a solid color and 1 for a color per pixel.
+static void nsvg__blendFormat(unsigned char* dst, int count, unsigned char* cover, const unsigned int* colors, int colorStep, int format)
+{
+	int aliased = format & NSVG_RAST_FORMAT_ALIASED;
+	unsigned int c;
+	int i, a;
+
+	switch (format & NSVG_RAST_FORMAT_MASK) {
+	case NSVG_RAST_FORMAT_RGB565:
+		for (i = 0; i < count; i++) {
+			c = colors[i * colorStep];
+			a = nsvg__coverAlpha(c, cover[i], aliased);
+			if (a != 0) nsvg__blendRGB565(&dst[i * 2], c, a, 0);
+		}
+		break;
+	case NSVG_RAST_FORMAT_RGB565_SWAPPED:
+		for (i = 0; i < count; i++) {
+			c = colors[i * colorStep];
+			a = nsvg__coverAlpha(c, cover[i], aliased);
+			if (a != 0) nsvg__blendRGB565(&dst[i * 2], c, a, 1);
+		}
+		break;
+	case NSVG_RAST_FORMAT_BGRA8888:
+		for (i = 0; i < count; i++) {
+			c = colors[i * colorStep];
+			a = nsvg__coverAlpha(c, cover[i], aliased);
+			if (a != 0) nsvg__blendBGRA8888(&dst[i * 4], c, a);
+		}
+		break;
+	}
+}
+
+static void nsvg__scanlineFormat(unsigned char* dst, int count, unsigned char* cover, int x, int y,
+								 float tx, float ty, float scale, const NSVGcachedPaint* cache, int format)
+{
+	NSVGgradientSpan span;
+	unsigned int colors[NSVG__GRADIENTBATCH];
+	int pitch = ((format & NSVG_RAST_FORMAT_MASK) == NSVG_RAST_FORMAT_BGRA8888) ? 4 : 2;
+	int i, n;
+
+	if (cache->type == NSVG_PAINT_COLOR) {
+		nsvg__blendFormat(dst, count, cover, &cache->color, 0, format);
+		return;
+	}
+
+	// Gradients are stepped for every pixel, covered or not.
+	nsvg__initGradientSpan(&span, cache, x, y, count, tx, ty, scale);
+	for (i = 0; i < count; i += n) {
+		n = (count - i < NSVG__GRADIENTBATCH) ? count - i : NSVG__GRADIENTBATCH;
+		nsvg__gradientColors(&span, colors, n);
+		nsvg__blendFormat(&dst[i * pitch], n, &cover[i], colors, 1, format);
+	}
+}
+
+static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r, const NSVGedge* edges, const NSVGcompactEdge* compactEdges, int nedges,
+									   float tx, float ty, float scale, const NSVGcachedPaint* cache, char fillRule, float ymin, float ymax)
+{
+	NSVGactiveEdge *active;
+	int nactive = 0;
+	int y, s, i, j;
 	int e = 0;
-	int maxWeight = (255 / NSVG__SUBSAMPLES);  // weight per vertical scanline
-	int xmin, xmax;
+	int ctx = (int)nsvg__roundf(tx * NSVG__COMPACT), cty = (int)nsvg__roundf(ty * NSVG__COMPACT);
+	int subsamples = r->subsamples;
+	int maxWeight = (255 / subsamples);  // weight per vertical scanline
+	int xmin, xmax, clearmin, clearmax;
 
 	int ystart = (-ty < r->viewymin) ? r->viewymin + ty : 0;
 	int yend = (r->height - ty > r->viewymax) ? r->viewymax + ty : r->height;
 	int xstart = (-tx < r->viewxmin) ? r->viewxmin + tx : 0;
 	int xend = (r->width - tx > r->viewxmax) ? r->viewxmax + tx : r->width;
 
+	// Skip rows outside the vertical extent of the edges.
+	if (ymin + ty > ystart) ystart = (int)floorf(ymin + ty);
+	if (ymax + ty < yend) yend = (int)ceilf(ymax + ty);
+
+	// The active edges are at most the edges of the shape, so the table is only enlarged for a larger shape.
+	if (nedges > r->cactive) {
+		active = (NSVGactiveEdge*)nsvgr__realloc(r, r->active, sizeof(NSVGactiveEdge) * nedges, sizeof(NSVGactiveEdge) * r->cactive);
+		if (active == NULL) return;
+		r->active = active;
+		r->cactive = nedges;
+		NSVG__STAT(r->stats.activeGrows++);
+	}
+	active = r->active;
+
 	for (y = ystart; y < yend; y++) {
-		memset(r->scanline, 0, r->width);
 		xmin = r->width;
 		xmax = 0;
-		for (s = 0; s < NSVG__SUBSAMPLES; ++s) {
+		for (s = 0; s < subsamples; ++s) {
 			// find center of pixel for this scanline
-			float scany = (float)(y*NSVG__SUBSAMPLES + s) + 0.5f;
-			NSVGactiveEdge **step = &active;
+			int sub = y*subsamples + s;
+			float scany = (float)sub + 0.5f;
 
 			// update all active edges;
 			// remove all active edges that terminate before the center of this scanline
-			while (*step) {
-				NSVGactiveEdge *z = *step;
-				if (z->ey <= scany) {
-					*step = z->next; // delete from list
-//					NSVG__assert(z->valid);
-					nsvg__freeActive(r, z);
-				} else {
-					z->x += z->dx; // advance to position for current scanline
-					step = &((*step)->next); // advance through list
+			for (i = 0, j = 0; i < nactive; i++) {
+				if (active[i].ey > sub) {
+					active[j] = active[i];
+					active[j].x += active[j].dx; // advance to position for current scanline
+					j++;
 				}
 			}
-
-			// resort the list if needed
-			for (;;) {
-				int changed = 0;
-				step = &active;
-				while (*step && (*step)->next) {
-					if ((*step)->x > (*step)->next->x) {
-						NSVGactiveEdge* t = *step;
-						NSVGactiveEdge* q = t->next;
-						t->next = q->next;
-						q->next = t;
-						*step = q;
-						changed = 1;
-					}
-					step = &(*step)->next;
-				}
-				if (!changed) break;
+			nactive = j;
+
+			// resort the table, the edges move little between scanlines so insertion sort is near linear
+			for (i = 1; i < nactive; i++) {
+				NSVGactiveEdge t = active[i];
+				for (j = i; j > 0 && active[j-1].x > t.x; j--)
+					active[j] = active[j-1];
+				active[j] = t;
 			}
 
 			// insert all edges that start before the center of this scanline -- omit ones that also end on this scanline
-			while (e < r->nedges && r->edges[e].y0 <= scany) {
-				if (r->edges[e].y1 > scany) {
-					NSVGactiveEdge* z = nsvg__addActive(r, &r->edges[e], scany);
-					if (z == NULL) break;
-					// find insertion point
-					if (active == NULL) {
-						active = z;
-					} else if (z->x < active->x) {
-						// insert at front
-						z->next = active;
-						active = z;
-					} else {
-						// find thing to insert AFTER
-						NSVGactiveEdge* p = active;
-						while (p->next && p->next->x < z->x)
-							p = p->next;
-						// at this point, p->next->x is NOT < z->x
-						z->next = p->next;
-						p->next = z;
+			// edges are translated and scaled to subsamples as they are reached
+			if (compactEdges != NULL) {
+				// compact edges are compared in units of 1/(2*NSVG__COMPACT) subsamples
+				while (e < nedges && 2 * subsamples * (compactEdges[e].y0 + cty) <= 2 * NSVG__COMPACT * sub + NSVG__COMPACT) {
+					const NSVGcompactEdge* ce = &compactEdges[e];
+					int dy = (ce->dy < 0) ? -ce->dy : ce->dy;
+					if (2 * subsamples * (ce->y0 + cty + dy) > 2 * NSVG__COMPACT * sub + NSVG__COMPACT) {
+						NSVGactiveEdge z;
+						nsvg__initActiveCompact(&z, subsamples, ce, ctx, cty, sub);
+						i = nsvg__insertActiveIndex(active, nactive, z.x);
+						memmove(&active[i+1], &active[i], sizeof(NSVGactiveEdge) * (nactive - i));
+						active[i] = z;
+						nactive++;
+					}
+					e++;
+				}
+			} else {
+				while (e < nedges && (ty + edges[e].y0) * subsamples <= scany) {
+					NSVGedge edge;
+					edge.y1 = (ty + edges[e].y1) * subsamples;
+					if (edge.y1 > scany) {
+						NSVGactiveEdge z;
+						edge.x0 = tx + edges[e].x0;
+						edge.y0 = (ty + edges[e].y0) * subsamples;
+						edge.x1 = tx + edges[e].x1;
+						edge.dir = edges[e].dir;
+						nsvg__initActive(&z, &edge, scany);
+						i = nsvg__insertActiveIndex(active, nactive, z.x);
+						memmove(&active[i+1], &active[i], sizeof(NSVGactiveEdge) * (nactive - i));
+						active[i] = z;
+						nactive++;
 					}
+					e++;
 				}
-				e++;
 			}
 
+			NSVG__STAT(if (nactive > r->stats.maxActiveEdges) r->stats.maxActiveEdges = nactive);
+
 			// now process all active edges in non-zero fashion
-			if (active != NULL)
-				nsvg__fillActiveEdges(r->scanline, r->width, active, maxWeight, &xmin, &xmax, fillRule);
+			if (nactive > 0)
+				nsvg__fillActiveEdges(r->scanline, r->width, active, nactive, maxWeight, &xmin, &xmax, fillRule);
 		}
 		// Blit
 		if (xmin < 0) xmin = 0;
-		if (xmin < xstart) xmin = xstart;
 		if (xmax > r->width-1) xmax = r->width-1;
+		clearmin = xmin;
+		clearmax = xmax;
+		if (xmin < xstart) xmin = xstart;
 		if (xmax > xend-1) xmax = xend-1;
-		if (xmin <= xmax) {
+		NSVG__STAT(if (xmin <= xmax) r->stats.pixels += xmax-xmin+1);
+		if (xmin <= xmax && r->format == NSVG_RAST_FORMAT_RGBA) {
 			nsvg__scanlineSolid(&r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scale, cache);
+		} else if (xmin <= xmax) {
+			int pitch = ((r->format & NSVG_RAST_FORMAT_MASK) == NSVG_RAST_FORMAT_BGRA8888) ? 4 : 2;
+			nsvg__scanlineFormat(&r->bitmap[y * r->stride] + xmin*pitch, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scale, cache, r->format);
 		}
+
+		// Clear only the span touched by the edges, instead of the whole scanline for every row.
+		if (clearmin <= clearmax)
+			memset(&r->scanline[clearmin], 0, clearmax - clearmin + 1);
 	}
 
 }
@@ -1438,7 +2130,8 @@ static void nsvg__unpremultiplyAlpha(unsigned char* image, int w, int h, int str
 		unsigned char *row = &image[y*stride];
 		for (x = 0; x < w; x++) {
 			int r = row[0], g = row[1], b = row[2], a = row[3];
-			if (a != 0) {
+			// Opaque pixels are the same unpremultiplied.
+			if (a != 0 && a != 255) {
 				row[0] = (unsigned char)(r*255/a);
 				row[1] = (unsigned char)(g*255/a);
 				row[2] = (unsigned char)(b*255/a);
@@ -1497,7 +2190,7 @@ static void nsvg__initPaint(NSVGcachedPaint* cache, NSVGpaint* paint, float opac
 	cache->type = paint->type;
 
 	if (paint->type == NSVG_PAINT_COLOR) {
-		cache->colors[0] = nsvg__applyOpacity(paint->color, opacity);
+		cache->color = nsvg__applyOpacity(paint->color, opacity);
 		return;
 	}
 
@@ -1550,20 +2243,6 @@ static void nsvg__initPaint(NSVGcachedPaint* cache, NSVGpaint* paint, float opac
 
 }
 
-static void nsvg__scaleAndTranslateEdges(NSVGrasterizer *r, float tx, float ty, float scale)
-{
-	NSVGedge *e = NULL;
-	int i;
-
-	for (i = 0; i < r->nedges; i++) {
-		e = &r->edges[i];
-		e->x0 = tx + e->x0;
-		e->y0 = (ty + e->y0) * scale;
-		e->x1 = tx + e->x1;
-		e->y1 = (ty + e->y1) * scale;
-	}
-}
-
 static void nsvg__prepareShapeFillEdges(NSVGrasterizer* r, NSVGshape* shape, float scale, NSVGcachedPaint* cache)
 {
 	NSVGedge *e = NULL;
@@ -1649,7 +2328,8 @@ void nsvgRasterize(NSVGrasterizer* r,
 	NSVGshapeNode *shapeNode = NULL;
 	NSVGshape *shape;
 	NSVGcachedPaint cache;
-	int i;
+	unsigned int colors[256];
+	float ymin, ymax;
 
 	r->bitmap = dst;
 	r->width = w;
@@ -1659,42 +2339,61 @@ void nsvgRasterize(NSVGrasterizer* r,
 	r->viewxmax = (image->viewMinx + image->viewWidth) * scale;
 	r->viewymin = image->viewMiny * scale;
 	r->viewymax = (image->viewMiny + image->viewHeight) * scale;
+	NSVG__STAT(r->stats.bands++);
+
+	// Shapes outside the destination are skipped, and edges are clipped to it with a pixel for antialiasing.
+	r->clip = 1;
+	r->clipxmin = -tx - 1;
+	r->clipymin = -ty - 1;
+	r->clipxmax = w - tx + 1;
+	r->clipymax = h - ty + 1;
 
 	if (w > r->cscanline) {
 		r->scanline = (unsigned char*)nsvgr__realloc(r, r->scanline, w, r->cscanline);
 		r->cscanline = w;
 		if (r->scanline == NULL) return;
+		// The scanline is kept cleared between rows.
+		memset(r->scanline, 0, w);
 	}
+	cache.colors = colors;
 
 	for (shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
 		shape  = shapeNode->shape;
 		if (shape == NULL) continue;
 
-		if (!(shape->flags & NSVG_FLAGS_VISIBLE))
+		if (!(shape->flags & NSVG_FLAGS_VISIBLE) || nsvg__isShapeClipped(r, shape, scale))
 			continue;
+		NSVG__STAT(r->stats.shapes++);
 
 		if (shape->fill.type != NSVG_PAINT_NONE) {
 			nsvg__prepareShapeFillEdges(r, shape, scale, &cache);
-			nsvg__scaleAndTranslateEdges(r, tx, ty, NSVG__SUBSAMPLES);
+			nsvg__clipEdges(r);
+			NSVG__STAT(r->stats.edges += r->nedges);
+			NSVG__STAT(r->stats.edgesVisited += r->nedges);
+			if (r->nedges != 0) {
+				nsvg__edgesExtent(r->edges, r->nedges, &ymin, &ymax);
 
-			nsvg__resetPool(r);
-			r->freelist = NULL;
-
-			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, shape->fillRule);
+				nsvg__rasterizeSortedEdges(r, r->edges, NULL, r->nedges, tx,ty,scale, &cache, shape->fillRule, ymin, ymax);
+			}
 		}
 		if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f) {
 			nsvg__prepareShapeStrokeEdges(r, shape, scale, &cache);
-			nsvg__scaleAndTranslateEdges(r, tx, ty, NSVG__SUBSAMPLES);
+			nsvg__clipEdges(r);
+			NSVG__STAT(r->stats.edges += r->nedges);
+			NSVG__STAT(r->stats.edgesVisited += r->nedges);
+			if (r->nedges != 0) {
+				nsvg__edgesExtent(r->edges, r->nedges, &ymin, &ymax);
 
-			nsvg__resetPool(r);
-			r->freelist = NULL;
-
-			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, NSVG_FILLRULE_NONZERO);
+				nsvg__rasterizeSortedEdges(r, r->edges, NULL, r->nedges, tx,ty,scale, &cache, NSVG_FILLRULE_NONZERO, ymin, ymax);
+			}
 		}
 	}
 
-	nsvg__unpremultiplyAlpha(dst, w, h, stride);
+	// Only the RGBA destination is premultiplied while rasterizing.
+	if (r->format == NSVG_RAST_FORMAT_RGBA)
+		nsvg__unpremultiplyAlpha(dst, w, h, stride);
 
+	r->clip = 0;
 	r->bitmap = NULL;
 	r->width = 0;
 	r->height = 0;
@@ -1709,57 +2408,600 @@ void nsvgRasterize(NSVGrasterizer* r,
 //   scale - image scale
 void nsvgRasterizePrepare(NSVGrasterizer* r, NSVGimage* image, float scale)
 {
-	NSVGrasterizedShape *rShape = NULL;
+	if (r->prepared == NULL) {
+		r->prepared = nsvgCreateRasterizedImage();
+		if (r->prepared == NULL) return;
+	}
+
+	// The context may prepare any image, so everything is prepared again.
+	r->prepared->image = NULL;
+	nsvgRasterizePrepareImage(r, r->prepared, image, scale);
+}
+
+static void nsvgr__xformMultiply(float* t, const float* s)
+{
+	float t0 = t[0] * s[0] + t[1] * s[2];
+	float t2 = t[2] * s[0] + t[3] * s[2];
+	float t4 = t[4] * s[0] + t[5] * s[2] + s[4];
+	t[1] = t[0] * s[1] + t[1] * s[3];
+	t[3] = t[2] * s[1] + t[3] * s[3];
+	t[5] = t[4] * s[1] + t[5] * s[3] + s[5];
+	t[0] = t0;
+	t[2] = t2;
+	t[4] = t4;
+}
+
+static int nsvgr__xformInverse(float* inv, const float* t)
+{
+	double invdet, det = (double)t[0] * t[3] - (double)t[2] * t[1];
+	if (det > -1e-6 && det < 1e-6)
+		return 0;
+	invdet = 1.0 / det;
+	inv[0] = (float)(t[3] * invdet);
+	inv[2] = (float)(-t[2] * invdet);
+	inv[4] = (float)(((double)t[2] * t[5] - (double)t[3] * t[4]) * invdet);
+	inv[1] = (float)(-t[1] * invdet);
+	inv[3] = (float)(t[0] * invdet);
+	inv[5] = (float)(((double)t[1] * t[4] - (double)t[0] * t[5]) * invdet);
+	return 1;
+}
+
+static int nsvgr__nearlyEqual(float a, float b)
+{
+	return nsvgr__absf(a - b) <= 1e-3f * nsvgr__absf(b);
+}
+
+static void nsvg__getShapeTransform(NSVGshape* shape, NSVGimage* image, float scale, float* t)
+{
+	int i;
+
+	// The paths are transformed by the shape transform, then to the viewbox and scaled.
+	memcpy(t, shape->xform, sizeof(float) * 6);
+	nsvgr__xformMultiply(t, image->viewXform);
+	for (i = 0; i < 6; i++)
+		t[i] *= scale;
+}
+
+static void nsvg__transformBaseEdges(NSVGrasterizer* r, const NSVGedge* edges, int nedges, const float* t)
+{
+	int i;
+
+	r->nedges = 0;
+	for (i = 0; i < nedges; i++) {
+		const NSVGedge* e = &edges[i];
+		float x0 = e->x0 * t[0] + e->y0 * t[2] + t[4];
+		float y0 = e->x0 * t[1] + e->y0 * t[3] + t[5];
+		float x1 = e->x1 * t[0] + e->y1 * t[2] + t[4];
+		float y1 = e->x1 * t[1] + e->y1 * t[3] + t[5];
+		if (e->dir > 0)
+			nsvg__addEdge(r, x0, y0, x1, y1);
+		else
+			nsvg__addEdge(r, x1, y1, x0, y0);
+	}
+
+	if (r->nedges != 0)
+		qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+}
+
+static int nsvg__isPaintOpaque(const NSVGcachedPaint* cache)
+{
+	int i;
+
+	if (cache->type == NSVG_PAINT_COLOR)
+		return (cache->color >> 24) == 255;
+	if (cache->type != NSVG_PAINT_LINEAR_GRADIENT && cache->type != NSVG_PAINT_RADIAL_GRADIENT)
+		return 0;
+	for (i = 0; i < 256; i++) {
+		if ((cache->colors[i] >> 24) != 255)
+			return 0;
+	}
+	return 1;
+}
+
+// Returns whether a part of the edge is in the rectangle, clipping it to the rectangle (Liang-Barsky).
+static int nsvg__edgeInRect(const NSVGedge* e, float xmin, float ymin, float xmax, float ymax)
+{
+	float p[4], q[4], t, t0 = 0, t1 = 1;
+	int i;
+
+	p[0] = e->x0 - e->x1;	q[0] = e->x0 - xmin;
+	p[1] = e->x1 - e->x0;	q[1] = xmax - e->x0;
+	p[2] = e->y0 - e->y1;	q[2] = e->y0 - ymin;
+	p[3] = e->y1 - e->y0;	q[3] = ymax - e->y0;
+	for (i = 0; i < 4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0) return 0;
+			continue;
+		}
+		t = q[i] / p[i];
+		if (p[i] < 0 && t > t0) t0 = t;
+		if (p[i] > 0 && t < t1) t1 = t;
+		if (t0 > t1) return 0;
+	}
+	return 1;
+}
+
+// Finds a rectangle covered with opaque pixels by the fill edges in the context, around the center of their extent.
+// No edge is in the rectangle, so its winding is the same everywhere, and it is filled if its center is.
+static void nsvg__prepareOpaque(NSVGrasterizer* r, NSVGrasterizedShape* rShape, char fillRule)
+{
+	static const float sizes[] = { 1.0f, 0.9f, 0.7f, 0.5f };
+	NSVGedge* e;
+	float xmin, ymin, xmax, ymax, cx, cy, hw, hh;
+	int i, k, winding;
+
+	rShape->opaque = 0;
+	if (r->nedges == 0 || !nsvg__isPaintOpaque(&rShape->fillCache))
+		return;
+
+	xmin = xmax = r->edges[0].x0;
+	ymin = ymax = r->edges[0].y0;
+	for (i = 0; i < r->nedges; i++) {
+		e = &r->edges[i];
+		xmin = (e->x0 < xmin) ? e->x0 : xmin;
+		xmin = (e->x1 < xmin) ? e->x1 : xmin;
+		xmax = (e->x0 > xmax) ? e->x0 : xmax;
+		xmax = (e->x1 > xmax) ? e->x1 : xmax;
+		ymin = (e->y0 < ymin) ? e->y0 : ymin;
+		ymax = (e->y1 > ymax) ? e->y1 : ymax;
+	}
+	cx = (xmin + xmax) * 0.5f;
+	cy = (ymin + ymax) * 0.5f;
+
+	// Winding of the center, from the edges crossing a ray to the right of it.
+	winding = 0;
+	for (i = 0; i < r->nedges; i++) {
+		e = &r->edges[i];
+		if (e->y0 <= cy && cy < e->y1 && nsvg__edgeXAt(e, cy) > cx)
+			winding += e->dir;
+	}
+	if (fillRule == NSVG_FILLRULE_EVENODD ? (winding & 1) == 0 : winding == 0)
+		return;
+
+	// The rectangle is a pixel smaller, so it stays covered after the edges are rounded and stepped.
+	for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++) {
+		hw = (xmax - xmin) * 0.5f * sizes[k] - 1;
+		hh = (ymax - ymin) * 0.5f * sizes[k] - 1;
+		if (hw <= 0 || hh <= 0)
+			return;
+		for (i = 0; i < r->nedges && !nsvg__edgeInRect(&r->edges[i], cx - hw, cy - hh, cx + hw, cy + hh); i++)
+			;
+		if (i == r->nedges) {
+			rShape->opaque = 1;
+			rShape->opaquexmin = cx - hw;
+			rShape->opaqueymin = cy - hh;
+			rShape->opaquexmax = cx + hw;
+			rShape->opaqueymax = cy + hh;
+			return;
+		}
+	}
+}
+
+// Prepares a shape changed by animation from its base edges, returns false if it needs to be flattened again.
+static int nsvg__prepareShapeTransformed(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGrasterizedShape* rShape, float scale)
+{
+	NSVGshape* shape = rShape->shape;
+	NSVGshapeBase* base = &rImage->bases[rShape->base];
+	float t[6], delta[6], f, det, disc, smin, smax;
+
+	// The stroke must be the same, only the transform may change.
+	if (!nsvgr__nearlyEqual(shape->strokeWidth, base->strokeWidth) || !nsvgr__nearlyEqual(shape->strokeDashOffset, base->strokeDashOffset) ||
+		shape->strokeDashCount != base->strokeDashCount ||
+		memcmp(shape->strokeDashArray, base->strokeDashArray, sizeof(float) * shape->strokeDashCount) != 0)
+		return 0;
+
+	// Transform from the base edges to the current edges.
+	if (!nsvgr__xformInverse(delta, base->xform))
+		return 0;
+	nsvg__getShapeTransform(shape, rImage->image, scale, t);
+	nsvgr__xformMultiply(delta, t);
+
+	// Flattened curves stay within the tolerance unless scaled up too much, and strokes can only move rigidly.
+	f = delta[0]*delta[0] + delta[1]*delta[1] + delta[2]*delta[2] + delta[3]*delta[3];
+	det = delta[0]*delta[3] - delta[1]*delta[2];
+	disc = f*f - 4*det*det;
+	disc = (disc > 0) ? sqrtf(disc) : 0;
+	smax = sqrtf((f + disc) * 0.5f);
+	smin = (f > disc) ? sqrtf((f - disc) * 0.5f) : 0;
+	if (smax > NSVG__MAXDELTASCALE)
+		return 0;
+	if (base->nstrokeEdges > 0 && (smax > 1.001f || smin < 0.999f))
+		return 0;
+
+	nsvg__transformBaseEdges(r, &rImage->baseEdges[base->fillOffset], base->nfillEdges, delta);
+	if (shape->fill.type != NSVG_PAINT_NONE)
+		nsvg__initPaint(&rShape->fillCache, &shape->fill, shape->opacity);
+	nsvg__prepareOpaque(r, rShape, shape->fillRule);
+	nsvg__copyEdgesToList(r, rImage, &rShape->fillEdges);
+
+	nsvg__transformBaseEdges(r, &rImage->baseEdges[base->strokeOffset], base->nstrokeEdges, delta);
+	if (base->nstrokeEdges > 0)
+		nsvg__initPaint(&rShape->strokeCache, &shape->stroke, shape->opacity);
+	nsvg__copyEdgesToList(r, rImage, &rShape->strokeEdges);
+
+	return 1;
+}
+
+static void nsvg__prepareShape(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGrasterizedShape* rShape, float scale, int changed)
+{
+	NSVGshape* shape = rShape->shape;
+	NSVGshapeBase* base = NULL;
+
+	rShape->generation = shape->generation;
+	if (!(shape->flags & NSVG_FLAGS_VISIBLE))
+		return;
+
+	// A shape outside the clip rectangle releases its previous edges, its base is kept for when it is changed again.
+	if (nsvg__isShapeClipped(r, shape, scale)) {
+		r->nedges = 0;
+		rShape->opaque = 0;
+		nsvg__copyEdgesToList(r, rImage, &rShape->fillEdges);
+		nsvg__copyEdgesToList(r, rImage, &rShape->strokeEdges);
+		return;
+	}
+	NSVG__STAT(r->stats.shapes++);
+
+	// A shape changed by animation is transformed from its base edges when possible.
+	if (changed && rShape->base >= 0 && nsvg__prepareShapeTransformed(r, rImage, rShape, scale))
+		return;
+
+	// Otherwise its flattened edges become the new base, including horizontal edges which may not stay horizontal.
+	if (changed && rShape->base < 0 && nsvg__reserveBases(rImage, 1)) {
+		rShape->base = rImage->nbases++;
+		memset(&rImage->bases[rShape->base], 0, sizeof(NSVGshapeBase));
+	}
+	if (changed && rShape->base >= 0) {
+		base = &rImage->bases[rShape->base];
+		nsvg__getShapeTransform(shape, rImage->image, scale, base->xform);
+		base->strokeWidth = shape->strokeWidth;
+		base->strokeDashOffset = shape->strokeDashOffset;
+		base->strokeDashCount = shape->strokeDashCount;
+		memcpy(base->strokeDashArray, shape->strokeDashArray, sizeof(base->strokeDashArray));
+	}
+	r->keepHorizontal = (base != NULL);
+
+	// Lists without edges, like a stroke animated to zero width, release their previous edges.
+	r->nedges = 0;
+	if (shape->fill.type != NSVG_PAINT_NONE)
+		nsvg__prepareShapeFillEdges(r, shape, scale, &rShape->fillCache);
+	if (base != NULL) {
+		if (!nsvg__copyBaseEdges(r, rImage, &base->fillOffset, &base->nfillEdges))
+			rShape->base = -1;
+		nsvg__removeHorizontalEdges(r);
+	}
+	nsvg__prepareOpaque(r, rShape, shape->fillRule);
+	nsvg__copyEdgesToList(r, rImage, &rShape->fillEdges);
+
+	r->nedges = 0;
+	if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f)
+		nsvg__prepareShapeStrokeEdges(r, shape, scale, &rShape->strokeCache);
+	if (base != NULL) {
+		if (!nsvg__copyBaseEdges(r, rImage, &base->strokeOffset, &base->nstrokeEdges))
+			rShape->base = -1;
+		nsvg__removeHorizontalEdges(r);
+	}
+	nsvg__copyEdgesToList(r, rImage, &rShape->strokeEdges);
+
+	r->keepHorizontal = 0;
+}
+
+static int nsvg__isGradient(NSVGpaint* paint)
+{
+	return paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT;
+}
+
+// Returns whether only the changed shapes of the image need to be prepared again.
+static int nsvg__canPrepareChanged(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGimage* image, float scale)
+{
 	NSVGshapeNode* shapeNode;
 	NSVGshape* shape;
 	int i;
 
-	// Free all edge lists used in previous shapes.
-	for (i = 0; i < r->nshapes; i++) {
-		nsvg__freeEdgeList(r, &r->shapes[i].fillEdges);
-		nsvg__freeEdgeList(r, &r->shapes[i].strokeEdges);
+	if (rImage->image != image || rImage->scale != scale || rImage->flags != r->flags || rImage->tessTol != r->tessTol)
+		return 0;
+
+	// Clipped shapes and edges are only complete within their clip rectangle.
+	if (rImage->clipped && (!r->clip || r->clipxmin < rImage->clipxmin || r->clipymin < rImage->clipymin ||
+							r->clipxmax > rImage->clipxmax || r->clipymax > rImage->clipymax))
+		return 0;
+
+	// Compact the prepared edges by preparing everything again when too many are unused.
+	if (rImage->nunusedEdges * 2 > rImage->nshapeEdges + rImage->ncompactEdges || rImage->nunusedBuckets * 2 > rImage->nbuckets ||
+		rImage->nunusedBaseEdges * 2 > rImage->nbaseEdges)
+		return 0;
+
+	// Shapes and their gradient colors must be where they were prepared.
+	for (i = 0, shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		shape = shapeNode->shape;
+		if (shape == NULL) continue;
+		if (i >= rImage->nshapes || rImage->shapes[i].shape != shape ||
+			nsvg__isGradient(&shape->fill) != (rImage->shapes[i].fillCache.colors != NULL) ||
+			nsvg__isGradient(&shape->stroke) != (rImage->shapes[i].strokeCache.colors != NULL))
+			return 0;
+		i++;
+	}
+	return i == rImage->nshapes;
+}
+
+static void nsvg__setPreparedClip(NSVGrasterizer* r, NSVGrasterizedImage* rImage)
+{
+	if (!r->clipped)
+		return;
+	rImage->clipped = 1;
+	rImage->clipxmin = r->clipxmin;
+	rImage->clipymin = r->clipymin;
+	rImage->clipxmax = r->clipxmax;
+	rImage->clipymax = r->clipymax;
+}
+
+static void nsvg__prepareImage(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGimage* image, float scale)
+{
+	NSVGrasterizedShape *rShape = NULL;
+	NSVGshapeNode* shapeNode;
+	NSVGshape* shape;
+	unsigned int* colors;
+	int i, ncolors;
+
+	// Prepare again only the shapes changed by animation since the last prepare.
+	r->clipped = 0;
+	if (nsvg__canPrepareChanged(r, rImage, image, scale)) {
+		// Changed shapes are clipped like the others, so the prepared image is complete within the same rectangle.
+		if (rImage->clipped) {
+			r->clipxmin = rImage->clipxmin;
+			r->clipymin = rImage->clipymin;
+			r->clipxmax = rImage->clipxmax;
+			r->clipymax = rImage->clipymax;
+		}
+		for (i = 0; i < rImage->nshapes; i++) {
+			rShape = &rImage->shapes[i];
+			if (rShape->generation != rShape->shape->generation)
+				nsvg__prepareShape(r, rImage, rShape, scale, 1);
+		}
+		nsvg__setPreparedClip(r, rImage);
+		return;
 	}
+	rImage->image = NULL;
+	rImage->clipped = 0;
 
-	// Allocate more shapes if needed.
-	for (r->nshapes = 0, shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
-		if (shapeNode->shape != NULL) {
-			r->nshapes++;
+	// Allocate more shapes if needed, and the colors of all gradients.
+	ncolors = 0;
+	for (rImage->nshapes = 0, shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
+		shape = shapeNode->shape;
+		if (shape != NULL) {
+			rImage->nshapes++;
+			if (nsvg__isGradient(&shape->fill))
+				ncolors += 256;
+			if (nsvg__isGradient(&shape->stroke))
+				ncolors += 256;
 		}
 	}
-	if (r->nshapes > r->cshapes) {
-		r->shapes = (NSVGrasterizedShape*)nsvgr__realloc(r, r->shapes, sizeof(NSVGrasterizedShape) * r->nshapes,
-														 sizeof(NSVGrasterizedShape) * r->cshapes);
-		if (r->shapes == NULL) return;
-		r->cshapes = r->nshapes;
+	if (rImage->nshapes > rImage->cshapes) {
+		rImage->shapes = (NSVGrasterizedShape*)nsvgr__resize(&rImage->memorySize, rImage->shapes, sizeof(NSVGrasterizedShape) * rImage->nshapes,
+														 sizeof(NSVGrasterizedShape) * rImage->cshapes);
+		if (rImage->shapes == NULL) return;
+		rImage->cshapes = rImage->nshapes;
 	}
-	memset(r->shapes, 0, sizeof(NSVGrasterizedShape) * r->nshapes);
+	memset(rImage->shapes, 0, sizeof(NSVGrasterizedShape) * rImage->nshapes);
+	if (ncolors != rImage->ccolors) {
+		rImage->colors = (unsigned int*)nsvgr__resize(&rImage->memorySize, rImage->colors, sizeof(unsigned int) * ncolors, sizeof(unsigned int) * rImage->ccolors);
+		if (rImage->colors == NULL && ncolors > 0) return;
+		rImage->ccolors = ncolors;
+	}
+	colors = rImage->colors;
+	rImage->nshapeEdges = 0;
+	rImage->ncompactEdges = 0;
+	rImage->nbuckets = 0;
+	rImage->nunusedEdges = 0;
+	rImage->nunusedBuckets = 0;
+	rImage->nbases = 0;
+	rImage->nbaseEdges = 0;
+	rImage->nunusedBaseEdges = 0;
 
 	// Prepare the rasterized image for all shapes.
 	for (i = 0, shapeNode = image->shapes; shapeNode != NULL; shapeNode = shapeNode->next) {
 		shape = shapeNode->shape;
 		if (shape == NULL) continue;
 
-		rShape = &r->shapes[i++];
+		rShape = &rImage->shapes[i++];
 		rShape->shape = shape;
+		rShape->base = -1;
+		if (nsvg__isGradient(&shape->fill)) {
+			rShape->fillCache.colors = colors;
+			colors += 256;
+		}
+		if (nsvg__isGradient(&shape->stroke)) {
+			rShape->strokeCache.colors = colors;
+			colors += 256;
+		}
 
-		if (!(shape->flags & NSVG_FLAGS_VISIBLE))
-			continue;
+		nsvg__prepareShape(r, rImage, rShape, scale, 0);
+	}
 
-		if (shape->fill.type != NSVG_PAINT_NONE) {
-			nsvg__prepareShapeFillEdges(r, shape, scale, &rShape->fillCache);
-			nsvg__copyEdgesToList(r, &rShape->fillEdges);
+	// Release space left from larger images.
+	if (rImage->cshapeEdges > rImage->nshapeEdges) {
+		rImage->shapeEdges = (NSVGedge*)nsvgr__resize(&rImage->memorySize, rImage->shapeEdges, sizeof(NSVGedge) * rImage->nshapeEdges, sizeof(NSVGedge) * rImage->cshapeEdges);
+		rImage->cshapeEdges = rImage->nshapeEdges;
+	}
+	if (rImage->ccompactEdges > rImage->ncompactEdges) {
+		rImage->compactEdges = (NSVGcompactEdge*)nsvgr__resize(&rImage->memorySize, rImage->compactEdges, sizeof(NSVGcompactEdge) * rImage->ncompactEdges,
+														   sizeof(NSVGcompactEdge) * rImage->ccompactEdges);
+		rImage->ccompactEdges = rImage->ncompactEdges;
+	}
+	if (rImage->cbuckets > rImage->nbuckets) {
+		rImage->buckets = (int*)nsvgr__resize(&rImage->memorySize, rImage->buckets, sizeof(int) * rImage->nbuckets, sizeof(int) * rImage->cbuckets);
+		rImage->cbuckets = rImage->nbuckets;
+	}
+	// Shapes prepared together have no base edges until they are changed.
+	if (rImage->cbases > 0) {
+		rImage->bases = (NSVGshapeBase*)nsvgr__resize(&rImage->memorySize, rImage->bases, 0, sizeof(NSVGshapeBase) * rImage->cbases);
+		rImage->cbases = 0;
+	}
+	if (rImage->cbaseEdges > 0) {
+		rImage->baseEdges = (NSVGedge*)nsvgr__resize(&rImage->memorySize, rImage->baseEdges, 0, sizeof(NSVGedge) * rImage->cbaseEdges);
+		rImage->cbaseEdges = 0;
+	}
+
+	rImage->image = image;
+	rImage->flags = r->flags;
+	rImage->scale = scale;
+	rImage->tessTol = r->tessTol;
+	nsvg__setPreparedClip(r, rImage);
+	rImage->viewxmin = image->viewMinx * scale;
+	rImage->viewxmax = (image->viewMinx + image->viewWidth) * scale;
+	rImage->viewymin = image->viewMiny * scale;
+	rImage->viewymax = (image->viewMiny + image->viewHeight) * scale;
+}
+
+void nsvgRasterizePrepareImage(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGimage* image, float scale)
+{
+	r->clip = 0;
+	nsvg__prepareImage(r, rImage, image, scale);
+}
+
+void nsvgRasterizePrepareImageViewport(NSVGrasterizer* r, NSVGrasterizedImage* rImage, NSVGimage* image, float scale,
+									   float tx, float ty, int w, int h)
+{
+	// Edges are clipped with a pixel for antialiasing.
+	r->clip = 1;
+	r->clipxmin = -tx - 1;
+	r->clipymin = -ty - 1;
+	r->clipxmax = w - tx + 1;
+	r->clipymax = h - ty + 1;
+	nsvg__prepareImage(r, rImage, image, scale);
+	r->clip = 0;
+}
+
+static void nsvg__rasterizeEdgeList(NSVGrasterizer* r, const NSVGrasterizedImage* rImage, const NSVGedgeList* edgeList,
+									float tx, float ty, float bandymin, float bandymax, const NSVGcachedPaint* cache, char fillRule)
+{
+	int first;
+
+	// Skip edges that do not overlap the band.
+	if (edgeList->count == 0 || edgeList->ymax <= bandymin || edgeList->ymin >= bandymax ||
+		edgeList->xmax <= -tx || edgeList->xmin >= r->width - tx)
+		return;
+	first = nsvg__firstEdgeInList(rImage, edgeList, bandymin);
+	NSVG__STAT(r->stats.edgesVisited += edgeList->count - first);
+
+	if (edgeList->compact)
+		nsvg__rasterizeSortedEdges(r, NULL, &rImage->compactEdges[edgeList->offset + first], edgeList->count - first,
+								   tx,ty, rImage->scale, cache, fillRule, edgeList->ymin, edgeList->ymax);
+	else
+		nsvg__rasterizeSortedEdges(r, &rImage->shapeEdges[edgeList->offset + first], NULL, edgeList->count - first,
+								   tx,ty, rImage->scale, cache, fillRule, edgeList->ymin, edgeList->ymax);
+}
+
+// Finds the destination pixels touched by the edges of a shape, returns false if there are none.
+static int nsvg__shapePixels(const NSVGrasterizedShape* rShape, float tx, float ty, int w, int h, int* rect)
+{
+	const NSVGedgeList* fill = &rShape->fillEdges;
+	const NSVGedgeList* stroke = &rShape->strokeEdges;
+	float xmin, ymin, xmax, ymax;
+
+	if (fill->count == 0 && stroke->count == 0)
+		return 0;
+	if (fill->count == 0)
+		fill = stroke;
+	else if (stroke->count == 0)
+		stroke = fill;
+	xmin = (fill->xmin < stroke->xmin) ? fill->xmin : stroke->xmin;
+	ymin = (fill->ymin < stroke->ymin) ? fill->ymin : stroke->ymin;
+	xmax = (fill->xmax > stroke->xmax) ? fill->xmax : stroke->xmax;
+	ymax = (fill->ymax > stroke->ymax) ? fill->ymax : stroke->ymax;
+
+	rect[0] = (int)floorf(nsvg__clampf(xmin + tx, 0, (float)w));
+	rect[1] = (int)floorf(nsvg__clampf(ymin + ty, 0, (float)h));
+	rect[2] = (int)ceilf(nsvg__clampf(xmax + tx, 0, (float)w));
+	rect[3] = (int)ceilf(nsvg__clampf(ymax + ty, 0, (float)h));
+	return rect[0] < rect[2] && rect[1] < rect[3];
+}
+
+// Finds the destination pixels entirely covered by the opaque rectangle of a shape, returns false if there are none.
+// The rectangle is limited to the viewbox, where shapes are rasterized.
+static int nsvg__opaquePixels(const NSVGrasterizedImage* rImage, const NSVGrasterizedShape* rShape, float tx, float ty, int w, int h, int* rect)
+{
+	float xmin, ymin, xmax, ymax;
+
+	if (!rShape->opaque || rShape->fillEdges.count == 0 || !(rShape->shape->flags & NSVG_FLAGS_VISIBLE))
+		return 0;
+	xmin = (rShape->opaquexmin > rImage->viewxmin) ? rShape->opaquexmin : (float)rImage->viewxmin;
+	ymin = (rShape->opaqueymin > rImage->viewymin) ? rShape->opaqueymin : (float)rImage->viewymin;
+	xmax = (rShape->opaquexmax < rImage->viewxmax) ? rShape->opaquexmax : (float)rImage->viewxmax;
+	ymax = (rShape->opaqueymax < rImage->viewymax) ? rShape->opaqueymax : (float)rImage->viewymax;
+
+	rect[0] = (int)ceilf(nsvg__clampf(xmin + tx, 0, (float)w));
+	rect[1] = (int)ceilf(nsvg__clampf(ymin + ty, 0, (float)h));
+	rect[2] = (int)floorf(nsvg__clampf(xmax + tx, 0, (float)w));
+	rect[3] = (int)floorf(nsvg__clampf(ymax + ty, 0, (float)h));
+	return rect[0] < rect[2] && rect[1] < rect[3];
+}
+
+// Marks the shapes whose pixels in the destination are all covered by later opaque shapes, returns false if out of memory.
+// The shapes are visited from the top, keeping the largest opaque rectangles found so far.
+static int nsvg__findOccluded(NSVGrasterizer* r, const NSVGrasterizedImage* rImage, int first, int last,
+							  float tx, float ty, int w, int h)
+{
+	int occluders[NSVG__OCCLUDERS][4], rect[4];
+	int noccluders = 0, i, j, k;
+
+	if (rImage->nshapes > r->coccluded) {
+		r->occluded = (unsigned char*)nsvgr__realloc(r, r->occluded, rImage->nshapes, r->coccluded);
+		r->coccluded = (r->occluded != NULL) ? rImage->nshapes : 0;
+		if (r->occluded == NULL) return 0;
+	}
+
+	for (i = last - 1; i >= first; i--) {
+		const NSVGrasterizedShape* rShape = &rImage->shapes[i];
+		r->occluded[i] = 0;
+		if (!(rShape->shape->flags & NSVG_FLAGS_VISIBLE) || !nsvg__shapePixels(rShape, tx, ty, w, h, rect))
+			continue;
+		for (j = 0; j < noccluders && !r->occluded[i]; j++) {
+			r->occluded[i] = (occluders[j][0] <= rect[0] && occluders[j][1] <= rect[1] &&
+							  occluders[j][2] >= rect[2] && occluders[j][3] >= rect[3]);
 		}
-		if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f) {
-			nsvg__prepareShapeStrokeEdges(r, shape, scale, &rShape->strokeCache);
-			nsvg__copyEdgesToList(r, &rShape->strokeEdges);
+		if (r->occluded[i] || !nsvg__opaquePixels(rImage, rShape, tx, ty, w, h, rect))
+			continue;
+
+		// Replace the smallest rectangle when there are too many.
+		if (noccluders < NSVG__OCCLUDERS) {
+			k = noccluders++;
+		} else {
+			for (k = 0, j = 1; j < noccluders; j++) {
+				if ((occluders[j][2] - occluders[j][0]) * (occluders[j][3] - occluders[j][1]) <
+					(occluders[k][2] - occluders[k][0]) * (occluders[k][3] - occluders[k][1]))
+					k = j;
+			}
+			if ((rect[2] - rect[0]) * (rect[3] - rect[1]) <= (occluders[k][2] - occluders[k][0]) * (occluders[k][3] - occluders[k][1]))
+				continue;
 		}
+		memcpy(occluders[k], rect, sizeof(rect));
 	}
+	return 1;
+}
 
-	r->scale = scale;
-	r->viewxmin = image->viewMinx * scale;
-	r->viewxmax = (image->viewMinx + image->viewWidth) * scale;
-	r->viewymin = image->viewMiny * scale;
-	r->viewymax = (image->viewMiny + image->viewHeight) * scale;
+// Limits a range of shapes to the shapes of the image.
+static void nsvg__shapeRange(const NSVGrasterizedImage* rImage, int first, int count, int* start, int* end)
+{
+	*start = (first > 0) ? first : 0;
+	*end = (count < rImage->nshapes - *start) ? *start + count : rImage->nshapes;
+}
+
+int nsvgRasterizeIsOpaque(const NSVGrasterizedImage* rImage, float tx, float ty, int w, int h)
+{
+	return nsvgRasterizeIsOpaqueShapes(rImage, 0, rImage->nshapes, tx, ty, w, h);
+}
+
+int nsvgRasterizeIsOpaqueShapes(const NSVGrasterizedImage* rImage, int first, int count, float tx, float ty, int w, int h)
+{
+	int rect[4], i, start, end;
+
+	nsvg__shapeRange(rImage, first, count, &start, &end);
+	for (i = start; i < end; i++) {
+		if (nsvg__opaquePixels(rImage, &rImage->shapes[i], tx, ty, w, h, rect) &&
+			rect[0] == 0 && rect[1] == 0 && rect[2] == w && rect[3] == h)
+			return 1;
+	}
+	return 0;
 }
 
 // Rasterizes prepared rasterized SVG image, returns RGBA image (non-premultiplied alpha)
@@ -1771,47 +3013,58 @@ void nsvgRasterizePrepare(NSVGrasterizer* r, NSVGimage* image, float scale)
 //   stride - number of bytes per scaleline in the destination buffer
 void nsvgRasterizeFinish(NSVGrasterizer* r, float tx, float ty, unsigned char* dst, int w, int h, int stride)
 {
-	NSVGrasterizedShape *rShape = NULL;
-	int i;
+	if (r->prepared == NULL) return;
+	nsvgRasterizeFinishImage(r, r->prepared, tx, ty, dst, w, h, stride);
+}
+
+void nsvgRasterizeFinishImage(NSVGrasterizer* r, const NSVGrasterizedImage* rImage, float tx, float ty,
+							  unsigned char* dst, int w, int h, int stride)
+{
+	nsvgRasterizeFinishImageShapes(r, rImage, 0, rImage->nshapes, tx, ty, dst, w, h, stride);
+}
+
+void nsvgRasterizeFinishImageShapes(NSVGrasterizer* r, const NSVGrasterizedImage* rImage, int first, int count,
+									float tx, float ty, unsigned char* dst, int w, int h, int stride)
+{
+	const NSVGrasterizedShape *rShape = NULL;
+	float bandymin = -ty, bandymax = h - ty;
+	int i, occlusion, start, end;
 
 	r->bitmap = dst;
 	r->width = w;
 	r->height = h;
 	r->stride = stride;
+	r->viewxmin = rImage->viewxmin;
+	r->viewxmax = rImage->viewxmax;
+	r->viewymin = rImage->viewymin;
+	r->viewymax = rImage->viewymax;
+	NSVG__STAT(r->stats.bands++);
 
 	if (w > r->cscanline) {
 		r->scanline = (unsigned char*)nsvgr__realloc(r, r->scanline, w, r->cscanline);
 		r->cscanline = w;
 		if (r->scanline == NULL) return;
+		// The scanline is kept cleared between rows.
+		memset(r->scanline, 0, w);
 	}
 
-	for (i = 0; i < r->nshapes; i++) {
-		rShape = &r->shapes[i];
-
-		if (!(rShape->shape->flags & NSVG_FLAGS_VISIBLE))
-			continue;
-
-		if (rShape->shape->fill.type != NSVG_PAINT_NONE) {
-			nsvg__copyEdgeListToEdges(r, &rShape->fillEdges);
-			nsvg__scaleAndTranslateEdges(r, tx, ty, NSVG__SUBSAMPLES);
+	// Shapes covered by later opaque shapes are replaced by them, so they are not rasterized.
+	nsvg__shapeRange(rImage, first, count, &start, &end);
+	occlusion = nsvg__findOccluded(r, rImage, start, end, tx, ty, w, h);
 
-			nsvg__resetPool(r);
-			r->freelist = NULL;
+	for (i = start; i < end; i++) {
+		rShape = &rImage->shapes[i];
 
-			nsvg__rasterizeSortedEdges(r, tx,ty, r->scale, &rShape->fillCache, rShape->shape->fillRule);
-		}
-		if (rShape->shape->stroke.type != NSVG_PAINT_NONE && (rShape->shape->strokeWidth * r->scale) > 0.01f) {
-			nsvg__copyEdgeListToEdges(r, &rShape->strokeEdges);
-			nsvg__scaleAndTranslateEdges(r, tx, ty, NSVG__SUBSAMPLES);
-
-			nsvg__resetPool(r);
-			r->freelist = NULL;
+		if (!(rShape->shape->flags & NSVG_FLAGS_VISIBLE) || (occlusion && r->occluded[i]))
+			continue;
 
-			nsvg__rasterizeSortedEdges(r, tx,ty, r->scale, &rShape->strokeCache, NSVG_FILLRULE_NONZERO);
-		}
+		nsvg__rasterizeEdgeList(r, rImage, &rShape->fillEdges, tx, ty, bandymin, bandymax, &rShape->fillCache, rShape->shape->fillRule);
+		nsvg__rasterizeEdgeList(r, rImage, &rShape->strokeEdges, tx, ty, bandymin, bandymax, &rShape->strokeCache, NSVG_FILLRULE_NONZERO);
 	}
 
-	nsvg__unpremultiplyAlpha(dst, w, h, stride);
+	// Only the RGBA destination is premultiplied while rasterizing.
+	if (r->format == NSVG_RAST_FORMAT_RGBA)
+		nsvg__unpremultiplyAlpha(dst, w, h, stride);
 
 	r->bitmap = NULL;
 	r->width = 0;
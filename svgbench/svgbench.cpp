@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2025 Idan Gutman
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ *
+ * This tool benchmarks AnimatedSVG without a window, timing each phase of loading, animating and rasterizing.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "CmdLineParser.h"
+#include "AnimatedSVG.h"
+#include "nanosvg.h"
+#include "nanosvgrast.h"
+
+// Same units as AnimatedSVG uses for parsing.
+#define SVG_UNITS   "px"
+#define SVG_DPI     96
+
+// Buffer height used for the whole destination height.
+#define FULL_BUFFER_HEIGHT  0
+
+// Largest difference of a color channel (out of 255) of ANIMATED_SVG_OPTION_DIRECT from the rasterize buffer.
+// The buffer is unpremultiplied and copied once per pixel, while DIRECT blends every shape into the destination,
+// so RGB565 is truncated to 5 or 6 bits for each shape.
+#define DIRECT_TOLERANCE_BGRA8888   8
+#define DIRECT_TOLERANCE_RGB565     32
+
+const char* samples[] = { "tiger.svg", "watch.svg", "ball_bounce.svg", "AnimatedSVG.svg" };
+const int bufferHeights[] = { 16, 64, FULL_BUFFER_HEIGHT };
+const float scales[] = { 0.5f, 1.0f, 2.0f };
+const int formats[] = { ANIMATED_SVG_OPTION_RGB565, ANIMATED_SVG_OPTION_BGRA8888 };
+
+const char* listPath = NULL;
+int iterations = 5;
+int frames = 30;
+int durationMs = 3000;
+bool noSamples = false;
+bool csv = false;
+bool checkDirect = false;
+
+// Times of a phase in milliseconds.
+struct PhaseTimes
+{
+    const char* name;
+    std::vector<double> times;
+};
+
+// Results of a configuration.
+struct BenchResult
+{
+    std::string file;
+    int width;
+    int height;
+    int format;
+    int bufferHeight;
+    float scale;
+    PhaseTimes phases[6];
+    int imageMemory;
+    int rasterizerMemory;
+};
+
+// AnimatedSVG with the time spent copying the rasterize buffer to the destination.
+class TimedAnimatedSVG : public AnimatedSVG
+{
+public:
+    TimedAnimatedSVG(const char* svg, unsigned char* rastBuffer, int bufferWidth, int bufferHeight, int options)
+        : AnimatedSVG(svg, rastBuffer, bufferWidth, bufferHeight, options), copyTimeMs(0)
+    {
+    }
+
+    double copyTimeMs;
+
+protected:
+    virtual void copyToDest(void* dstBuffer, int dstStride, int width, int height)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        AnimatedSVG::copyToDest(dstBuffer, dstStride, width, height);
+        copyTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+bool parseArgs(int argc, const char** argv);
+std::vector<std::string> getFilePaths();
+char* readFile(const char* filePath);
+bool benchFile(const std::string& filePath, std::vector<BenchResult>& results);
+bool benchConfig(const char* svg, BenchResult& result);
+double elapsedMs(std::chrono::steady_clock::time_point start);
+double mean(const std::vector<double>& times);
+double percentile(const std::vector<double>& sorted, double p);
+void printResult(const BenchResult& result);
+void printCsv(const std::vector<BenchResult>& results);
+bool checkDirectFile(const std::string& filePath);
+bool checkDirectConfig(const char* svg, int format, float scale, int& maxDiff);
+int channelDiff(const unsigned char* a, const unsigned char* b, int format);
+
+int main(int argc, char** argv)
+{
+    if (!parseArgs(argc, (const char**)argv))
+    {
+        return 1;
+    }
+
+    std::vector<std::string> filePaths = getFilePaths();
+    if (filePaths.empty())
+    {
+        fprintf(stderr, "No files to benchmark\n");
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    bool success = true;
+    for (size_t i = 0; i < filePaths.size(); i++)
+    {
+        if (checkDirect)
+        {
+            if (!checkDirectFile(filePaths[i]))
+            {
+                success = false;
+            }
+        }
+        else if (!benchFile(filePaths[i], results))
+        {
+            fprintf(stderr, "Error benchmarking %s\n", filePaths[i].c_str());
+            success = false;
+        }
+    }
+
+    if (csv && !checkDirect)
+    {
+        printCsv(results);
+    }
+
+    return success ? 0 : 1;
+}
+
+bool parseArgs(int argc, const char** argv)
+{
+    CmdLineParser parser;
+    bool syntax = false;
+
+    parser.AddArgument("list path", "Path of a text file listing more SVG files to benchmark, one per line", &listPath, true);
+    parser.AddIntOption("i", "iterations", "iterations", "Set the number of loads timed for each configuration", &iterations);
+    parser.AddIntOption("f", "frames", "frames", "Set the number of frames of the animation timeline", &frames);
+    parser.AddIntOption("d", "duration", "duration", "Set the duration of the animation timeline in milliseconds", &durationMs);
+    parser.AddFlagOption("ns", "no-samples", "no samples", "Do not benchmark the files in the samples folder", &noSamples);
+    parser.AddFlagOption("c", "csv", "csv", "Print the results as CSV (one line per phase) instead of tables", &csv);
+    parser.AddFlagOption("cd", "check-direct", "check direct", "Check that ANIMATED_SVG_OPTION_DIRECT matches the rasterize buffer instead of benchmarking", &checkDirect);
+    parser.AddFlagOption("h", "help", "help", "Show this help", &syntax);
+
+    bool success = parser.Parse(argc, argv);
+    if (success && (iterations < 1 || frames < 1 || durationMs < 0))
+    {
+        fprintf(stderr, "Iterations and frames should be positive\n\n");
+        success = false;
+    }
+
+    if (!success && parser.GetLastError() != NULL)
+    {
+        fprintf(stderr, "%s\n\n", parser.GetLastError());
+    }
+    if (!success || syntax)
+    {
+        const char* exe = argv[0];
+        for (const char* ptr = exe; *ptr != '\0'; ptr++)
+        {
+            if (*ptr == '/' || *ptr == '\\')
+            {
+                exe = ptr + 1;
+            }
+        }
+
+        fprintf(stderr, "Syntax: %s %s\n", exe, parser.GetSyntax());
+
+        return false;
+    }
+
+    return true;
+}
+
+// Return the samples followed by the files of the list.
+std::vector<std::string> getFilePaths()
+{
+    std::vector<std::string> filePaths;
+
+    if (!noSamples)
+    {
+        for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+        {
+            filePaths.push_back(std::string(SVGBENCH_SAMPLES_DIR) + "/" + samples[i]);
+        }
+    }
+
+    if (listPath != NULL)
+    {
+        char* list = readFile(listPath);
+        if (list == NULL)
+        {
+            fprintf(stderr, "Error reading %s\n", listPath);
+            return filePaths;
+        }
+        for (char* line = strtok(list, "\r\n"); line != NULL; line = strtok(NULL, "\r\n"))
+        {
+            if (line[0] != '\0' && line[0] != '#')
+            {
+                filePaths.push_back(line);
+            }
+        }
+        free(list);
+    }
+
+    return filePaths;
+}
+
+// Read a whole file, returns NULL on error.
+char* readFile(const char* filePath)
+{
+    FILE* fp = fopen(filePath, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* data = (size >= 0) ? (char*)malloc(size + 1) : NULL;
+    if (data == NULL || fread(data, 1, size, fp) != (size_t)size)
+    {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    data[size] = '\0';
+    fclose(fp);
+
+    return data;
+}
+
+// Benchmark a file with every combination of format, buffer height and scale.
+bool benchFile(const std::string& filePath, std::vector<BenchResult>& results)
+{
+    char* svg = readFile(filePath.c_str());
+    if (svg == NULL)
+    {
+        return false;
+    }
+
+    std::string fileName = filePath.substr(filePath.find_last_of("/\\") + 1);
+    bool success = true;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]) && success; f++)
+    {
+        for (size_t b = 0; b < sizeof(bufferHeights) / sizeof(bufferHeights[0]) && success; b++)
+        {
+            for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]) && success; s++)
+            {
+                BenchResult result;
+                result.file = fileName;
+                result.format = formats[f];
+                result.bufferHeight = bufferHeights[b];
+                result.scale = scales[s];
+                success = benchConfig(svg, result);
+                if (success)
+                {
+                    if (!csv)
+                    {
+                        printResult(result);
+                    }
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    free(svg);
+
+    return success;
+}
+
+// Benchmark a configuration: loads, then the updates and rasterizes of each frame of the timeline.
+// Prepare and finish are timed on the same frames with the NanoSVG API, as AnimatedSVG runs them within rasterize().
+bool benchConfig(const char* svg, BenchResult& result)
+{
+    static const char* names[] = { "load", "update", "rasterize", "prepare", "finish", "copyToDest" };
+    PhaseTimes& load = result.phases[0];
+    PhaseTimes& update = result.phases[1];
+    PhaseTimes& rasterize = result.phases[2];
+    PhaseTimes& prepare = result.phases[3];
+    PhaseTimes& finish = result.phases[4];
+    PhaseTimes& copy = result.phases[5];
+    for (int i = 0; i < 6; i++)
+    {
+        result.phases[i].name = names[i];
+    }
+    result.imageMemory = 0;
+    result.rasterizerMemory = 0;
+
+    // The size of the destination is known once the image is parsed.
+    NSVGimage* image = nsvgParse(svg, SVG_UNITS, SVG_DPI);
+    if (image == NULL)
+    {
+        return false;
+    }
+    result.width = (int)ceilf(image->width * result.scale);
+    result.height = (int)ceilf(image->height * result.scale);
+    int bufferHeight = (result.bufferHeight == FULL_BUFFER_HEIGHT || result.bufferHeight > result.height) ?
+                       result.height : result.bufferHeight;
+    int pitch = (result.format & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 2;
+
+    unsigned char* rastBuffer = (unsigned char*)malloc(result.width * bufferHeight * 4);
+    unsigned char* dst = (unsigned char*)malloc(result.width * result.height * pitch);
+    NSVGrasterizer* rasterizer = nsvgCreateRasterizer();
+    NSVGrasterizedImage* prepared = nsvgCreateRasterizedImage();
+    TimedAnimatedSVG* animatedSvg = new TimedAnimatedSVG(svg, rastBuffer, result.width, bufferHeight, result.format);
+    bool success = rastBuffer != NULL && dst != NULL && rasterizer != NULL && prepared != NULL;
+
+    for (int i = 0; i < iterations && success; i++)
+    {
+        animatedSvg->unload();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        success = animatedSvg->load();
+        load.times.push_back(elapsedMs(start));
+    }
+
+    if (success)
+    {
+        nsvgRasterizerSetSubsamples(rasterizer, ANIMATED_SVG_QUALITY_NORMAL);
+    }
+    for (int i = 0; i < frames && success; i++)
+    {
+        long timeMs = (long)i * durationMs / frames;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        animatedSvg->update(timeMs);
+        update.times.push_back(elapsedMs(start));
+
+        animatedSvg->copyTimeMs = 0;
+        start = std::chrono::steady_clock::now();
+        animatedSvg->rasterize(dst, result.width, result.height, result.width * pitch, 0, 0, result.scale);
+        rasterize.times.push_back(elapsedMs(start));
+        copy.times.push_back(animatedSvg->copyTimeMs);
+
+        result.imageMemory = std::max(result.imageMemory, animatedSvg->getImageUsedMemory());
+        result.rasterizerMemory = std::max(result.rasterizerMemory, animatedSvg->getRasterizerUsedMemory());
+
+        // Same frame in bands of the buffer height, like AnimatedSVG rasterizes into its buffer.
+        nsvgAnimate(image, timeMs);
+        start = std::chrono::steady_clock::now();
+        nsvgRasterizePrepareImage(rasterizer, prepared, image, result.scale);
+        prepare.times.push_back(elapsedMs(start));
+
+        double finishMs = 0;
+        for (int y = 0; y < result.height; y += bufferHeight)
+        {
+            int height = std::min(bufferHeight, result.height - y);
+            memset(rastBuffer, 0, result.width * height * 4);
+            start = std::chrono::steady_clock::now();
+            nsvgRasterizeFinishImage(rasterizer, prepared, 0, (float)-y, rastBuffer, result.width, height, result.width * 4);
+            finishMs += elapsedMs(start);
+        }
+        finish.times.push_back(finishMs);
+    }
+
+    delete animatedSvg;
+    nsvgDeleteRasterizedImage(prepared);
+    nsvgDeleteRasterizer(rasterizer);
+    nsvgDelete(image);
+    free(dst);
+    free(rastBuffer);
+
+    return success;
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double mean(const std::vector<double>& times)
+{
+    double sum = 0;
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        sum += times[i];
+    }
+
+    return times.empty() ? 0 : sum / times.size();
+}
+
+// Return the percentile of sorted times, interpolated between the nearest ranks.
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+
+    double rank = p / 100 * (sorted.size() - 1);
+    size_t index = (size_t)rank;
+    if (index + 1 >= sorted.size())
+    {
+        return sorted.back();
+    }
+
+    return sorted[index] + (sorted[index + 1] - sorted[index]) * (rank - index);
+}
+
+void printResult(const BenchResult& result)
+{
+    char bufferHeight[16];
+    if (result.bufferHeight == FULL_BUFFER_HEIGHT)
+    {
+        strcpy(bufferHeight, "full");
+    }
+    else
+    {
+        sprintf(bufferHeight, "%d", result.bufferHeight);
+    }
+
+    printf("%s %dx%d %s buffer height %s scale %.2f (image memory %d, rasterizer memory %d)\n",
+           result.file.c_str(), result.width, result.height,
+           (result.format & ANIMATED_SVG_OPTION_BGRA8888) ? "BGRA8888" : "RGB565", bufferHeight, result.scale,
+           result.imageMemory, result.rasterizerMemory);
+    printf("  %-12s %8s %8s %8s %8s %8s\n", "phase (ms)", "mean", "p50", "p90", "p99", "max");
+    for (int i = 0; i < 6; i++)
+    {
+        std::vector<double> sorted = result.phases[i].times;
+        std::sort(sorted.begin(), sorted.end());
+        printf("  %-12s %8.3f %8.3f %8.3f %8.3f %8.3f\n", result.phases[i].name, mean(sorted),
+               percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), sorted.empty() ? 0 : sorted.back());
+    }
+    printf("\n");
+}
+
+void printCsv(const std::vector<BenchResult>& results)
+{
+    printf("file,width,height,format,buffer_height,scale,phase,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,"
+           "image_memory,rasterizer_memory\n");
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        const BenchResult& result = results[r];
+        for (int i = 0; i < 6; i++)
+        {
+            std::vector<double> sorted = result.phases[i].times;
+            std::sort(sorted.begin(), sorted.end());
+            printf("%s,%d,%d,%s,%d,%.2f,%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d\n", result.file.c_str(),
+                   result.width, result.height, (result.format & ANIMATED_SVG_OPTION_BGRA8888) ? "BGRA8888" : "RGB565",
+                   (result.bufferHeight == FULL_BUFFER_HEIGHT) ? result.height : result.bufferHeight, result.scale,
+                   result.phases[i].name, (int)sorted.size(), mean(sorted), percentile(sorted, 50), percentile(sorted, 90),
+                   percentile(sorted, 99), sorted.empty() ? 0 : sorted.back(), result.imageMemory, result.rasterizerMemory);
+        }
+    }
+}
+
+// Check ANIMATED_SVG_OPTION_DIRECT against the rasterize buffer for every format and scale, returns false if it differs
+// by more than the tolerance.
+bool checkDirectFile(const std::string& filePath)
+{
+    char* svg = readFile(filePath.c_str());
+    if (svg == NULL)
+    {
+        fprintf(stderr, "Error reading %s\n", filePath.c_str());
+        return false;
+    }
+
+    std::string fileName = filePath.substr(filePath.find_last_of("/\\") + 1);
+    bool success = true;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        int tolerance = (formats[f] & ANIMATED_SVG_OPTION_BGRA8888) ? DIRECT_TOLERANCE_BGRA8888 : DIRECT_TOLERANCE_RGB565;
+        for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+        {
+            int maxDiff = 0;
+            if (!checkDirectConfig(svg, formats[f], scales[s], maxDiff))
+            {
+                fprintf(stderr, "Error rasterizing %s\n", filePath.c_str());
+                success = false;
+                continue;
+            }
+
+            printf("%s %s scale %.2f: max difference %d (tolerance %d)%s\n", fileName.c_str(),
+                   (formats[f] & ANIMATED_SVG_OPTION_BGRA8888) ? "BGRA8888" : "RGB565", scales[s],
+                   maxDiff, tolerance, (maxDiff > tolerance) ? " FAILED" : "");
+            if (maxDiff > tolerance)
+            {
+                success = false;
+            }
+        }
+    }
+
+    free(svg);
+
+    return success;
+}
+
+// Rasterize each frame of the timeline with a buffer of the whole destination height and with DIRECT, and find the
+// largest difference of a channel. A shorter buffer would restart the edges at every band, which also moves them.
+bool checkDirectConfig(const char* svg, int format, float scale, int& maxDiff)
+{
+    NSVGimage* image = nsvgParse(svg, SVG_UNITS, SVG_DPI);
+    if (image == NULL)
+    {
+        return false;
+    }
+    int width = (int)ceilf(image->width * scale);
+    int height = (int)ceilf(image->height * scale);
+    int pitch = (format & ANIMATED_SVG_OPTION_BGRA8888) ? 4 : 2;
+    nsvgDelete(image);
+
+    unsigned char* rastBuffer = (unsigned char*)malloc(width * height * 4);
+    std::vector<unsigned char> expected(width * height * pitch);
+    std::vector<unsigned char> actual(width * height * pitch);
+    AnimatedSVG* buffered = new AnimatedSVG(svg, rastBuffer, width, height, format);
+    AnimatedSVG* direct = new AnimatedSVG(svg, NULL, width, height, format | ANIMATED_SVG_OPTION_DIRECT);
+    bool success = rastBuffer != NULL && buffered->load() && direct->load();
+
+    for (int i = 0; i < frames && success; i++)
+    {
+        long timeMs = (long)i * durationMs / frames;
+        buffered->update(timeMs);
+        direct->update(timeMs);
+
+        std::fill(expected.begin(), expected.end(), 0);
+        std::fill(actual.begin(), actual.end(), 0);
+        buffered->rasterize(expected.data(), width, height, width * pitch, 0, 0, scale);
+        direct->rasterize(actual.data(), width, height, width * pitch, 0, 0, scale);
+        for (size_t p = 0; p < expected.size(); p += pitch)
+        {
+            maxDiff = std::max(maxDiff, channelDiff(&expected[p], &actual[p], format));
+        }
+    }
+
+    delete direct;
+    delete buffered;
+    free(rastBuffer);
+
+    return success;
+}
+
+// Return the largest difference of the channels of two pixels, out of 255.
+int channelDiff(const unsigned char* a, const unsigned char* b, int format)
+{
+    int diff = 0;
+    if (format & ANIMATED_SVG_OPTION_BGRA8888)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            diff = std::max(diff, abs(a[i] - b[i]));
+        }
+    }
+    else
+    {
+        int ca = a[0] | (a[1] << 8);
+        int cb = b[0] | (b[1] << 8);
+        diff = std::max(diff, abs((ca >> 11) - (cb >> 11)) << 3);
+        diff = std::max(diff, abs(((ca >> 5) & 0x3f) - ((cb >> 5) & 0x3f)) << 2);
+        diff = std::max(diff, abs((ca & 0x1f) - (cb & 0x1f)) << 3);
+    }
+
+    return diff;
+}
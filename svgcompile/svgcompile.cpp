@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2025 Idan Gutman
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ *
+ * This tool compiles SVG files into binary images embedded as headers, which AnimatedSVG loads without parsing.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+
+#include "CmdLineParser.h"
+
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+
+// Same units as AnimatedSVG uses for parsing.
+#define SVG_UNITS   "px"
+#define SVG_DPI     96
+
+const char* filePath = NULL;
+const char* outputPath = NULL;
+
+bool parseArgs(int argc, const char** argv);
+std::string getDefaultOutputPath(const char* filePath);
+std::string getArrayName(const char* outputPath);
+bool writeHeader(const char* outputPath, const char* filePath, const unsigned char* data, int size);
+
+int main(int argc, char** argv)
+{
+    if (!parseArgs(argc, (const char**)argv))
+    {
+        return 1;
+    }
+
+    std::string defaultOutputPath = getDefaultOutputPath(filePath);
+    if (outputPath == NULL)
+    {
+        outputPath = defaultOutputPath.c_str();
+    }
+
+    // Parse the SVG with the same units as AnimatedSVG.
+    NSVGimage* image = nsvgParseFromFile(filePath, SVG_UNITS, SVG_DPI);
+    if (image == NULL)
+    {
+        fprintf(stderr, "Error parsing %s\n", filePath);
+        return 1;
+    }
+
+    // Serialize the parsed image.
+    int size = nsvgSerialize(image, NULL, 0);
+    unsigned char* data = (unsigned char*)malloc(size);
+    if (data == NULL || nsvgSerialize(image, data, size) != size)
+    {
+        fprintf(stderr, "Error compiling %s\n", filePath);
+        nsvgDelete(image);
+        free(data);
+        return 1;
+    }
+    int memorySize = image->memorySize;
+    nsvgDelete(image);
+
+    // Check that the binary image loads.
+    image = nsvgParseBinary(data, size, 0);
+    if (image == NULL)
+    {
+        fprintf(stderr, "Error loading compiled %s\n", filePath);
+        free(data);
+        return 1;
+    }
+    nsvgDelete(image);
+
+    if (!writeHeader(outputPath, filePath, data, size))
+    {
+        fprintf(stderr, "Error writing %s\n", outputPath);
+        free(data);
+        return 1;
+    }
+    printf("%s: compiled to %d bytes in %s (%d bytes of image memory)\n", filePath, size, outputPath, memorySize);
+
+    free(data);
+
+    return 0;
+}
+
+bool parseArgs(int argc, const char** argv)
+{
+    CmdLineParser parser;
+    bool syntax = false;
+
+    parser.AddArgument("file path", "Path of the SVG file to be compiled", &filePath);
+    parser.AddArgument("output path", "Path of the header to be written (default is the file path with _svgb.h)", &outputPath, true);
+    parser.AddFlagOption("h", "help", "help", "Show this help", &syntax);
+
+    bool success = parser.Parse(argc, argv);
+
+    if (!success && parser.GetLastError() != NULL)
+    {
+        fprintf(stderr, "%s\n\n", parser.GetLastError());
+    }
+    if (!success || syntax)
+    {
+        const char* exe = argv[0];
+        for (const char* ptr = exe; *ptr != '\0'; ptr++)
+        {
+            if (*ptr == '/' || *ptr == '\\')
+            {
+                exe = ptr + 1;
+            }
+        }
+
+        fprintf(stderr, "Syntax: %s %s\n", exe, parser.GetSyntax());
+
+        return false;
+    }
+
+    return true;
+}
+
+// Return the file path with its extension replaced by _svgb.h (e.g. watch.svg is compiled to watch_svgb.h).
+std::string getDefaultOutputPath(const char* filePath)
+{
+    std::string path = filePath;
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        path.erase(dot);
+    }
+
+    return path + "_svgb.h";
+}
+
+// Return the name of the array, the file name of the output path without extension.
+std::string getArrayName(const char* outputPath)
+{
+    std::string name = outputPath;
+    size_t slash = name.find_last_of("/\\");
+
+    if (slash != std::string::npos)
+    {
+        name.erase(0, slash + 1);
+    }
+    if (name.find_last_of('.') != std::string::npos)
+    {
+        name.erase(name.find_last_of('.'));
+    }
+    for (size_t i = 0; i < name.length(); i++)
+    {
+        if (!isalnum((unsigned char)name[i]))
+        {
+            name[i] = '_';
+        }
+    }
+    if (name.empty() || isdigit((unsigned char)name[0]))
+    {
+        name = "_" + name;
+    }
+
+    return name;
+}
+
+// Write the binary image as a header with a const array, aligned so its points can be used in place.
+bool writeHeader(const char* outputPath, const char* filePath, const unsigned char* data, int size)
+{
+    std::string name = getArrayName(outputPath);
+    std::string guard = name + "_H";
+    for (size_t i = 0; i < guard.length(); i++)
+    {
+        guard[i] = (char)toupper((unsigned char)guard[i]);
+    }
+
+    FILE* fp = fopen(outputPath, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    const char* fileName = filePath;
+    for (const char* ptr = filePath; *ptr != '\0'; ptr++)
+    {
+        if (*ptr == '/' || *ptr == '\\')
+        {
+            fileName = ptr + 1;
+        }
+    }
+
+    fprintf(fp, "// Compiled by svgcompile from %s, load with AnimatedSVG(%s, sizeof(%s), ...).\n\n", fileName, name.c_str(), name.c_str());
+    fprintf(fp, "#ifndef %s\n", guard.c_str());
+    fprintf(fp, "#define %s\n\n", guard.c_str());
+    fprintf(fp, "alignas(4) const unsigned char %s[] =\n{", name.c_str());
+    for (int i = 0; i < size; i++)
+    {
+        fprintf(fp, "%s0x%02x,", (i % 16 == 0) ? "\n\t" : " ", data[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "#endif //%s\n", guard.c_str());
+
+    bool success = ferror(fp) == 0;
+    fclose(fp);
+
+    return success;
+}
@@ -39,6 +39,7 @@ private:
         OPTION_TYPE_BOOL,
         OPTION_TYPE_INT,
         OPTION_TYPE_COLOR,
+        OPTION_TYPE_STRING,
     } OptionType;
 
     typedef struct Option
@@ -112,7 +113,8 @@ public:
                     nextArgOpt->hasValue = true;
 
                     // Move to next argument option.
-                    for (;nextArgOpt != NULL && nextArgOpt->type != OPTION_TYPE_ARGUMENT;
+                    for (nextArgOpt = nextArgOpt->next;
+                         nextArgOpt != NULL && nextArgOpt->type != OPTION_TYPE_ARGUMENT;
                          nextArgOpt = nextArgOpt->next);
                 }
             }
@@ -208,6 +210,12 @@ public:
                                         }
                                         break;
                                     }
+                                    case OPTION_TYPE_STRING:
+                                    {
+                                        *opt->argValue = argv[i];
+                                        opt->hasValue = true;
+                                        break;
+                                    }
                                     default: // do nothing
                                     {
                                         break;
@@ -350,6 +358,14 @@ public:
         option->intValue = value;
     }
 
+    void AddStringOption(const char* shortOpt, const char* longOpt, const char* name, const char* description,
+                         const char** value, bool isOptional = true)
+    {
+        Option* option = AddOption(shortOpt, longOpt, name, description, isOptional);
+        option->type = OPTION_TYPE_STRING;
+        option->argValue = value;
+    }
+
     void AddArgument(const char* name, const char* description, const char** value, bool isOptional = false)
     {
         Option* option = AddOption(NULL, NULL, name, description, isOptional);
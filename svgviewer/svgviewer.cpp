@@ -30,6 +30,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -67,7 +68,24 @@ int panY = 0;
 float loadTimeMs = 0;
 float renderTimeMs = 0;
 
+// Export of frames without a window.
+const char* exportPattern = NULL;
+int exportStartMs = 0;
+int exportEndMs = -1;
+int exportFps = 30;
+int exportWidth = -1;
+int exportHeight = -1;
+int exportThreads = 0;
+char* exportContent = NULL;
+int exportFrameCount = 0;
+SDL_AtomicInt exportNextFrame;
+SDL_AtomicInt exportFailed;
+
 bool loadSvg(const char* filePath);
+char* readFileContent(const char* filename);
+bool exportFrames();
+int exportWorker(void* data);
+int countFrameConversions(const char* pattern);
 void fileSaveDialogCallback(void *userdata, const char * const *filelist, int filter);
 bool parseArgs(int argc, const char** argv);
 std::vector<std::string> getInfo();
@@ -83,6 +101,12 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
         return SDL_APP_FAILURE;
     }
 
+    // Export the frames and quit without opening a window.
+    if (exportPattern != NULL)
+    {
+        return exportFrames() ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+    }
+
     bufferWidth = (fixedBufferWidth < 0) ? windowWidth : fixedBufferWidth;
     bufferHeight = (fixedBufferHeight < 0) ? windowHeight : fixedBufferHeight;
 
@@ -160,6 +184,8 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result)
 }
 
 bool changed = true;
+bool interacting = false;
+bool draft = false;
 long overrideTimeMs = -1;
 SDL_Time startTime = 0;
 long timeMs = 0;
@@ -218,6 +244,14 @@ SDL_AppResult SDL_AppIterate(void *appstate)
         changed = true;
     }
 
+    // Render in draft quality while zooming or panning with the mouse, and in normal quality once stopped.
+    if (draft != interacting)
+    {
+        draft = interacting;
+        changed = true;
+    }
+    interacting = false;
+
     if (changed)
     {
 
@@ -269,6 +303,7 @@ SDL_AppResult SDL_AppIterate(void *appstate)
         SDL_Time rastStartTime, rastEndTime;
         SDL_GetCurrentTime(&rastStartTime);
 
+        svg->setQuality(draft ? ANIMATED_SVG_QUALITY_DRAFT : ANIMATED_SVG_QUALITY_NORMAL);
         svg->rasterize((unsigned short*)surface->pixels, windowWidth, windowHeight, windowWidth * 4,
                        panX + windowWidth/2 - svg->width() * scale/2,
                        panY + windowHeight/2 - svg->height() * scale/2, scale);
@@ -432,6 +467,7 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event)
         if (event->wheel.y != 0)
         {
             scaleMultiplier += event->wheel.y;
+            interacting = true;
             changed = true;
         }
     }
@@ -441,6 +477,7 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event)
         {
             panX += event->motion.xrel;
             panY += event->motion.yrel;
+            interacting = true;
             changed = true;
         }
     }
@@ -520,6 +557,7 @@ void fileSaveDialogCallback(void *userdata, const char * const *filelist, int fi
 
     // Rasterize.
     SDL_LockSurface(surface);
+    svg->setQuality(ANIMATED_SVG_QUALITY_NORMAL);
     svg->rasterize((unsigned short*)surface->pixels, windowWidth, windowHeight, windowWidth * 4,
                    panX + windowWidth/2 - svg->width() * scale/2,
                    panY + windowHeight/2 - svg->height() * scale/2, scale);
@@ -533,6 +571,198 @@ void fileSaveDialogCallback(void *userdata, const char * const *filelist, int fi
     }
 }
 
+bool exportFrames()
+{
+    if (exportFps <= 0 || (exportEndMs >= 0 && exportEndMs < exportStartMs) || exportThreads < 0)
+    {
+        SDL_Log("Invalid export time range, fps or threads");
+        return false;
+    }
+
+    // Frames are exported from the start time until before the end time, or a single frame without an end time.
+    exportFrameCount = (exportEndMs >= 0) ? (int)((long long)(exportEndMs - exportStartMs) * exportFps / 1000) : 1;
+    exportFrameCount = (exportFrameCount > 0) ? exportFrameCount : 1;
+    // The pattern is formatted with the frame number, so it may only convert the frame number (any other % as %%).
+    int conversions = countFrameConversions(exportPattern);
+    if (conversions < 0 || conversions > 1 || (exportFrameCount > 1 && conversions == 0))
+    {
+        SDL_Log("Export pattern should contain the frame number once (e.g. frame%%04d.png): %s", exportPattern);
+        return false;
+    }
+
+    exportContent = readFileContent(filePath);
+    if (exportContent == NULL)
+    {
+        SDL_Log("Error reading input file: %s", filePath);
+        return false;
+    }
+
+    // Load the image once for its size, the default export size, keeping the aspect ratio if only one is set.
+    AnimatedSVG* probe = new AnimatedSVG(exportContent, NULL, 0, 0, ANIMATED_SVG_OPTION_BGRA8888);
+    bool loaded = probe->load();
+    int imageWidth = probe->width();
+    int imageHeight = probe->height();
+    delete probe;
+    if (!loaded || imageWidth <= 0 || imageHeight <= 0)
+    {
+        SDL_Log("Error loading SVG file: %s", filePath);
+        SDL_free(exportContent);
+        return false;
+    }
+    if (exportWidth <= 0 && exportHeight <= 0)
+    {
+        exportWidth = imageWidth;
+        exportHeight = imageHeight;
+    }
+    else if (exportWidth <= 0)
+    {
+        exportWidth = (exportHeight * imageWidth + imageHeight / 2) / imageHeight;
+    }
+    else if (exportHeight <= 0)
+    {
+        exportHeight = (exportWidth * imageHeight + imageWidth / 2) / imageWidth;
+    }
+    bufferWidth = (fixedBufferWidth < 0) ? exportWidth : fixedBufferWidth;
+    bufferHeight = (fixedBufferHeight < 0) ? exportHeight : fixedBufferHeight;
+
+    // Each thread has its own instance, since animating modifies the image, and takes the next frame to export.
+    int threads = (exportThreads > 0) ? exportThreads : SDL_GetNumLogicalCPUCores();
+    threads = (threads < exportFrameCount) ? threads : exportFrameCount;
+    threads = (threads > 0) ? threads : 1;
+    SDL_SetAtomicInt(&exportNextFrame, 0);
+    SDL_SetAtomicInt(&exportFailed, 0);
+
+    SDL_Time startTime = 0, endTime = 0;
+    SDL_GetCurrentTime(&startTime);
+
+    std::vector<SDL_Thread*> workers;
+    for (int i = 0; i < threads; i++)
+    {
+        SDL_Thread* thread = SDL_CreateThread(exportWorker, "export", NULL);
+        if (thread == NULL)
+        {
+            SDL_Log("Error creating export thread: %s", SDL_GetError());
+            SDL_SetAtomicInt(&exportFailed, 1);
+            break;
+        }
+        workers.push_back(thread);
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        SDL_WaitThread(workers[i], NULL);
+    }
+
+    SDL_GetCurrentTime(&endTime);
+    SDL_free(exportContent);
+    exportContent = NULL;
+
+    if (SDL_GetAtomicInt(&exportFailed))
+    {
+        return false;
+    }
+
+    SDL_Log("Exported %d frames of %dx%d in %.2fms with %d threads", exportFrameCount, exportWidth, exportHeight,
+            (endTime - startTime) / 1000000.0f, (int)workers.size());
+
+    return true;
+}
+
+int exportWorker(void* data)
+{
+    (void)data;
+    unsigned char* buffer = (unsigned char*)malloc(bufferWidth * bufferHeight * 4);
+    SDL_Surface* frameSurface = SDL_CreateSurface(exportWidth, exportHeight, SDL_PIXELFORMAT_ARGB8888);
+    AnimatedSVG* frameSvg = NULL;
+
+    if (buffer == NULL || frameSurface == NULL)
+    {
+        SDL_Log("Error allocating export buffers");
+        SDL_SetAtomicInt(&exportFailed, 1);
+    }
+    else
+    {
+        int options = ANIMATED_SVG_OPTION_BGRA8888;
+        options |= largeBuffer ? ANIMATED_SVG_OPTION_LARGE_BUFFER : 0;
+        // Parsing does not modify the SVG, so all instances parse the same content.
+        frameSvg = new AnimatedSVG(exportContent, buffer, bufferWidth, bufferHeight, options);
+        if (!frameSvg->load())
+        {
+            SDL_Log("Error loading SVG file: %s", filePath);
+            SDL_SetAtomicInt(&exportFailed, 1);
+        }
+        frameSvg->setQuality(ANIMATED_SVG_QUALITY_NORMAL);
+    }
+
+    while (!SDL_GetAtomicInt(&exportFailed))
+    {
+        int frame = SDL_AddAtomicInt(&exportNextFrame, 1);
+        if (frame >= exportFrameCount)
+        {
+            break;
+        }
+
+        // Frames are taken in order, so the animation of each instance only moves forward.
+        frameSvg->update(exportStartMs + (long)((long long)frame * 1000 / exportFps));
+
+        // Fit the image to the frame, centered.
+        float imageRatio = frameSvg->width() / (float)frameSvg->height();
+        float frameScale = (exportWidth / (float)exportHeight > imageRatio) ?
+                           (exportHeight / (float)frameSvg->height()) :
+                           (exportWidth / (float)frameSvg->width());
+
+        SDL_FillSurfaceRect(frameSurface, NULL, (background != 0) ? (background | 0xFF000000) : 0);
+        SDL_LockSurface(frameSurface);
+        frameSvg->rasterize((unsigned short*)frameSurface->pixels, exportWidth, exportHeight, frameSurface->pitch,
+                            exportWidth/2 - frameSvg->width() * frameScale/2,
+                            exportHeight/2 - frameSvg->height() * frameScale/2, frameScale);
+        SDL_UnlockSurface(frameSurface);
+
+        char path[1024];
+        snprintf(path, sizeof(path), exportPattern, frame);
+        if (!IMG_SavePNG(frameSurface, path))
+        {
+            SDL_Log("Error saving %s as PNG: %s", path, SDL_GetError());
+            SDL_SetAtomicInt(&exportFailed, 1);
+        }
+    }
+
+    delete frameSvg;
+    SDL_DestroySurface(frameSurface);
+    free(buffer);
+
+    return 0;
+}
+
+// Return the number of frame number conversions (%d or %0Nd) in the export pattern, or -1 if it has other conversions.
+int countFrameConversions(const char* pattern)
+{
+    int count = 0;
+
+    for (const char* ptr = pattern; *ptr != '\0'; ptr++)
+    {
+        if (*ptr != '%')
+        {
+            continue;
+        }
+        ptr++;
+        if (*ptr == '%')
+        {
+            continue;
+        }
+        while (*ptr >= '0' && *ptr <= '9')
+        {
+            ptr++;
+        }
+        if (*ptr != 'd')
+        {
+            return -1;
+        }
+        count++;
+    }
+
+    return count;
+}
+
 bool parseArgs(int argc, const char** argv)
 {
     CmdLineParser parser;
@@ -548,6 +778,13 @@ bool parseArgs(int argc, const char** argv)
     parser.AddBoolOption("z", "zoom", "zoom", "Enable/disable zoom to window", &zoomToWindow);
     parser.AddFlagOption("i", "show-info", "show info", "Show information on the rendered image", &showInfo);
     parser.AddFlagOption("p", "print-info", "print info", "Print information on the rendered image to the console", &printInfo);
+    parser.AddStringOption("e", "export", "export pattern", "Export frames to PNG files without a window (e.g. frame%04d.png)", &exportPattern);
+    parser.AddIntOption("es", "export-start", "export start", "Set the time of the first exported frame in milliseconds", &exportStartMs);
+    parser.AddIntOption("ee", "export-end", "export end", "Set the time the export ends before in milliseconds (default is a single frame)", &exportEndMs);
+    parser.AddIntOption("fps", "fps", "fps", "Set the frames per second of the export", &exportFps);
+    parser.AddIntOption("ew", "export-width", "export width", "Set the width of the exported frames (default is the image width)", &exportWidth);
+    parser.AddIntOption("eh", "export-height", "export height", "Set the height of the exported frames (default is the image height)", &exportHeight);
+    parser.AddIntOption("et", "export-threads", "export threads", "Set the number of threads of the export (default is the number of cores)", &exportThreads);
     parser.AddFlagOption("h", "help", "help", "Show this help", &syntax);
 
     bool success = parser.Parse(argc, argv);
@@ -593,6 +830,8 @@ std::vector<std::string> getInfo()
     info.push_back(buf);
     sprintf(buf, "Zoom to window:          %s", zoomToWindow ? "true" : "false");
     info.push_back(buf);
+    sprintf(buf, "Draft quality:           %s", draft ? "true" : "false");
+    info.push_back(buf);
     sprintf(buf, "Effective scale:         %.1f%%", scale * 100);
     info.push_back(buf);
     sprintf(buf, "Pan X:                   %d", panX);